@@ -0,0 +1,267 @@
+#ifndef BASE_COMPACT_TIME_SERIES_HPP
+#define BASE_COMPACT_TIME_SERIES_HPP
+
+#include <cstddef>
+#include <vector>
+#include <iterator>
+#include <stdexcept>
+#include <base/Time.hpp>
+
+namespace base{
+
+/** Compact storage for a sequence of times, e.g. the per-measurement
+ * timestamps of a DepthMap or the beam times of a SonarScan
+ *
+ * The first time is stored as-is. Each following time is stored as the
+ * difference between its delta to the previous time and the previous delta
+ * ("delta of delta"), zigzag- and varint-encoded. Regularly sampled times
+ * therefore need a single byte each, instead of eight for a std::vector<Time>.
+ *
+ * A checkpoint of the decoder state is kept every \c checkpoint_interval
+ * entries, so that random access only needs to decode at most that many
+ * entries. Sequential access through the iterators or decode() is the fast
+ * path.
+ */
+class CompactTimeSeries
+{
+public:
+    /** Input iterator that decodes the times on the fly. The times are not
+     * stored, so dereferencing returns them by value and the iterator is
+     * not a forward iterator. Only iterators of the same series can be
+     * compared */
+    class const_iterator
+    {
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef Time value_type;
+        typedef std::ptrdiff_t difference_type;
+        /** Points to the time decoded by the iterator */
+        typedef Time const* pointer;
+        typedef Time reference;
+
+        const_iterator() : data(0), index(0), size(0), delta(0) {}
+
+        Time operator*() const { return time; }
+        Time const* operator->() const { return &time; }
+
+        const_iterator& operator++()
+        {
+            ++index;
+            if (index < size)
+            {
+                delta += decodeVarint(data);
+                time.microseconds += delta;
+            }
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            const_iterator result = *this;
+            ++(*this);
+            return result;
+        }
+
+        bool operator==(const_iterator const& other) const { return index == other.index; }
+        bool operator!=(const_iterator const& other) const { return index != other.index; }
+
+    private:
+        friend class CompactTimeSeries;
+        const_iterator(uint8_t const* data, size_t index, size_t size, int64_t time, int64_t delta)
+            : data(data), index(index), size(size), time(Time::fromMicroseconds(time)), delta(delta) {}
+
+        uint8_t const* data;
+        size_t index;
+        size_t size;
+        Time time;
+        int64_t delta;
+    };
+
+    explicit CompactTimeSeries(size_t checkpoint_interval = 64)
+        : checkpoint_interval(checkpoint_interval ? checkpoint_interval : 1)
+        , count(0), last_time(0), last_delta(0) {}
+
+    explicit CompactTimeSeries(std::vector<Time> const& times, size_t checkpoint_interval = 64)
+        : checkpoint_interval(checkpoint_interval ? checkpoint_interval : 1)
+        , count(0), last_time(0), last_delta(0)
+    {
+        assign(times);
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    /** Returns the number of bytes used by the encoded times and the
+     * checkpoints */
+    size_t byteSize() const
+    {
+        return data.size() + checkpoints.size() * sizeof(Checkpoint);
+    }
+
+    void clear()
+    {
+        data.clear();
+        checkpoints.clear();
+        count = 0;
+        last_time = 0;
+        last_delta = 0;
+    }
+
+    /** Replaces the content with the given times */
+    void assign(std::vector<Time> const& times)
+    {
+        clear();
+        data.reserve(times.size() + 8);
+        checkpoints.reserve(times.size() / checkpoint_interval + 1);
+        for (size_t i = 0; i < times.size(); ++i)
+            push_back(times[i]);
+    }
+
+    /** Appends a time */
+    void push_back(Time const& time)
+    {
+        int64_t value = time.toMicroseconds();
+        if (count)
+        {
+            int64_t delta = value - last_time;
+            encodeVarint(delta - last_delta);
+            last_delta = delta;
+        }
+        last_time = value;
+        if (count % checkpoint_interval == 0)
+        {
+            Checkpoint checkpoint = { data.size(), last_time, last_delta };
+            checkpoints.push_back(checkpoint);
+        }
+        ++count;
+    }
+
+    /** Returns the i-th time, decoding at most checkpoint_interval entries */
+    Time operator[](size_t index) const
+    {
+        Checkpoint const& checkpoint = checkpoints[index / checkpoint_interval];
+        uint8_t const* it = bytes() + checkpoint.offset;
+        int64_t time = checkpoint.time, delta = checkpoint.delta;
+        for (size_t i = index % checkpoint_interval; i > 0; --i)
+        {
+            delta += decodeVarint(it);
+            time += delta;
+        }
+        return Time::fromMicroseconds(time);
+    }
+
+    /** Returns the i-th time
+     * \throws std::out_of_range if the index is out of bounds */
+    Time at(size_t index) const
+    {
+        if (index >= count)
+            throw std::out_of_range("CompactTimeSeries: index out of bounds");
+        return (*this)[index];
+    }
+
+    Time front() const { return (*this)[0]; }
+    Time back() const { return Time::fromMicroseconds(last_time); }
+
+    const_iterator begin() const
+    {
+        if (!count)
+            return end();
+        return const_iterator(bytes(), 0, count, checkpoints[0].time, checkpoints[0].delta);
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(0, count, count, 0, 0);
+    }
+
+    /** Decodes all times into \c times, reusing its memory */
+    void decode(std::vector<Time>& times) const
+    {
+        times.resize(count);
+        if (count)
+            decode(0, count, &times[0]);
+    }
+
+    /** Decodes \c n times starting at \c first into \c times */
+    void decode(size_t first, size_t n, Time* times) const
+    {
+        if (!n)
+            return;
+        if (first + n > count)
+            throw std::out_of_range("CompactTimeSeries: range out of bounds");
+
+        Checkpoint const& checkpoint = checkpoints[first / checkpoint_interval];
+        uint8_t const* it = bytes() + checkpoint.offset;
+        int64_t time = checkpoint.time, delta = checkpoint.delta;
+        for (size_t i = first % checkpoint_interval; i > 0; --i)
+        {
+            delta += decodeVarint(it);
+            time += delta;
+        }
+
+        times[0].microseconds = time;
+        for (size_t i = 1; i < n; ++i)
+        {
+            delta += decodeVarint(it);
+            time += delta;
+            times[i].microseconds = time;
+        }
+    }
+
+    /** Returns all times as a vector */
+    std::vector<Time> toVector() const
+    {
+        std::vector<Time> result;
+        decode(result);
+        return result;
+    }
+
+private:
+    struct Checkpoint
+    {
+        /** Offset in data of the entry that follows the checkpoint */
+        size_t offset;
+        int64_t time;
+        int64_t delta;
+    };
+
+    uint8_t const* bytes() const { return data.empty() ? 0 : &data[0]; }
+
+    void encodeVarint(int64_t value)
+    {
+        // Zigzag encoding, so that small negative values are small as well
+        uint64_t encoded = (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+        while (encoded >= 0x80)
+        {
+            data.push_back(static_cast<uint8_t>(encoded) | 0x80);
+            encoded >>= 7;
+        }
+        data.push_back(static_cast<uint8_t>(encoded));
+    }
+
+    static int64_t decodeVarint(uint8_t const*& it)
+    {
+        uint64_t encoded = 0;
+        int shift = 0;
+        uint8_t byte;
+        do
+        {
+            byte = *it++;
+            encoded |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            shift += 7;
+        }
+        while (byte & 0x80);
+        return static_cast<int64_t>(encoded >> 1) ^ -static_cast<int64_t>(encoded & 1);
+    }
+
+    size_t checkpoint_interval;
+    std::vector<uint8_t> data;
+    std::vector<Checkpoint> checkpoints;
+    size_t count;
+    int64_t last_time;
+    int64_t last_delta;
+};
+
+}
+
+#endif
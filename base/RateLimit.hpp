@@ -0,0 +1,54 @@
+#ifndef BASE_RATE_LIMIT_HPP
+#define BASE_RATE_LIMIT_HPP
+
+#include <base/Time.hpp>
+
+namespace base{
+
+/** Limits the rate of a diagnostic message
+ *
+ * The header-only types cannot use the logging macros of base-lib (and
+ * their _EVERY_T variants). This is the equivalent for messages that go to
+ * std::cerr, to avoid flooding the output when e.g. a driver calls a setter
+ * with wrong sizes for every sample.
+ *
+ * It is a POD, so that a function-local static is zero-initialized without
+ * any guard:
+ *
+ * \code
+ * static base::RateLimit limit;
+ * unsigned int suppressed;
+ * if (limit.allow(base::Time::fromSeconds(1), suppressed))
+ *     std::cerr << "message (" << suppressed << " suppressed)" << std::endl;
+ * \endcode
+ */
+struct RateLimit
+{
+    /** Earliest monotonic time of the next message, in microseconds */
+    int64_t next;
+    unsigned int suppressed;
+
+    /** Returns true if the last allowed message is at least \c period old
+     *
+     * @param dropped set to the number of messages that got suppressed
+     *   since the last allowed message
+     */
+    bool allow(Time const& period, unsigned int& dropped)
+    {
+        int64_t now = Time::now(Time::MonotonicCoarseClock).toMicroseconds();
+        int64_t expected = __atomic_load_n(&next, __ATOMIC_RELAXED);
+        if (now < expected || !__atomic_compare_exchange_n(&next, &expected,
+                    now + period.toMicroseconds(), false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            __atomic_add_fetch(&suppressed, 1, __ATOMIC_RELAXED);
+            dropped = 0;
+            return false;
+        }
+        dropped = __atomic_exchange_n(&suppressed, 0, __ATOMIC_RELAXED);
+        return true;
+    }
+};
+
+}
+
+#endif
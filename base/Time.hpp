@@ -30,12 +30,86 @@ namespace base
             : microseconds(0) {}
 
 
+        /** The clocks that can be read with now(ClockSource) */
+        enum ClockSource
+        {
+            /** The wall clock (CLOCK_REALTIME). This is what now() returns.
+             * It jumps when the system time is set, e.g. by NTP */
+            RealtimeClock = 0,
+            /** CLOCK_MONOTONIC. Never jumps, but has an arbitrary origin */
+            MonotonicClock,
+            /** CLOCK_MONOTONIC_COARSE. Same time base than MonotonicClock,
+             * but only updated once per kernel tick (a few milliseconds).
+             * It is the cheapest clock to read */
+            MonotonicCoarseClock,
+            /** The CPU time-stamp counter, calibrated against MonotonicClock
+             * on first use. Only use it on CPUs with an invariant TSC. It is
+             * the same as MonotonicClock on non-x86 platforms */
+            TscClock
+        };
+
     public:
         /** Returns the current time */
         static Time now() {
-            timeval t;
-            gettimeofday(&t, 0);
-            return Time(static_cast<int64_t>(t.tv_sec) * UsecPerSec + t.tv_usec);
+            return now(RealtimeClock);
+        }
+
+        /** Returns the current time of the given clock
+         *
+         * Only RealtimeClock returns a time that can be compared to now() and
+         * converted with toString(). The other clocks should only be used to
+         * compute durations.
+         */
+        static Time now(ClockSource source) {
+            return Time(nanoseconds(source) / 1000);
+        }
+
+        /** Returns the current time of the monotonic clock selected with
+         * setMonotonicClockSource (MonotonicClock by default)
+         *
+         * Use it for timeouts and latency measurements, i.e. everywhere where
+         * the result of now() would be wrong if the system time was set
+         */
+        static Time monotonicNow() {
+            return now(getMonotonicClockSource());
+        }
+
+        /** Returns the clock used by monotonicNow() */
+        static ClockSource getMonotonicClockSource() {
+            return __atomic_load_n(&monotonicClockSource(), __ATOMIC_RELAXED);
+        }
+
+        /** Selects the clock used by monotonicNow()
+         *
+         * All monotonic clocks share the same time base, so this can be
+         * changed at runtime. It is meant to be called once at startup though.
+         *
+         * \throws std::invalid_argument if \c source is RealtimeClock
+         */
+        static void setMonotonicClockSource(ClockSource source) {
+            if (source == RealtimeClock)
+                throw std::invalid_argument("base::Time::setMonotonicClockSource: RealtimeClock is not monotonic");
+            __atomic_store_n(&monotonicClockSource(), source, __ATOMIC_RELAXED);
+        }
+
+        /** Returns the raw reading of the given clock, in nanoseconds */
+        static int64_t nanoseconds(ClockSource source) {
+            switch(source)
+            {
+                case RealtimeClock:
+                    return readClock(CLOCK_REALTIME);
+                case MonotonicClock:
+                    return readClock(CLOCK_MONOTONIC);
+                case MonotonicCoarseClock:
+#ifdef CLOCK_MONOTONIC_COARSE
+                    return readClock(CLOCK_MONOTONIC_COARSE);
+#else
+                    return readClock(CLOCK_MONOTONIC);
+#endif
+                case TscClock:
+                    return readTsc();
+            }
+            throw std::invalid_argument("base::Time::nanoseconds: invalid clock source");
         }
 
         bool operator < (Time const& ts) const
@@ -76,6 +150,12 @@ namespace base
          **/
 	std::string toString(base::Time::Resolution resolution = Microseconds, const std::string& mainFormat = "%Y%m%d-%H:%M:%S") const
 	{
+            if (mainFormat == "%Y%m%d-%H:%M:%S")
+            {
+                char buffer[MaxStringLength];
+                return std::string(buffer, toChars(buffer, sizeof(buffer), resolution));
+            }
+
             struct timeval tv = toTimeval();
             int uSecs = tv.tv_usec;
 
@@ -103,6 +183,94 @@ namespace base
 	    return std::string(buffer);
 	}
 
+        /** Maximum length of the strings generated by toChars() and
+         * toISO8601(), including the terminating NUL character */
+        static const int MaxStringLength = 32;
+
+        /** Writes this time in the default toString() layout
+         * (%Y%m%d-%H:%M:%S plus ':' and the sub-second part if requested by
+         * \c resolution) into \c buffer
+         *
+         * Unlike toString(), it does not allocate. The date and time part is
+         * cached per thread, so that localtime is called at most once per
+         * minute.
+         *
+         * \returns the length of the string (without the terminating NUL
+         *   character), or zero if \c size is too small
+         */
+        size_t toChars(char* buffer, size_t size, Resolution resolution = Microseconds) const
+        {
+            int64_t seconds = floorDiv(microseconds, UsecPerSec);
+            int64_t minute = floorDiv(seconds, 60);
+            size_t length = 17 + fractionLength(resolution);
+            if (size <= length)
+                return 0;
+
+            LocalTimeCache& cache = localTimeCache();
+            if (!cache.valid || cache.minute != minute)
+            {
+                time_t when = minute * 60;
+                struct tm tm;
+                localtime_r(&when, &tm);
+                writeDigits(cache.text, tm.tm_year + 1900, 4);
+                writeDigits(cache.text + 4, tm.tm_mon + 1, 2);
+                writeDigits(cache.text + 6, tm.tm_mday, 2);
+                cache.text[8] = '-';
+                writeDigits(cache.text + 9, tm.tm_hour, 2);
+                cache.text[11] = ':';
+                writeDigits(cache.text + 12, tm.tm_min, 2);
+                cache.text[14] = ':';
+                cache.minute = minute;
+                cache.valid = true;
+            }
+
+            for (int i = 0; i < 15; ++i)
+                buffer[i] = cache.text[i];
+            writeDigits(buffer + 15, seconds - minute * 60, 2);
+            writeFraction(buffer + 17, ':', microseconds - seconds * UsecPerSec, resolution);
+            buffer[length] = 0;
+            return length;
+        }
+
+        /** Writes this time as an ISO 8601 UTC string
+         * (YYYY-MM-DDTHH:MM:SS plus '.' and the sub-second part if requested
+         * by \c resolution, plus 'Z') into \c buffer
+         *
+         * It does not allocate and does not use the C library's time
+         * functions.
+         *
+         * \returns the length of the string (without the terminating NUL
+         *   character), or zero if \c size is too small
+         */
+        size_t toISO8601(char* buffer, size_t size, Resolution resolution = Microseconds) const
+        {
+            size_t length = 20 + fractionLength(resolution);
+            if (size <= length)
+                return 0;
+
+            int64_t seconds = floorDiv(microseconds, UsecPerSec);
+            int64_t days = floorDiv(seconds, 86400);
+            int64_t secondOfDay = seconds - days * 86400;
+            int year, month, day;
+            civilFromDays(days, year, month, day);
+
+            writeDigits(buffer, year, 4);
+            buffer[4] = '-';
+            writeDigits(buffer + 5, month, 2);
+            buffer[7] = '-';
+            writeDigits(buffer + 8, day, 2);
+            buffer[10] = 'T';
+            writeDigits(buffer + 11, secondOfDay / 3600, 2);
+            buffer[13] = ':';
+            writeDigits(buffer + 14, (secondOfDay / 60) % 60, 2);
+            buffer[16] = ':';
+            writeDigits(buffer + 17, secondOfDay % 60, 2);
+            writeFraction(buffer + 19, '.', microseconds - seconds * UsecPerSec, resolution);
+            buffer[length - 1] = 'Z';
+            buffer[length] = 0;
+            return length;
+        }
+
         /** Returns this time as a fractional number of seconds */
         double toSeconds() const
         { return static_cast<double>(microseconds) / UsecPerSec; }
@@ -180,6 +348,9 @@ namespace base
         */
         static Time fromString(const std::string& stringTime, Resolution resolution = Microseconds, const std::string& mainFormat = "%Y%m%d-%H:%M:%S")
         {
+            if (mainFormat == "%Y%m%d-%H:%M:%S")
+                return fromChars(stringTime.c_str(), stringTime.size(), resolution);
+
             std::string mainTime = stringTime;
             int32_t usecs = 0;
             if(resolution > Seconds)
@@ -225,6 +396,274 @@ namespace base
             return Time(static_cast<int64_t>(time)*UsecPerSec + static_cast<int64_t>(usecs));
         }
 
+
+        /** Parses a string in the default toString() layout
+         * (%Y%m%d-%H:%M:%S plus ':' and the sub-second part)
+         *
+         * This is the allocation-free equivalent of fromString() with the
+         * default format. mktime is called at most once per minute and thread.
+         *
+         * \param resolution Set to a resolution higher than Seconds if the
+         *   sub-second field is present. Milliseconds accepts three or six
+         *   digits, Microseconds requires six.
+         * \throws std::runtime_error if the string does not match the layout
+         */
+        static Time fromChars(const char* str, size_t length, Resolution resolution = Microseconds)
+        {
+            int year, month, day, hour, minute, second;
+            if (length < 17 ||
+                    !parseDigits(str, 4, year) || !parseDigits(str + 4, 2, month) ||
+                    !parseDigits(str + 6, 2, day) || str[8] != '-' ||
+                    !parseDigits(str + 9, 2, hour) || str[11] != ':' ||
+                    !parseDigits(str + 12, 2, minute) || str[14] != ':' ||
+                    !parseDigits(str + 15, 2, second))
+                throw std::runtime_error("base::Time::fromChars failed - string does not match %Y%m%d-%H:%M:%S");
+
+            int64_t usecs = 0;
+            if (resolution > Seconds)
+                usecs = parseFraction(str + 17, length - 17, ':', resolution);
+
+            // Cache the local -> UTC conversion of the current minute
+            int64_t localMinute = (daysFromCivil(year, month, day) * 24 + hour) * 60 + minute;
+            LocalTimeCache& cache = parseCache();
+            if (!cache.valid || cache.minute != localMinute)
+            {
+                struct tm tm;
+                tm.tm_year = year - 1900;
+                tm.tm_mon = month - 1;
+                tm.tm_mday = day;
+                tm.tm_hour = hour;
+                tm.tm_min = minute;
+                tm.tm_sec = 0;
+                tm.tm_isdst = -1;
+                cache.utc = mktime(&tm);
+                cache.minute = localMinute;
+                cache.valid = true;
+            }
+            return Time((static_cast<int64_t>(cache.utc) + second) * UsecPerSec + usecs);
+        }
+
+        /** Parses an ISO 8601 string as generated by toISO8601
+         *
+         * The fractional part is optional and may have up to 9 digits (it is
+         * truncated to microseconds). The string must end with either 'Z' or
+         * a +HH:MM / -HH:MM UTC offset. It does not allocate and does not
+         * use the C library's time functions.
+         *
+         * \throws std::runtime_error if the string does not match
+         */
+        static Time fromISO8601(const char* str, size_t length)
+        {
+            int year, month, day, hour, minute, second;
+            if (length < 20 ||
+                    !parseDigits(str, 4, year) || str[4] != '-' ||
+                    !parseDigits(str + 5, 2, month) || str[7] != '-' ||
+                    !parseDigits(str + 8, 2, day) || (str[10] != 'T' && str[10] != ' ') ||
+                    !parseDigits(str + 11, 2, hour) || str[13] != ':' ||
+                    !parseDigits(str + 14, 2, minute) || str[16] != ':' ||
+                    !parseDigits(str + 17, 2, second))
+                throw std::runtime_error("base::Time::fromISO8601 failed - string does not match YYYY-MM-DDTHH:MM:SS");
+
+            size_t pos = 19;
+            int64_t usecs = 0;
+            if (str[pos] == '.')
+            {
+                int64_t scale = 100000;
+                for (++pos; pos < length && str[pos] >= '0' && str[pos] <= '9'; ++pos)
+                {
+                    usecs += (str[pos] - '0') * scale;
+                    scale /= 10;
+                }
+            }
+
+            int64_t offset = 0;
+            if (pos + 1 == length && str[pos] == 'Z')
+                offset = 0;
+            else if (pos + 6 == length && (str[pos] == '+' || str[pos] == '-') && str[pos + 3] == ':')
+            {
+                int offsetHours, offsetMinutes;
+                if (!parseDigits(str + pos + 1, 2, offsetHours) || !parseDigits(str + pos + 4, 2, offsetMinutes))
+                    throw std::runtime_error("base::Time::fromISO8601 failed - invalid UTC offset");
+                offset = (offsetHours * 60 + offsetMinutes) * 60;
+                if (str[pos] == '-')
+                    offset = -offset;
+            }
+            else
+                throw std::runtime_error("base::Time::fromISO8601 failed - expected 'Z' or a UTC offset after the time");
+
+            int64_t seconds = ((daysFromCivil(year, month, day) * 24 + hour) * 60 + minute) * 60 + second - offset;
+            return Time(seconds * UsecPerSec + usecs);
+        }
+
+    private:
+        /** Per-thread cache of the local date and time of one minute */
+        struct LocalTimeCache
+        {
+            bool valid;
+            int64_t minute;
+            time_t utc;
+            char text[16];
+        };
+
+        static LocalTimeCache& localTimeCache()
+        {
+            static __thread LocalTimeCache cache;
+            return cache;
+        }
+
+        static LocalTimeCache& parseCache()
+        {
+            static __thread LocalTimeCache cache;
+            return cache;
+        }
+
+        static int64_t floorDiv(int64_t value, int64_t divider)
+        {
+            int64_t result = value / divider;
+            if (value % divider < 0)
+                --result;
+            return result;
+        }
+
+        static size_t fractionLength(Resolution resolution)
+        {
+            switch(resolution)
+            {
+                case Milliseconds: return 4;
+                case Microseconds: return 7;
+                default: return 0;
+            }
+        }
+
+        static void writeDigits(char* buffer, int64_t value, int count)
+        {
+            for (int i = count - 1; i >= 0; --i)
+            {
+                buffer[i] = '0' + value % 10;
+                value /= 10;
+            }
+        }
+
+        static void writeFraction(char* buffer, char separator, int64_t usecs, Resolution resolution)
+        {
+            if (resolution == Milliseconds)
+            {
+                buffer[0] = separator;
+                writeDigits(buffer + 1, usecs / 1000, 3);
+            }
+            else if (resolution == Microseconds)
+            {
+                buffer[0] = separator;
+                writeDigits(buffer + 1, usecs, 6);
+            }
+        }
+
+        static bool parseDigits(const char* str, int count, int& value)
+        {
+            value = 0;
+            for (int i = 0; i < count; ++i)
+            {
+                if (str[i] < '0' || str[i] > '9')
+                    return false;
+                value = value * 10 + (str[i] - '0');
+            }
+            return true;
+        }
+
+        /** Parses the ':usec' or ':msec' part of the default layout, with
+         * the same rules than fromString */
+        static int64_t parseFraction(const char* str, size_t length, char separator, Resolution resolution)
+        {
+            int value;
+            if (length == 7 && str[0] == separator && parseDigits(str + 1, 6, value))
+                return resolution == Milliseconds ? value / 1000 * 1000 : value;
+            else if (length == 4 && str[0] == separator && resolution == Milliseconds && parseDigits(str + 1, 3, value))
+                return value * 1000;
+            throw std::runtime_error("base::Time::fromChars failed - resolution does not match provided Time-String");
+        }
+
+        /** Number of days since 1970-01-01 of the given proleptic gregorian date */
+        static int64_t daysFromCivil(int64_t year, int month, int day)
+        {
+            year -= month <= 2;
+            int64_t era = (year >= 0 ? year : year - 399) / 400;
+            int64_t yearOfEra = year - era * 400;
+            int64_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+            int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+            return era * 146097 + dayOfEra - 719468;
+        }
+
+        /** Inverse of daysFromCivil */
+        static void civilFromDays(int64_t days, int& year, int& month, int& day)
+        {
+            days += 719468;
+            int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+            int64_t dayOfEra = days - era * 146097;
+            int64_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+            int64_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+            int64_t mp = (5 * dayOfYear + 2) / 153;
+            day = dayOfYear - (153 * mp + 2) / 5 + 1;
+            month = mp < 10 ? mp + 3 : mp - 9;
+            year = yearOfEra + era * 400 + (month <= 2);
+        }
+
+        static int64_t readClock(clockid_t clock)
+        {
+            timespec t;
+            clock_gettime(clock, &t);
+            return static_cast<int64_t>(t.tv_sec) * 1000000000LL + t.tv_nsec;
+        }
+
+        /** Read by monotonicNow() on any thread, accessed atomically */
+        static ClockSource& monotonicClockSource()
+        {
+            static ClockSource source = MonotonicClock;
+            return source;
+        }
+
+#if defined(__x86_64__) || defined(__i386__)
+        static uint64_t readTscCounter()
+        {
+            uint32_t lo, hi;
+            __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+            return (static_cast<uint64_t>(hi) << 32) | lo;
+        }
+
+        /** Offset and scale that map the TSC onto CLOCK_MONOTONIC */
+        struct TscCalibration
+        {
+            uint64_t counter;
+            int64_t nanoseconds;
+            double nsPerTick;
+
+            TscCalibration()
+            {
+                // Measure the TSC rate over ~20ms. The clock/counter pairs are
+                // read back-to-back so that the rate is not biased by the
+                // time it takes to read the clock
+                uint64_t c0 = readTscCounter();
+                int64_t ns0 = readClock(CLOCK_MONOTONIC);
+                int64_t ns1;
+                do { ns1 = readClock(CLOCK_MONOTONIC); }
+                while (ns1 - ns0 < 20000000LL);
+                uint64_t c1 = readTscCounter();
+
+                counter = c0;
+                nanoseconds = ns0;
+                nsPerTick = static_cast<double>(ns1 - ns0) / static_cast<double>(c1 - c0);
+            }
+        };
+
+        static int64_t readTsc()
+        {
+            static const TscCalibration calibration;
+            uint64_t ticks = readTscCounter() - calibration.counter;
+            return calibration.nanoseconds + static_cast<int64_t>(ticks * calibration.nsPerTick);
+        }
+#else
+        static int64_t readTsc()
+        { return readClock(CLOCK_MONOTONIC); }
+#endif
     };
 
     inline std::ostream& operator << (std::ostream& io, base::Time const& time)
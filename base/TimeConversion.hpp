@@ -0,0 +1,202 @@
+#ifndef BASE_TIME_CONVERSION_HPP
+#define BASE_TIME_CONVERSION_HPP
+
+#include <vector>
+#include <stdexcept>
+#include <base/Time.hpp>
+
+/** \file TimeConversion.hpp
+ * Conversion of whole arrays of base::Time, e.g. DepthMap::timestamps or
+ * SonarScan::time_beams
+ *
+ * The loops have no branches and no dependencies between iterations, so that
+ * the compiler can vectorize them.
+ */
+
+namespace base
+{
+    /** Converts \c count times into fractional seconds */
+    inline void toSeconds(const Time* __restrict__ times, size_t count, double* __restrict__ seconds)
+    {
+        for (size_t i = 0; i < count; ++i)
+            seconds[i] = static_cast<double>(times[i].microseconds) / Time::UsecPerSec;
+    }
+
+    /** Converts \c count times into seconds relative to \c reference */
+    inline void toSeconds(const Time* __restrict__ times, size_t count, Time const& reference, double* __restrict__ seconds)
+    {
+        const int64_t offset = reference.microseconds;
+        for (size_t i = 0; i < count; ++i)
+            seconds[i] = static_cast<double>(times[i].microseconds - offset) / Time::UsecPerSec;
+    }
+
+    /** Converts \c count fractional seconds into times, with the same
+     * rounding than Time::fromSeconds(double) */
+    inline void fromSeconds(const double* __restrict__ seconds, size_t count, Time* __restrict__ times)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            int64_t full = seconds[i];
+            times[i].microseconds = full * Time::UsecPerSec + static_cast<int64_t>(round((seconds[i] - full) * Time::UsecPerSec));
+        }
+    }
+
+    /** Converts \c count seconds relative to \c reference into times */
+    inline void fromSeconds(const double* __restrict__ seconds, size_t count, Time const& reference, Time* __restrict__ times)
+    {
+        const int64_t offset = reference.microseconds;
+        for (size_t i = 0; i < count; ++i)
+        {
+            int64_t full = seconds[i];
+            times[i].microseconds = offset + full * Time::UsecPerSec + static_cast<int64_t>(round((seconds[i] - full) * Time::UsecPerSec));
+        }
+    }
+
+    /** Converts \c count times into microseconds */
+    inline void toMicroseconds(const Time* __restrict__ times, size_t count, int64_t* __restrict__ microseconds)
+    {
+        for (size_t i = 0; i < count; ++i)
+            microseconds[i] = times[i].microseconds;
+    }
+
+    /** Converts \c count times into microseconds relative to \c reference */
+    inline void toMicroseconds(const Time* __restrict__ times, size_t count, Time const& reference, int64_t* __restrict__ microseconds)
+    {
+        const int64_t offset = reference.microseconds;
+        for (size_t i = 0; i < count; ++i)
+            microseconds[i] = times[i].microseconds - offset;
+    }
+
+    /** Converts \c count microseconds into times */
+    inline void fromMicroseconds(const int64_t* __restrict__ microseconds, size_t count, Time* __restrict__ times)
+    {
+        for (size_t i = 0; i < count; ++i)
+            times[i].microseconds = microseconds[i];
+    }
+
+    /** Converts \c count microseconds relative to \c reference into times */
+    inline void fromMicroseconds(const int64_t* __restrict__ microseconds, size_t count, Time const& reference, Time* __restrict__ times)
+    {
+        const int64_t offset = reference.microseconds;
+        for (size_t i = 0; i < count; ++i)
+            times[i].microseconds = offset + microseconds[i];
+    }
+
+    /** Converts a vector of times into fractional seconds */
+    inline void toSeconds(std::vector<Time> const& times, std::vector<double>& seconds)
+    {
+        seconds.resize(times.size());
+        if (!times.empty())
+            toSeconds(&times[0], times.size(), &seconds[0]);
+    }
+
+    /** Converts a vector of times into seconds relative to \c reference */
+    inline void toSeconds(std::vector<Time> const& times, Time const& reference, std::vector<double>& seconds)
+    {
+        seconds.resize(times.size());
+        if (!times.empty())
+            toSeconds(&times[0], times.size(), reference, &seconds[0]);
+    }
+
+    /** Converts a vector of fractional seconds into times */
+    inline void fromSeconds(std::vector<double> const& seconds, std::vector<Time>& times)
+    {
+        times.resize(seconds.size());
+        if (!seconds.empty())
+            fromSeconds(&seconds[0], seconds.size(), &times[0]);
+    }
+
+    /** Converts a vector of seconds relative to \c reference into times */
+    inline void fromSeconds(std::vector<double> const& seconds, Time const& reference, std::vector<Time>& times)
+    {
+        times.resize(seconds.size());
+        if (!seconds.empty())
+            fromSeconds(&seconds[0], seconds.size(), reference, &times[0]);
+    }
+
+    /** Converts a vector of times into microseconds */
+    inline void toMicroseconds(std::vector<Time> const& times, std::vector<int64_t>& microseconds)
+    {
+        microseconds.resize(times.size());
+        if (!times.empty())
+            toMicroseconds(&times[0], times.size(), &microseconds[0]);
+    }
+
+    /** Converts a vector of microseconds into times */
+    inline void fromMicroseconds(std::vector<int64_t> const& microseconds, std::vector<Time>& times)
+    {
+        times.resize(microseconds.size());
+        if (!microseconds.empty())
+            fromMicroseconds(&microseconds[0], microseconds.size(), &times[0]);
+    }
+
+    /** Returns the time of element \c index out of \c count elements (e.g. rows
+     * or beams) given a timestamp vector following the DepthMap convention
+     *
+     * \c timestamps can either have one entry (all elements have the same
+     * time), two entries (the times of the first and last elements, the
+     * other ones are interpolated) or \c count entries.
+     *
+     * \throws std::invalid_argument if timestamps has another size
+     * \throws std::out_of_range if index is not less than count
+     */
+    inline Time interpolateTime(std::vector<Time> const& timestamps, size_t index, size_t count)
+    {
+        if (index >= count)
+            throw std::out_of_range("base::interpolateTime: index out of range");
+        if (timestamps.size() == count)
+            return timestamps[index];
+        else if (timestamps.size() == 1)
+            return timestamps[0];
+        else if (timestamps.size() == 2)
+        {
+            if (count < 2)
+                return timestamps[0];
+            int64_t first = timestamps[0].microseconds;
+            double step = static_cast<double>(timestamps[1].microseconds - first) / (count - 1);
+            return Time::fromMicroseconds(first + static_cast<int64_t>(round(step * index)));
+        }
+        throw std::invalid_argument("base::interpolateTime: expected one, two or one timestamp per element");
+    }
+
+    /** Computes the times of \c count elements (e.g. rows or beams) given a
+     * timestamp vector following the DepthMap convention, see
+     * interpolateTime
+     *
+     * \throws std::invalid_argument if timestamps has an invalid size
+     */
+    inline void interpolateTimes(std::vector<Time> const& timestamps, size_t count, Time* __restrict__ times)
+    {
+        if (timestamps.size() == count)
+        {
+            for (size_t i = 0; i < count; ++i)
+                times[i] = timestamps[i];
+        }
+        else if (timestamps.size() == 1)
+        {
+            const int64_t value = timestamps[0].microseconds;
+            for (size_t i = 0; i < count; ++i)
+                times[i].microseconds = value;
+        }
+        else if (timestamps.size() == 2)
+        {
+            const int64_t first = timestamps[0].microseconds;
+            const double step = count < 2 ? 0 :
+                static_cast<double>(timestamps[1].microseconds - first) / (count - 1);
+            for (size_t i = 0; i < count; ++i)
+                times[i].microseconds = first + static_cast<int64_t>(round(step * i));
+        }
+        else
+            throw std::invalid_argument("base::interpolateTimes: expected one, two or one timestamp per element");
+    }
+
+    /** Computes the times of \c count elements, see interpolateTime */
+    inline void interpolateTimes(std::vector<Time> const& timestamps, size_t count, std::vector<Time>& times)
+    {
+        times.resize(count);
+        if (count)
+            interpolateTimes(timestamps, count, &times[0]);
+    }
+}
+
+#endif
@@ -2,15 +2,28 @@
 #define BASE_TIMEOUT_HPP
 
 #include <base/Time.hpp>
+#include <base/TimeoutSet.hpp>
 
 namespace base{
 
 /** A timeout tracking class
+ *
+ * Timeouts are measured with base::Time::monotonicNow(), i.e. they are not
+ * affected by changes of the system time
+ *
+ * A timeout can also be a view on a TimeoutSet, in which case it uses the
+ * set's cached time instead of reading the clock. Use TimeoutSet directly to
+ * manage many deadlines.
  */
 class Timeout {
 private:
     base::Time timeout;
     base::Time start_time;
+    const TimeoutSet* clock;
+
+    base::Time now() const{
+        return clock ? clock->now() : base::Time::monotonicNow();
+    }
 
 public:
     /**
@@ -18,21 +31,34 @@ public:
      * @param timeout, if zero is given the timeout is inactive 
      */
     Timeout(base::Time timeout = base::Time::fromSeconds(0))
-    : timeout(timeout) 
+    : timeout(timeout), clock(0)
+    {
+    start_time = now();
+    }
+
+    /**
+     * Initializes and starts a timeout that uses the current time of the
+     * given set, i.e. that is only updated by TimeoutSet::update
+     * @param timeout, if zero is given the timeout is inactive 
+     * @param clock  the set, it must outlive the timeout
+     */
+    Timeout(base::Time timeout, TimeoutSet const& clock)
+    : timeout(timeout), clock(&clock)
     {
-    start_time = base::Time::now();
+    start_time = now();
     }
 
     /**
      * Restarts the timeout
      */
     void restart(){
-        start_time = base::Time::now();
+        start_time = now();
     }
 
     /**
      * Checks if the timeout is already elapsed.
-     * This uses a syscall, so use sparingly and cache results
+     * This reads the monotonic clock unless the timeout is a view on a
+     * TimeoutSet, so use sparingly and cache results
      * @returns  true if the timeout is elapsed
      */
     bool elapsed() const{
@@ -41,13 +67,14 @@ public:
 
     /**
      * Checks if the timeout is already elapsed.
-     * This uses a syscall, so use sparingly and cache results
+     * This reads the monotonic clock unless the timeout is a view on a
+     * TimeoutSet, so use sparingly and cache results
      * @param timeout  a custom timeout
      * @returns  true if the timeout is elapsed
      */
     bool elapsed(const base::Time &timeout) const{
         if(!timeout.isNull()){
-            return start_time + timeout < base::Time::now();
+            return start_time + timeout < now();
         }else{
             return false;
         }
@@ -55,7 +82,8 @@ public:
 
     /**
      * Calculates the time left for this timeout
-     * This uses a syscall, so use sparingly and cache results
+     * This reads the monotonic clock unless the timeout is a view on a
+     * TimeoutSet, so use sparingly and cache results
      * @returns  number of milliseconds this timeout as left
      */
     base::Time timeLeft() const{
@@ -64,13 +92,14 @@ public:
 
     /**
      * Calculates the time left for this timeout
-     * This uses a syscall, so use sparingly and cache results
+     * This reads the monotonic clock unless the timeout is a view on a
+     * TimeoutSet, so use sparingly and cache results
      * @param timeout  a custom timeout
      * @returns  number of milliseconds this timeout as left
      */
     base::Time timeLeft(const base::Time &timeout) const{
         if(!timeout.isNull()){
-            return start_time + timeout - base::Time::now();
+            return start_time + timeout - now();
         }else{
             return base::Time::fromSeconds(0);
         }
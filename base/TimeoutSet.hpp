@@ -0,0 +1,340 @@
+#ifndef BASE_TIMEOUT_SET_HPP
+#define BASE_TIMEOUT_SET_HPP
+
+#include <vector>
+#include <stdexcept>
+#include <base/Time.hpp>
+
+namespace base{
+
+/** A set of deadlines, managed by a hierarchical timer wheel
+ *
+ * Arming, cancelling and expiring a timeout are O(1) regardless of the
+ * number of armed timeouts. The clock is read only once per call to update(),
+ * so a driver that manages many deadlines pays for a single clock read per
+ * cycle:
+ *
+ * \code
+ * TimeoutSet timeouts;
+ * TimeoutSet::Handle h = timeouts.arm(base::Time::fromMilliseconds(100));
+ * std::vector<TimeoutSet::Handle> expired;
+ * while (true)
+ * {
+ *     base::Time wait = timeouts.timeUntilNextExpiry();
+ *     // ppoll/epoll_wait with wait as timeout
+ *     timeouts.update(expired);
+ *     ...
+ * }
+ * \endcode
+ *
+ * All times are measured with base::Time::monotonicNow(). Deadlines are
+ * rounded up to the wheel resolution, i.e. a timeout never expires early.
+ */
+class TimeoutSet
+{
+public:
+    /** Identifies an armed timeout. Handles of expired or cancelled
+     * timeouts are never reused */
+    typedef uint64_t Handle;
+
+    /** A handle that never refers to an armed timeout */
+    static const Handle INVALID_HANDLE = 0;
+
+    /**
+     * @param resolution duration of one tick of the wheel
+     */
+    TimeoutSet(base::Time resolution = base::Time::fromMilliseconds(1))
+        : resolution(resolution.toMicroseconds())
+        , origin(base::Time::monotonicNow())
+        , current_time(origin)
+        , tick(0)
+        , armed_count(0)
+        , free_list(NONE)
+    {
+        if (this->resolution <= 0)
+            throw std::invalid_argument("TimeoutSet: the resolution must be strictly positive");
+        for (int level = 0; level < LEVELS; ++level)
+        {
+            occupied[level] = 0;
+            for (int slot = 0; slot < SLOTS; ++slot)
+                heads[level][slot] = NONE;
+        }
+    }
+
+    /** Returns the time of the last call to update(), i.e. the cached
+     * current time */
+    base::Time now() const { return current_time; }
+
+    /** Returns the number of armed timeouts */
+    size_t size() const { return armed_count; }
+
+    /** Arms a timeout that expires \c timeout after now() */
+    Handle arm(base::Time const& timeout)
+    {
+        return armAt(current_time + timeout);
+    }
+
+    /** Arms a timeout that expires at the given monotonic time */
+    Handle armAt(base::Time const& deadline)
+    {
+        uint32_t index;
+        if (free_list != NONE)
+        {
+            index = free_list;
+            free_list = entries[index].next;
+        }
+        else
+        {
+            index = entries.size();
+            entries.push_back(Entry());
+            entries.back().generation = 0;
+        }
+
+        Entry& entry = entries[index];
+        // Round up so that we never expire early
+        int64_t delta = (deadline - origin).toMicroseconds();
+        entry.expiry = delta <= 0 ? 0 : (delta + resolution - 1) / resolution;
+        ++entry.generation;
+        entry.armed = true;
+        insert(index);
+        ++armed_count;
+        return makeHandle(index, entry.generation);
+    }
+
+    /** Cancels a timeout
+     *
+     * @returns false if the handle does not refer to an armed timeout
+     *   (e.g. because it already expired)
+     */
+    bool cancel(Handle handle)
+    {
+        uint32_t index;
+        if (!resolve(handle, index))
+            return false;
+        unlink(index);
+        release(index);
+        return true;
+    }
+
+    /** True if the handle refers to a timeout that did not expire yet */
+    bool isArmed(Handle handle) const
+    {
+        uint32_t index;
+        return resolve(handle, index);
+    }
+
+    /** Reads the clock once and expires all timeouts whose deadline is
+     * reached
+     *
+     * @param expired the handles of the expired timeouts are appended to it
+     * @returns the new current time
+     */
+    base::Time update(std::vector<Handle>& expired)
+    {
+        return update(base::Time::monotonicNow(), expired);
+    }
+
+    /** Expires all timeouts whose deadline is before \c now, without reading
+     * the clock. \c now must not be before the current time */
+    base::Time update(base::Time const& now, std::vector<Handle>& expired)
+    {
+        if (now > current_time)
+            current_time = now;
+        int64_t target = (current_time - origin).toMicroseconds() / resolution;
+
+        while (tick <= target)
+        {
+            if (!armed_count)
+            {
+                tick = target + 1;
+                break;
+            }
+
+            if ((tick & SLOT_MASK) == 0)
+                cascade();
+
+            int slot = tick & SLOT_MASK;
+            while (heads[0][slot] != NONE)
+            {
+                uint32_t index = heads[0][slot];
+                unlink(index);
+                expired.push_back(makeHandle(index, entries[index].generation));
+                release(index);
+            }
+
+            // Jump to the next occupied slot of level 0, or to the start of
+            // the next block where the upper levels need to be cascaded
+            uint64_t next_slots = slot == SLOT_MASK ? 0 : occupied[0] >> (slot + 1) << (slot + 1);
+            int64_t next = next_slots ? (tick & ~int64_t(SLOT_MASK)) + __builtin_ctzll(next_slots)
+                                      : (tick | SLOT_MASK) + 1;
+            tick = next < target + 1 ? next : target + 1;
+        }
+        return current_time;
+    }
+
+    /** Returns a lower bound for the expiry of the next timeout, or a null
+     * time if no timeout is armed
+     *
+     * The bound is exact for timeouts stored in the lowest level of the
+     * wheel, and the start of the wheel slot they are stored in otherwise. It
+     * is therefore safe to sleep until then and call update(); far-away
+     * timeouts only cause a few spurious wakeups while they move down the
+     * wheel.
+     */
+    base::Time nextExpiry() const
+    {
+        if (!armed_count)
+            return base::Time();
+
+        int64_t best = -1;
+        for (int level = 0; level < LEVELS; ++level)
+        {
+            if (!occupied[level])
+                continue;
+
+            int shift = level * SLOT_BITS;
+            int64_t block = tick >> shift;
+            // Level 0 slots are exact ticks, the current one included. Slots
+            // of the other levels are cascaded when their block starts, i.e.
+            // the current one is still pending only if we are at its start
+            bool pending = (tick & ((int64_t(1) << shift) - 1)) == 0;
+            int first = pending ? 0 : 1;
+            int current = block & SLOT_MASK;
+            uint64_t rotated = rotateRight(occupied[level], (current + first) & SLOT_MASK);
+            if (!rotated)
+                continue;
+            int64_t distance = first + __builtin_ctzll(rotated);
+            int64_t candidate = (block + distance) << shift;
+            if (candidate < tick)
+                candidate = tick;
+            if (best < 0 || candidate < best)
+                best = candidate;
+        }
+        return origin + base::Time::fromMicroseconds(best * resolution);
+    }
+
+    /** Returns the time until nextExpiry(), relative to now(), or a null time
+     * if no timeout is armed or the next one is already expired */
+    base::Time timeUntilNextExpiry() const
+    {
+        base::Time next = nextExpiry();
+        if (next.isNull() || next <= current_time)
+            return base::Time();
+        return next - current_time;
+    }
+
+private:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+    static const int SLOT_MASK = SLOTS - 1;
+    static const uint32_t NONE = 0xFFFFFFFF;
+
+    struct Entry
+    {
+        int64_t expiry;
+        uint32_t next;
+        uint32_t prev;
+        uint32_t generation;
+        uint8_t level;
+        uint8_t slot;
+        bool armed;
+    };
+
+    static Handle makeHandle(uint32_t index, uint32_t generation)
+    { return (static_cast<uint64_t>(generation) << 32) | index; }
+
+    static uint64_t rotateRight(uint64_t value, int count)
+    { return count ? (value >> count) | (value << (64 - count)) : value; }
+
+    bool resolve(Handle handle, uint32_t& index) const
+    {
+        index = handle & 0xFFFFFFFF;
+        return index < entries.size() && entries[index].armed &&
+            entries[index].generation == (handle >> 32);
+    }
+
+    void insert(uint32_t index)
+    {
+        Entry& entry = entries[index];
+        int64_t expiry = entry.expiry < tick ? tick : entry.expiry;
+        int64_t delta = expiry - tick;
+        int level = 0;
+        while (level < LEVELS - 1 && delta >= (int64_t(1) << ((level + 1) * SLOT_BITS)))
+            ++level;
+        // Timeouts beyond the range of the wheel are parked in the last
+        // level, and re-inserted when their slot gets cascaded
+        int64_t max_delta = (int64_t(1) << (LEVELS * SLOT_BITS)) - 1;
+        if (delta > max_delta)
+            expiry = tick + max_delta;
+
+        int slot = (expiry >> (level * SLOT_BITS)) & SLOT_MASK;
+        entry.level = level;
+        entry.slot = slot;
+        entry.prev = NONE;
+        entry.next = heads[level][slot];
+        if (entry.next != NONE)
+            entries[entry.next].prev = index;
+        heads[level][slot] = index;
+        occupied[level] |= uint64_t(1) << slot;
+    }
+
+    void unlink(uint32_t index)
+    {
+        Entry& entry = entries[index];
+        if (entry.prev != NONE)
+            entries[entry.prev].next = entry.next;
+        else
+            heads[entry.level][entry.slot] = entry.next;
+        if (entry.next != NONE)
+            entries[entry.next].prev = entry.prev;
+        if (heads[entry.level][entry.slot] == NONE)
+            occupied[entry.level] &= ~(uint64_t(1) << entry.slot);
+    }
+
+    void release(uint32_t index)
+    {
+        entries[index].armed = false;
+        entries[index].next = free_list;
+        free_list = index;
+        --armed_count;
+    }
+
+    /** Moves the timeouts of the upper-level slots that start at the current
+     * tick into the lower levels */
+    void cascade()
+    {
+        int level = 1;
+        while (level < LEVELS - 1 && ((tick >> (level * SLOT_BITS)) & SLOT_MASK) == 0)
+            ++level;
+        for (; level > 0; --level)
+        {
+            int slot = (tick >> (level * SLOT_BITS)) & SLOT_MASK;
+            uint32_t index = heads[level][slot];
+            heads[level][slot] = NONE;
+            occupied[level] &= ~(uint64_t(1) << slot);
+            while (index != NONE)
+            {
+                uint32_t next = entries[index].next;
+                insert(index);
+                index = next;
+            }
+        }
+    }
+
+    int64_t resolution;
+    base::Time origin;
+    base::Time current_time;
+    /** The next tick to be processed */
+    int64_t tick;
+    size_t armed_count;
+
+    std::vector<Entry> entries;
+    uint32_t free_list;
+    uint32_t heads[LEVELS][SLOTS];
+    uint64_t occupied[LEVELS];
+};
+
+}
+
+#endif
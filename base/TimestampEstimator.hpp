@@ -0,0 +1,227 @@
+#ifndef BASE_TIMESTAMP_ESTIMATOR_HPP
+#define BASE_TIMESTAMP_ESTIMATOR_HPP
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <base/Time.hpp>
+#include <base/samples/Frame.hpp>
+
+namespace base{
+
+/** Estimates jitter-free timestamps from device times and receive times
+ *
+ * Drivers usually know when a sample got received by the host, but that time
+ * is delayed by a variable transport latency. If the device provides its own
+ * time (or a sample counter with a known period), the timestamp can be
+ * estimated as
+ *
+ *   time = offset + (1 + drift) * device_time
+ *
+ * where the offset and the drift between the two clocks are estimated
+ * online. The receive times are always after the true sample times, so the
+ * estimator tracks the lower envelope of the receive times: the window is
+ * split into buckets, the minimum of each bucket is kept, and a line is
+ * fitted below these minima. Each update is O(1) and the memory is bounded
+ * by the number of buckets.
+ *
+ * \code
+ * TimestampEstimator estimator(base::Time::fromSeconds(20));
+ * ...
+ * frame.received_time = base::Time::now();
+ * estimator.stamp(frame, device_time);
+ * \endcode
+ *
+ * The estimator resets itself if the device time goes backwards.
+ */
+class TimestampEstimator
+{
+public:
+    /**
+     * @param window the duration over which the clock offset and drift are
+     *   estimated. It should be long compared to the transport jitter, and
+     *   short compared to the changes of the drift.
+     * @param period the nominal period of the device's sample counter, only
+     *   needed by updateIndex
+     * @param latency a known constant transport latency, that is subtracted
+     *   from the estimated times
+     * @param bucket_count the number of minima kept in the window
+     */
+    TimestampEstimator(base::Time window = base::Time::fromSeconds(20),
+            base::Time period = base::Time(),
+            base::Time latency = base::Time(),
+            int bucket_count = 16)
+        : period(period.toSeconds())
+        , latency(latency)
+        , bucket_width(window.toSeconds() / (bucket_count > 0 ? bucket_count : 1))
+        , buckets(bucket_count > 0 ? bucket_count : 1)
+    {
+        if (bucket_width <= 0)
+            throw std::invalid_argument("TimestampEstimator: the window must be strictly positive");
+        reset();
+    }
+
+    /** Forgets all past samples */
+    void reset()
+    {
+        initialized = false;
+        last_device = 0;
+        offset = 0;
+        drift = 0;
+        current_bucket = 0;
+        for (size_t i = 0; i < buckets.size(); ++i)
+            buckets[i].id = -1;
+    }
+
+    /** Returns the estimated relative drift of the device clock, i.e. a
+     * positive value means that the device clock is slower than the host
+     * clock */
+    double getDrift() const { return drift; }
+
+    /** Returns the estimated time of a sample
+     *
+     * @param device_time the time of the sample in the device's clock
+     * @param receive_time the time at which the sample got received
+     */
+    base::Time update(base::Time const& device_time, base::Time const& receive_time)
+    {
+        return update(device_time.toSeconds(), receive_time);
+    }
+
+    /** Returns the estimated time of a sample given its index in the device's
+     * sample counter
+     *
+     * \throws std::logic_error if no period has been given to the constructor
+     */
+    base::Time updateIndex(int64_t index, base::Time const& receive_time)
+    {
+        if (period <= 0)
+            throw std::logic_error("TimestampEstimator: updateIndex requires the period of the sample counter");
+        return update(index * period, receive_time);
+    }
+
+    /** Sets the time of a sample that has a \c time field, such as
+     * SonarBeam or LaserScan */
+    template<typename Sample>
+    void stamp(Sample& sample, base::Time const& device_time, base::Time const& receive_time)
+    {
+        sample.time = update(device_time, receive_time);
+    }
+
+    /** Sets the time of a frame from its received_time */
+    void stamp(samples::frame::Frame& frame, base::Time const& device_time)
+    {
+        frame.time = update(device_time, frame.received_time);
+    }
+
+private:
+    struct Bucket
+    {
+        int64_t id;
+        double device;
+        double offset;
+    };
+
+    base::Time update(double device_seconds, base::Time const& receive_time)
+    {
+        if (!initialized || device_seconds < last_device)
+        {
+            reset();
+            initialized = true;
+            device_reference = device_seconds;
+            receive_reference = receive_time;
+        }
+        last_device = device_seconds;
+
+        // Work relative to the first sample to keep the precision of the
+        // doubles
+        double x = device_seconds - device_reference;
+        double y = (receive_time - receive_reference).toSeconds();
+        double r = y - x;
+
+        int64_t id = static_cast<int64_t>(x / bucket_width);
+        bool changed = id != current_bucket;
+        current_bucket = id;
+        Bucket& bucket = buckets[id % buckets.size()];
+        if (bucket.id != id || r < bucket.offset)
+        {
+            bucket.id = id;
+            bucket.device = x;
+            bucket.offset = r;
+            changed = true;
+        }
+        if (changed)
+            fit();
+
+        // A sample cannot be received before it got acquired
+        double estimate = std::min(y, x + offset + drift * x);
+        return receive_reference + base::Time::fromSeconds(estimate) - latency;
+    }
+
+    bool inWindow(Bucket const& bucket) const
+    {
+        return bucket.id >= 0 && bucket.id > current_bucket - static_cast<int64_t>(buckets.size());
+    }
+
+    /** Fits a line through the bucket minima and moves it below all of them
+     *
+     * The minimum of the current bucket is based on few samples, so it is
+     * not used to estimate the drift. It is still used to place the line.
+     */
+    void fit()
+    {
+        double sum_x = 0, sum_r = 0;
+        int count = 0;
+        for (size_t i = 0; i < buckets.size(); ++i)
+        {
+            if (inWindow(buckets[i]) && buckets[i].id != current_bucket)
+            {
+                sum_x += buckets[i].device;
+                sum_r += buckets[i].offset;
+                ++count;
+            }
+        }
+
+        double mean_x = count ? sum_x / count : 0, mean_r = count ? sum_r / count : 0;
+        double var = 0, cov = 0;
+        for (size_t i = 0; i < buckets.size(); ++i)
+        {
+            if (inWindow(buckets[i]) && buckets[i].id != current_bucket)
+            {
+                double dx = buckets[i].device - mean_x;
+                var += dx * dx;
+                cov += dx * (buckets[i].offset - mean_r);
+            }
+        }
+        drift = (count > 1 && var > 0) ? cov / var : 0;
+
+        bool first = true;
+        for (size_t i = 0; i < buckets.size(); ++i)
+        {
+            if (inWindow(buckets[i]))
+            {
+                double candidate = buckets[i].offset - drift * buckets[i].device;
+                if (first || candidate < offset)
+                    offset = candidate;
+                first = false;
+            }
+        }
+    }
+
+    double period;
+    base::Time latency;
+    double bucket_width;
+    std::vector<Bucket> buckets;
+
+    bool initialized;
+    double device_reference;
+    base::Time receive_reference;
+    double last_device;
+    int64_t current_bucket;
+    double offset;
+    double drift;
+};
+
+}
+
+#endif
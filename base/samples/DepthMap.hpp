@@ -1,16 +1,33 @@
 #ifndef __BASE_SAMPLES_DEPTH_MAP_HPP__
 #define __BASE_SAMPLES_DEPTH_MAP_HPP__
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <vector>
 #include <Eigen/Geometry>
 
 #include <base/Float.hpp>
 #include <base/Time.hpp>
+#include <base/TimeConversion.hpp>
 #include <base/Angle.hpp>
 #include <base/Singleton.hpp>
+#include <base/samples/PointcloudArrays.hpp>
+#include <base/samples/RigidBodyState.hpp>
+#include <base/templates/TimeIndexedBuffer.hpp>
+
+/** Number of entries of the rotation lookup tables of the DepthMap over the
+ * full circle. The values between two entries are interpolated. */
+#ifndef BASE_DEPTH_MAP_LUT_RESOLUTION
+#define BASE_DEPTH_MAP_LUT_RESOLUTION 4096
+#endif
 
 namespace base { namespace samples {
 
+template<typename S> class DepthMapProjector;
+struct DepthMapView;
+struct DepthMapStatistics;
+
 /**
  * The DepthMap type provides distance and optional remission values in 3D.
  * The information is stored in a vector in a row major form, to simplify the usage as a distance image.
@@ -219,9 +236,26 @@ public:
      */
     bool isMeasurementValid(scalar distance) const
     {
-	return getMeasurementState(distance) == VALID_MEASUREMENT;
+	// false for NaN, infinity and non-positive distances
+	return distance > 0.0 && distance < std::numeric_limits<scalar>::infinity();
     }
 
+    /** Computes the validity mask, the number of measurements in each state and
+     * the statistics of the valid distances in a single pass over the distances.
+     * This is the way to check all measurements, instead of calling isIndexValid
+     * or getMeasurementState for each of them.
+     * When compiled with OpenMP, the distances are processed in parallel.
+     * 
+     * @param statistics the result, whose buffers are reused
+     * @param histogram_bins number of bins of the histogram of the valid distances, none if 0
+     * @param histogram_min lower bound of the first bin
+     * @param histogram_max upper bound of the last bin
+     */
+    void computeStatistics(DepthMapStatistics& statistics, 
+			   unsigned histogram_bins = 0, 
+			   double histogram_min = 0.0, 
+			   double histogram_max = 0.0) const;
+
     /** Computes the index in the distance and remission vector 
      * of a given vertrical and horizontal index. 
      * Note that the data is stored in row major form.
@@ -269,29 +303,25 @@ public:
 				bool use_lut = false, 
 				bool skip_invalid_measurements = true) const
     {
-	point_cloud.clear();
-	
-	// check row and col size
-	if(!checkSizeConfig())
-	    throw std::out_of_range("Number of rows and columns does not match the distance array size.");
-
-	// check if nothing to do
-	if(distances.empty())
-	    return;
-
-	// give the vector a hint about the size it might be
-	point_cloud.reserve(distances.size());
-	
-	// precompute local transformations
-	std::vector< Eigen::Transform<typename T::Scalar,3,Eigen::Affine> > rows2column;
-	std::vector< Eigen::Transform<typename T::Scalar,3,Eigen::Affine> > columns2pointcloud;
-	computeLocalTransformations(rows2column, columns2pointcloud, use_lut);
-	
-	// convert rows
-	for(unsigned v = 0; v < vertical_size; v++)
-	    convertSingleRow(point_cloud, v, rows2column[v], columns2pointcloud, transformation, skip_invalid_measurements);
+	DepthMapProjector<typename T::Scalar>().convertDepthMapToPointCloud(*this, point_cloud, transformation,
+									     use_lut, skip_invalid_measurements);
     }
 
+    /** Converts the depth map into coordinate arrays according to the given transformation matrix.
+     * The points are computed in double precision. If enabled in the point cloud, the
+     * index of the measurement and its remission are stored with each point, so that
+     * they stay associated when the invalid measurements are skipped.
+     * 
+     * @param point_cloud returned pointcloud
+     * @param transformation all points will be transformed using this transformation
+     * @param use_lut true, if lookup table for single unit axis rotations shall be used
+     * @param skip_invalid_measurements true, if invalid measurements should be skipped
+     */
+    void convertDepthMapToPointCloud(PointcloudArrays &point_cloud,
+				const Eigen::Affine3d& transformation = Eigen::Affine3d::Identity(),
+				bool use_lut = false, 
+				bool skip_invalid_measurements = true) const;
+
     /** Converts the depth map to a pointcloud according to the given transformation matrices.
      * On basis of the first and last transformation the transformations will be
      * interpolated and applied row-wise if the parameter apply_transforms_vertically is 
@@ -312,61 +342,8 @@ public:
 				bool skip_invalid_measurements = true,
 				bool apply_transforms_vertically = true) const
     {
-	point_cloud.clear();
-	
-	// check row and col size
-	if(!checkSizeConfig())
-	    throw std::out_of_range("Number of rows and columns does not match the distance array size.");
-
-	// check if nothing to do
-	if(distances.empty())
-	    return;
-
-	// give the vector a hint about the size it might be
-	point_cloud.reserve(distances.size());
-	
-	// precompute local transformations
-	std::vector< Eigen::Transform<typename T::Scalar,3,Eigen::Affine> > rows2column;
-	std::vector< Eigen::Transform<typename T::Scalar,3,Eigen::Affine> > columns2pointcloud;
-	computeLocalTransformations(rows2column, columns2pointcloud, use_lut);
-	
-	Eigen::Matrix<typename T::Scalar,3,1> translation_delta = last_transformation.translation() - first_transformation.translation();
-	Eigen::Quaterniond first_rotation = Eigen::Quaterniond(first_transformation.linear());
-	Eigen::Quaterniond last_rotation = Eigen::Quaterniond(last_transformation.linear());
-	
-	// apply global interpolated transformations
-	if(!apply_transforms_vertically)
-	{
-	    for(unsigned h = 0; h < horizontal_size; h++)
-	    {
-		Eigen::Transform<typename T::Scalar,3,Eigen::Affine> transformation = 
-		    Eigen::Transform<typename T::Scalar,3,Eigen::Affine>(first_rotation.slerp((double)h / (double)(horizontal_size-1), last_rotation));
-		transformation.pretranslate(first_transformation.translation() + ((double)h / (double)(horizontal_size-1)) * translation_delta);
-		columns2pointcloud[h] = transformation * columns2pointcloud[h];
-	    }
-	    
-	    // convert rows
-	    for(unsigned v = 0; v < vertical_size; v++)
-		convertSingleRow(point_cloud, v, rows2column[v], columns2pointcloud, 
-				 Eigen::Transform<typename T::Scalar,3,Eigen::Affine>::Identity(), 
-				 skip_invalid_measurements);
-	}
-	else
-	{
-	    std::vector< Eigen::Transform<typename T::Scalar,3,Eigen::Affine> > pointcloud2world;
-	    for(unsigned v = 0; v < vertical_size; v++)
-	    {
-		Eigen::Transform<typename T::Scalar,3,Eigen::Affine> transformation = 
-		    Eigen::Transform<typename T::Scalar,3,Eigen::Affine>(first_rotation.slerp((double)v / (double)(vertical_size-1), last_rotation));
-		transformation.pretranslate(first_transformation.translation() + ((double)v / (double)(vertical_size-1)) * translation_delta);
-		pointcloud2world.push_back(transformation);
-	    }
-	    
-	    // convert rows
-	    for(unsigned v = 0; v < vertical_size; v++)
-		convertSingleRow(point_cloud, v, rows2column[v], columns2pointcloud, 
-				 pointcloud2world[v], skip_invalid_measurements);
-	}
+	DepthMapProjector<typename T::Scalar>().convertDepthMapToPointCloud(*this, point_cloud, first_transformation, last_transformation,
+									     use_lut, skip_invalid_measurements, apply_transforms_vertically);
     }
 
     /** Converts the depth map to a pointcloud according to the given transformation matrices.
@@ -388,79 +365,240 @@ public:
 				bool skip_invalid_measurements = true,
 				bool apply_transforms_vertically = true) const
     {
-	point_cloud.clear();
-	
-	// check row and col size
-	if(!checkSizeConfig())
-	    throw std::out_of_range("Number of rows and columns does not match the distance array size.");
-
-	// check if nothing to do
-	if(distances.empty())
-	    return;
+	DepthMapProjector<typename T::Scalar>().convertDepthMapToPointCloud(*this, point_cloud, transformations,
+									     use_lut, skip_invalid_measurements, apply_transforms_vertically);
+    }
+    
+    /** Converts the depth map to a pointcloud in the world frame, compensating the
+     * motion of the sensor during the measurement, using its timestamps.
+     * 
+     * @see DepthMapProjector::convertDepthMapToDeskewedPointCloud
+     */
+    template<typename T, typename PoseAtTime>
+    void convertDepthMapToDeskewedPointCloud(std::vector<T> &point_cloud,
+					     PoseAtTime sensor2world,
+					     bool use_lut = false,
+					     bool skip_invalid_measurements = true,
+					     bool apply_transforms_vertically = true) const
+    {
+	DepthMapProjector<typename T::Scalar>().convertDepthMapToDeskewedPointCloud(*this, point_cloud, sensor2world,
+										     use_lut, skip_invalid_measurements, apply_transforms_vertically);
+    }
+    
+private:
+    template<typename T, UNIT_AXIS, unsigned resolution> class RotationLUT;
+    template<typename S> friend class DepthMapProjector;
+    friend struct DepthMapView;
 
-	// give the vector a hint about the size it might be
-	point_cloud.reserve(distances.size());
+protected:    
+    /** Output of the conversions into a vector of points */
+    template<typename T>
+    class PointVectorOutput
+    {
+    public:
+	explicit PointVectorOutput(std::vector<T>& points) : points(&points), data(0) {}
 	
-	// precompute local transformations
-	std::vector< Eigen::Transform<typename T::Scalar,3,Eigen::Affine> > rows2column;
-	std::vector< Eigen::Transform<typename T::Scalar,3,Eigen::Affine> > columns2pointcloud;
-	computeLocalTransformations(rows2column, columns2pointcloud);
+	void resize(size_t count)
+	{
+	    typedef typename T::Scalar S;
+	    points->resize(count, T(S(0), S(0), S(0)));
+	    data = count ? &(*points)[0] : 0;
+	}
 	
-	// apply global transformations
-	if(!apply_transforms_vertically)
+	template<typename S>
+	inline void setPoint(size_t position, const Eigen::Matrix<S,3,1>& point, size_t)
 	{
-	    if(transformations.size() != horizontal_size)
-		throw std::out_of_range("Invalid amount of transformations given");
-	    for(unsigned h = 0; h < horizontal_size; h++)
-		columns2pointcloud[h] = transformations[h] * columns2pointcloud[h];
-	    
-	    // convert rows
-	    for(unsigned v = 0; v < vertical_size; v++)
-		convertSingleRow(point_cloud, v, rows2column[v], columns2pointcloud, 
-				 Eigen::Transform<typename T::Scalar,3,Eigen::Affine>::Identity(), 
-				 skip_invalid_measurements);
+	    data[position] = T(point.x(), point.y(), point.z());
 	}
-	else
+	
+	inline void setInvalid(size_t position, size_t)
 	{
-	    if(transformations.size() != vertical_size)
-		throw std::out_of_range("Invalid amount of transformations given");
-	    
-	    // convert rows
-	    for(unsigned v = 0; v < vertical_size; v++)
-		convertSingleRow(point_cloud, v, rows2column[v], columns2pointcloud, 
-				 transformations[v], 
-				 skip_invalid_measurements);
+	    typename T::Scalar nan = base::unknown<typename T::Scalar>();
+	    data[position] = T(nan, nan, nan);
 	}
+	
+    private:
+	std::vector<T>* points;
+	T* data;
+    };
+    
+    /** Output of the conversions into coordinate arrays, with the indices and remissions
+     * of the measurements */
+    class PointArraysOutput
+    {
+    public:
+	PointArraysOutput(PointcloudArrays& points, const std::vector<scalar>& remissions, size_t measurements) 
+	    : points(&points), remissions(remissions.size() == measurements ? &remissions : 0) {}
+	
+	void resize(size_t count) { points->resize(count); }
+	
+	template<typename S>
+	inline void setPoint(size_t position, const Eigen::Matrix<S,3,1>& point, size_t index)
+	{
+	    points->setPoint(position, point.x(), point.y(), point.z(), index, 
+			     remissions ? (*remissions)[index] : base::unknown<float>());
+	}
+	
+	inline void setInvalid(size_t position, size_t index)
+	{
+	    float nan = base::unknown<float>();
+	    points->setPoint(position, nan, nan, nan, index, remissions ? (*remissions)[index] : nan);
+	}
+	
+    private:
+	PointcloudArrays* points;
+	const std::vector<scalar>* remissions;
+    };
+    
+    template<typename T>
+    static PointVectorOutput<T> makeOutput(std::vector<T>& points) { return PointVectorOutput<T>(points); }
+    /** Also stamps the point cloud with the first timestamp of the depth map */
+    PointArraysOutput makeOutput(PointcloudArrays& points) const 
+    { 
+	points.time = timestamps.empty() ? base::Time() : timestamps.front();
+	return PointArraysOutput(points, remissions, distances.size()); 
     }
+
+    /** Measurements of a conversion, the whole depth map or the ones of a view. 
+     * The measurement (v, h) is distances[first + v * row_stride + h * column_stride]. */
+    struct Grid
+    {
+	size_t first;
+	size_t row_stride;
+	size_t column_stride;
+	uint32_t rows;
+	uint32_t columns;
+    };
     
-private:
-    template<typename T, UNIT_AXIS> class RotationLUT;
+    Grid getGrid() const
+    {
+	Grid grid = { 0, horizontal_size, 1, vertical_size, horizontal_size };
+	return grid;
+    }
 
-protected:    
-    /** Helper method which converts a single row to a pointcloud. */
-    template<typename T>
-    void convertSingleRow(std::vector<T> &point_cloud, 
-			    unsigned int row,
-			    const Eigen::Transform<typename T::Scalar,3,Eigen::Affine>& row2column,
-			    const std::vector< Eigen::Transform<typename T::Scalar,3,Eigen::Affine> >& columns2pointcloud,
-			    const Eigen::Transform<typename T::Scalar,3,Eigen::Affine>& pointcloud2world,
-			    bool skip_invalid_measurements) const
-    {
-	size_t row_index = (size_t)row * (size_t)horizontal_size;
-	for(unsigned h = 0; h < horizontal_size; h++)
-	{
-	    scalar distance = distances[row_index + h];
-	    if(isMeasurementValid(distance))
-	    {
-		T point(distance, 0.0, 0.0);
-		point =  pointcloud2world * (columns2pointcloud[h] * row2column * point);
-		point_cloud.push_back(point);
-	    }
-	    else if(!skip_invalid_measurements)
+    /** Helper method which computes the index of the first point of each row in
+     * the point cloud. Returns the number of points. */
+    size_t computeRowPositions(std::vector<size_t>& row_positions, const Grid& grid, bool skip_invalid_measurements) const
+    {
+	row_positions.resize(grid.rows);
+	if(!skip_invalid_measurements)
+	{
+	    for(unsigned v = 0; v < grid.rows; v++)
+		row_positions[v] = (size_t)v * (size_t)grid.columns;
+	    return (size_t)grid.rows * (size_t)grid.columns;
+	}
+	
+	// count the valid measurements of each row, then accumulate
+	const int rows = grid.rows;
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(static)
+#endif
+	for(int v = 0; v < rows; v++)
+	{
+	    const scalar* row_distances = &distances[grid.first + (size_t)v * grid.row_stride];
+	    size_t count = 0;
+	    for(uint32_t h = 0; h < grid.columns; h++)
+		count += isMeasurementValid(row_distances[h * grid.column_stride]) ? 1 : 0;
+	    row_positions[v] = count;
+	}
+	size_t count = 0;
+	for(unsigned v = 0; v < grid.rows; v++)
+	{
+	    size_t row_count = row_positions[v];
+	    row_positions[v] = count;
+	    count += row_count;
+	}
+	return count;
+    }
+
+    /** Helper method which converts all rows to a pointcloud.
+     * 
+     * The point of a measurement is rows2world * columns2pointcloud[h] * rows2column[v] * (distance, 0, 0).
+     * rows2column must be rotations, so that each point is the distance times the
+     * rotated unit vector of its row plus the translation of its column, instead of
+     * two products of affine transformations. The measurements are processed in
+     * blocks of columns, so that the matrix entries of the columns stay in the
+     * cache while converting all rows. The point cloud is resized once and the
+     * points are written in place.
+     * When compiled with OpenMP, the rows are converted in parallel.
+     * 
+     * @param output PointVectorOutput or PointArraysOutput
+     * @param grid the measurements to convert, rows2column and columns2pointcloud
+     *             having one entry per row and column of it
+     * @param rows2world empty, one transformation for all rows or one per row
+     */
+    template<typename Output, typename S>
+    void convertRows(Output output, 
+		     const Grid& grid,
+		     const std::vector< Eigen::Transform<S,3,Eigen::Affine> >& rows2column,
+		     const std::vector< Eigen::Transform<S,3,Eigen::Affine> >& columns2pointcloud,
+		     const std::vector< Eigen::Transform<S,3,Eigen::Affine> >& rows2world,
+		     bool skip_invalid_measurements) const
+    {
+	static const DepthMatrix::Index block_size = 256;
+	const DepthMatrix::Index columns = grid.columns;
+	const int rows = grid.rows;
+	const size_t column_stride = grid.column_stride;
+	
+	// position of the next point of each row in the point cloud
+	std::vector<size_t> row_positions;
+	size_t count = computeRowPositions(row_positions, grid, skip_invalid_measurements);
+	output.resize(count);
+	if(count == 0)
+	    return;
+	
+#ifdef _OPENMP
+	#pragma omp parallel
+#endif
+	{
+	    std::vector<S> column_data(12 * block_size);
+	    const S* c[12];
+	    for(unsigned k = 0; k < 12; k++)
+		c[k] = &column_data[k * block_size];
+	    for(DepthMatrix::Index begin = 0; begin < columns; begin += block_size)
 	    {
-		point_cloud.push_back(T(base::unknown<typename T::Scalar>(), 
-					base::unknown<typename T::Scalar>(), 
-					base::unknown<typename T::Scalar>()));
+		const DepthMatrix::Index n = std::min(block_size, columns - begin);
+		
+		// linear part and translation of the columns, one array per matrix entry
+		for(DepthMatrix::Index i = 0; i < n; i++)
+		{
+		    Eigen::Matrix<S,3,4> matrix = (rows2world.size() == 1 ? 
+			Eigen::Transform<S,3,Eigen::Affine>(rows2world.front() * columns2pointcloud[begin + i]) : 
+			columns2pointcloud[begin + i]).matrix().template topRows<3>();
+		    for(unsigned k = 0; k < 12; k++)
+			column_data[k * block_size + i] = matrix(k / 4, k % 4);
+		}
+		
+		// a thread gets the same rows in every block, so that it is the
+		// only one to update their positions
+#ifdef _OPENMP
+		#pragma omp for schedule(static) nowait
+#endif
+		for(int v = 0; v < rows; v++)
+		{
+		    const Eigen::Matrix<S,3,1> r = rows2column[v].linear().col(0);
+		    const size_t row_index = grid.first + (size_t)v * grid.row_stride + (size_t)begin * column_stride;
+		    const scalar* row_distances = &distances[row_index];
+		    const Eigen::Transform<S,3,Eigen::Affine>* row2world = rows2world.size() > 1 ? &rows2world[v] : 0;
+		    size_t position = row_positions[v];
+		    for(DepthMatrix::Index i = 0; i < n; i++)
+		    {
+			scalar distance = row_distances[i * column_stride];
+			if(isMeasurementValid(distance))
+			{
+			    S d = distance;
+			    Eigen::Matrix<S,3,1> point(d * (c[0][i] * r.x() + c[1][i] * r.y() + c[2][i] * r.z()) + c[3][i],
+						       d * (c[4][i] * r.x() + c[5][i] * r.y() + c[6][i] * r.z()) + c[7][i],
+						       d * (c[8][i] * r.x() + c[9][i] * r.y() + c[10][i] * r.z()) + c[11][i]);
+			    if(row2world)
+				point = *row2world * point;
+			    output.setPoint(position++, point, row_index + i * column_stride);
+			}
+			else if(!skip_invalid_measurements)
+			    output.setInvalid(position++, row_index + i * column_stride);
+		    }
+		    row_positions[v] = position;
+		}
 	    }
 	}
     }
@@ -604,19 +742,19 @@ protected:
 	{
 	    if(axis == UNIT_X)
 	    {
-		RotationLUT<T,UNIT_X>* lut = Singleton< RotationLUT<T,UNIT_X> >::getInstance();
+		RotationLUT<T,UNIT_X,BASE_DEPTH_MAP_LUT_RESOLUTION>* lut = Singleton< RotationLUT<T,UNIT_X,BASE_DEPTH_MAP_LUT_RESOLUTION> >::getInstance();
 		for(unsigned i = 0; i < angles.size(); i++)
 		    rotations[i] = lut->getTransformation(angles[i].getRad());
 	    }
 	    else if(axis == UNIT_Y)
 	    {
-		RotationLUT<T,UNIT_Y>* lut = Singleton< RotationLUT<T,UNIT_Y> >::getInstance();
+		RotationLUT<T,UNIT_Y,BASE_DEPTH_MAP_LUT_RESOLUTION>* lut = Singleton< RotationLUT<T,UNIT_Y,BASE_DEPTH_MAP_LUT_RESOLUTION> >::getInstance();
 		for(unsigned i = 0; i < angles.size(); i++)
 		    rotations[i] = lut->getTransformation(angles[i].getRad());
 	    }
 	    else if(axis == UNIT_Z)
 	    {
-		RotationLUT<T,UNIT_Z>* lut = Singleton< RotationLUT<T,UNIT_Z> >::getInstance();
+		RotationLUT<T,UNIT_Z,BASE_DEPTH_MAP_LUT_RESOLUTION>* lut = Singleton< RotationLUT<T,UNIT_Z,BASE_DEPTH_MAP_LUT_RESOLUTION> >::getInstance();
 		for(unsigned i = 0; i < angles.size(); i++)
 		    rotations[i] = lut->getTransformation(angles[i].getRad());
 	    }
@@ -663,34 +801,1005 @@ protected:
     }
     
 private:
-    /** Lookup table for rotations around one unit axis */
-    template<typename T, UNIT_AXIS unit_axis>
+    /** Lookup table for rotations around one unit axis
+     *
+     * Only the sine and cosine are stored, resolution entries over the full
+     * circle, and the values in between are linearly interpolated. The
+     * rotation is built directly from them.
+     */
+    template<typename T, UNIT_AXIS unit_axis, unsigned resolution>
     class RotationLUT
     {
-	static const unsigned resolution = 36000;
-	
     public:
-	Eigen::Transform<T,3,Eigen::Affine> getTransformation(double rad)
+	/** Returns the interpolated sine and cosine of the given angle */
+	inline void getSinCos(double rad, T& sin_value, T& cos_value) const
 	{
-	    uint16_t deg = (uint16_t)((rad < 0.0 ? rad + 2.0*M_PI: rad) * rad2deg);
-	    return transformations[deg];
+	    double position = rad * rad2index;
+	    position -= std::floor(position / (double)resolution) * (double)resolution;
+	    unsigned index = (unsigned)position;
+	    if(index >= resolution)
+		index = resolution - 1;
+	    T fraction = (T)(position - (double)index);
+	    const T* entry = &sin_cos[2 * index];
+	    sin_value = entry[0] + fraction * (entry[2] - entry[0]);
+	    cos_value = entry[1] + fraction * (entry[3] - entry[1]);
+	}
+	
+	Eigen::Transform<T,3,Eigen::Affine> getTransformation(double rad) const
+	{
+	    T s, c;
+	    getSinCos(rad, s, c);
+	    
+	    // rotation matrix around the unit axis, the other two axes in cyclic order
+	    const unsigned a = ((unsigned)unit_axis + 1) % 3;
+	    const unsigned b = ((unsigned)unit_axis + 2) % 3;
+	    Eigen::Transform<T,3,Eigen::Affine> transformation = Eigen::Transform<T,3,Eigen::Affine>::Identity();
+	    transformation.matrix()(a,a) = c;
+	    transformation.matrix()(a,b) = -s;
+	    transformation.matrix()(b,a) = s;
+	    transformation.matrix()(b,b) = c;
+	    return transformation;
 	};
 	
-	RotationLUT() : rad2deg( ((double)resolution) / (2.0*M_PI) ), deg2rad( (2.0*M_PI) / ((double)resolution) )
+	RotationLUT() : rad2index( ((double)resolution) / (2.0*M_PI) )
 	{
-	    transformations.resize(resolution);
-	    for(unsigned i = 0; i < resolution; i++)
-		transformations[i] = Eigen::Transform<T,3,Eigen::Affine>(Eigen::AngleAxis<T>((double)i * deg2rad, Eigen::Matrix<T,3,1>::Unit(unit_axis)));
+	    // one additional entry to interpolate in the last interval
+	    double index2rad = (2.0*M_PI) / ((double)resolution);
+	    sin_cos.resize(2 * (resolution + 1));
+	    for(unsigned i = 0; i <= resolution; i++)
+	    {
+		sin_cos[2 * i] = (T)std::sin((double)i * index2rad);
+		sin_cos[2 * i + 1] = (T)std::cos((double)i * index2rad);
+	    }
 	}
 	virtual ~RotationLUT() {}
 	
     private:
-	double rad2deg;
-	double deg2rad;
-	std::vector< Eigen::Transform<T,3,Eigen::Affine> > transformations;
+	double rad2index;
+	/** interleaved sine and cosine values, resolution + 1 pairs */
+	std::vector<T> sin_cos;
     };
 };
 
+/**
+ * Validity of the measurements of a DepthMap and statistics of its valid
+ * distances, computed in one pass by DepthMap::computeStatistics.
+ */
+struct DepthMapStatistics
+{
+    typedef boost::uint64_t uint64_t;
+    
+    /** One bit per measurement, set if the measurement is valid. The bit of the
+     * measurement i is the bit i % 64 of valid_mask[i / 64]. */
+    std::vector<uint64_t> valid_mask;
+    
+    /** Number of measurements in each DepthMap::DEPTH_MEASUREMENT_STATE */
+    size_t state_counts[4];
+    
+    /** Smallest, largest and mean valid distance, NaN if there is no valid measurement */
+    double valid_min;
+    double valid_max;
+    double valid_mean;
+    
+    /** Number of valid distances in each of the bins of equal size between 
+     * histogram_min and histogram_max. The distances outside are not counted. */
+    std::vector<size_t> histogram;
+    double histogram_min;
+    double histogram_max;
+    
+    DepthMapStatistics() 
+	: valid_min(base::unknown<double>()), valid_max(base::unknown<double>()), valid_mean(base::unknown<double>()),
+	  histogram_min(0.0), histogram_max(0.0)
+    {
+	std::fill(state_counts, state_counts + 4, 0);
+    }
+    
+    /** Returns true if the measurement at the given index is valid */
+    inline bool isIndexValid(size_t index) const
+    {
+	return (valid_mask[index >> 6] >> (index & 63)) & 1;
+    }
+    
+    size_t getValidCount() const { return state_counts[DepthMap::VALID_MEASUREMENT]; }
+};
+
+inline void DepthMap::computeStatistics(DepthMapStatistics& statistics, 
+					unsigned histogram_bins, 
+					double histogram_min, 
+					double histogram_max) const
+{
+    typedef DepthMapStatistics::uint64_t uint64_t;
+    const size_t size = distances.size();
+    const int words = (size + 63) / 64;
+    const double bin_scale = histogram_max > histogram_min ? (double)histogram_bins / (histogram_max - histogram_min) : 0.0;
+    
+    statistics.valid_mask.resize(words);
+    statistics.histogram.assign(bin_scale > 0.0 ? histogram_bins : 0, 0);
+    statistics.histogram_min = histogram_min;
+    statistics.histogram_max = histogram_max;
+    std::fill(statistics.state_counts, statistics.state_counts + 4, 0);
+    size_t valid_count = 0, nan_count = 0, infinity_count = 0;
+    double sum = 0.0;
+    scalar min = std::numeric_limits<scalar>::infinity();
+    scalar max = 0.0;
+    
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    {
+	size_t thread_valid = 0, thread_nan = 0, thread_infinity = 0;
+	double thread_sum = 0.0;
+	scalar thread_min = std::numeric_limits<scalar>::infinity();
+	scalar thread_max = 0.0;
+	std::vector<size_t> thread_histogram(statistics.histogram.size(), 0);
+	
+	// the measurements of one word of the mask at a time
+#ifdef _OPENMP
+	#pragma omp for schedule(static)
+#endif
+	for(int w = 0; w < words; w++)
+	{
+	    const size_t begin = (size_t)w * 64;
+	    const unsigned n = (unsigned)std::min<size_t>(64, size - begin);
+	    const scalar* word_distances = &distances[begin];
+	    uint64_t word = 0;
+	    for(unsigned i = 0; i < n; i++)
+	    {
+		scalar distance = word_distances[i];
+		if(isMeasurementValid(distance))
+		{
+		    word |= (uint64_t)1 << i;
+		    thread_valid++;
+		    thread_sum += distance;
+		    thread_min = std::min(thread_min, distance);
+		    thread_max = std::max(thread_max, distance);
+		    if(!thread_histogram.empty() && distance >= histogram_min && distance < histogram_max)
+			thread_histogram[std::min<size_t>((size_t)((distance - histogram_min) * bin_scale), histogram_bins - 1)]++;
+		}
+		else if(distance != distance)
+		    thread_nan++;
+		else if(distance > 0.0 || distance == -std::numeric_limits<scalar>::infinity())
+		    thread_infinity++;
+	    }
+	    statistics.valid_mask[w] = word;
+	}
+	
+#ifdef _OPENMP
+	#pragma omp critical
+#endif
+	{
+	    valid_count += thread_valid;
+	    nan_count += thread_nan;
+	    infinity_count += thread_infinity;
+	    sum += thread_sum;
+	    min = std::min(min, thread_min);
+	    max = std::max(max, thread_max);
+	    for(unsigned b = 0; b < thread_histogram.size(); b++)
+		statistics.histogram[b] += thread_histogram[b];
+	}
+    }
+    
+    statistics.state_counts[VALID_MEASUREMENT] = valid_count;
+    statistics.state_counts[TOO_FAR] = infinity_count;
+    statistics.state_counts[MEASUREMENT_ERROR] = nan_count;
+    statistics.state_counts[TOO_NEAR] = size - valid_count - infinity_count - nan_count;
+    if(valid_count)
+    {
+	statistics.valid_min = min;
+	statistics.valid_max = max;
+	statistics.valid_mean = sum / (double)valid_count;
+    }
+    else
+	statistics.valid_min = statistics.valid_max = statistics.valid_mean = base::unknown<double>();
+}
+
+/**
+ * A strided region of interest of a DepthMap, which references its measurements
+ * instead of copying them.
+ * 
+ * The view has the rows first_row, first_row + row_step, ... and the columns
+ * first_column, first_column + column_step, ... of the depth map, e.g. every
+ * fourth column of an angular sector of a 3D laser scan. The distances are
+ * accessible as an Eigen::Map with inner and outer strides, and the view is
+ * converted to a point cloud directly, by DepthMapProjector or by the conversion
+ * methods of the view. The intervals and timestamps of the view are computed
+ * from the ones of the depth map. toDepthMap() copies the view into a DepthMap
+ * and decimate() reduces blocks of it to their minimum or median.
+ * 
+ * The depth map must outlive the view and keep its size while the view is used.
+ */
+struct DepthMapView
+{
+public:
+    typedef DepthMap::scalar scalar;
+    typedef boost::uint32_t uint32_t;
+    typedef Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic> Stride;
+    typedef const Eigen::Map< DepthMap::DepthMatrixConst, Eigen::Unaligned, Stride > DepthMatrixMapConst;
+    
+    enum DECIMATION_MODE
+    {
+	DECIMATE_MIN,
+	DECIMATE_MEDIAN
+    };
+    
+    /** The viewed depth map */
+    const DepthMap* depth_map;
+    
+    /** Row and column of the depth map of the first measurement of the view */
+    uint32_t first_row;
+    uint32_t first_column;
+    
+    /** Number of rows of the view */
+    uint32_t vertical_size;
+    
+    /** Number of columns of the view */
+    uint32_t horizontal_size;
+    
+    /** Distance between two rows and two columns of the view in the depth map */
+    uint32_t row_step;
+    uint32_t column_step;
+    
+    /** Creates a view on the whole depth map */
+    explicit DepthMapView(const DepthMap& depth_map)
+	: depth_map(&depth_map), first_row(0), first_column(0), 
+	  vertical_size(depth_map.vertical_size), horizontal_size(depth_map.horizontal_size),
+	  row_step(1), column_step(1)
+    {
+	if(!checkSizeConfig())
+	    throw std::out_of_range("Number of rows and columns does not match the distance array size.");
+    }
+    
+    /** Creates a view on vertical_size rows and horizontal_size columns of the depth map
+     * 
+     * \throws std::out_of_range if a step is zero or the view is not within the depth map
+     */
+    DepthMapView(const DepthMap& depth_map, 
+		 uint32_t first_row, uint32_t first_column,
+		 uint32_t vertical_size, uint32_t horizontal_size,
+		 uint32_t row_step = 1, uint32_t column_step = 1)
+	: depth_map(&depth_map), first_row(first_row), first_column(first_column),
+	  vertical_size(vertical_size), horizontal_size(horizontal_size),
+	  row_step(row_step), column_step(column_step)
+    {
+	if(!checkSizeConfig())
+	    throw std::out_of_range("The view is not within the depth map.");
+    }
+    
+    /** Creates a view on every row_step-th row and column_step-th column of the depth map,
+     * starting with the first ones */
+    static DepthMapView stride(const DepthMap& depth_map, uint32_t row_step, uint32_t column_step)
+    {
+	return DepthMapView(depth_map, 0, 0, 
+			    blockCount(depth_map.vertical_size, row_step), 
+			    blockCount(depth_map.horizontal_size, column_step), 
+			    row_step, column_step);
+    }
+    
+    /** Returns true if the view is within the depth map */
+    bool checkSizeConfig() const
+    {
+	if(!depth_map->checkSizeConfig() || row_step == 0 || column_step == 0)
+	    return false;
+	if(vertical_size == 0 || horizontal_size == 0)
+	    return true;
+	return (uint64_t)first_row + (uint64_t)(vertical_size - 1) * row_step < depth_map->vertical_size &&
+	       (uint64_t)first_column + (uint64_t)(horizontal_size - 1) * column_step < depth_map->horizontal_size;
+    }
+    
+    /** Computes the index in the distance and remission vector of the depth map 
+     * of a given vertical and horizontal index of the view. */
+    inline size_t getIndex(uint32_t v_index, uint32_t h_index) const
+    {
+	return depth_map->getIndex(first_row + v_index * row_step, first_column + h_index * column_step);
+    }
+    
+    /** Creates a mapping of the distances of the view to a const eigen matrix */
+    DepthMatrixMapConst getDistanceMatrixMapConst() const
+	{ return mapMeasurements(depth_map->distances); }
+    
+    /** Creates a mapping of the remissions of the view to a const eigen matrix
+     * 
+     * \throws std::out_of_range if the depth map has no remissions
+     */
+    DepthMatrixMapConst getRemissionMatrixMapConst() const
+    {
+	if(depth_map->remissions.size() != depth_map->distances.size())
+	    throw std::out_of_range("The depth map has no remissions.");
+	return mapMeasurements(depth_map->remissions);
+    }
+    
+    /** Returns the vertical interval of the view, with one entry per row.
+     * Intervals of the depth map with less than two entries are returned as they are. */
+    std::vector<double> getVerticalInterval() const { return computeInterval(false, 1); }
+    
+    /** Returns the horizontal interval of the view, with one entry per column.
+     * Intervals of the depth map with less than two entries are returned as they are. */
+    std::vector<double> getHorizontalInterval() const { return computeInterval(true, 1); }
+    
+    /** Returns the timestamps of the view. The timestamps per row, column or 
+     * measurement are the ones of the view, and a single timestamp is the one of 
+     * the depth map.
+     * 
+     * Two timestamps are the ones of the first and last rows of the depth map
+     * (or of its columns if timestamps_per_row is false), as in
+     * DepthMapProjector::convertDepthMapToDeskewedPointCloud. They are kept if the
+     * view has all these rows. Otherwise the times of the rows of the view are
+     * interpolated with base::interpolateTimes, one per row. timestamps_per_row
+     * also selects the rows if the depth map has as many rows as columns.
+     */
+    std::vector<base::Time> getTimestamps(bool timestamps_per_row = true) const
+    {
+	std::vector<base::Time> timestamps;
+	if(hasMeasurementTimestamps())
+	{
+	    timestamps.reserve((size_t)vertical_size * horizontal_size);
+	    for(uint32_t v = 0; v < vertical_size; v++)
+		for(uint32_t h = 0; h < horizontal_size; h++)
+		    timestamps.push_back(depth_map->timestamps[getIndex(v, h)]);
+	}
+	else
+	    selectTimestamps(timestamps, 1, 1, timestamps_per_row);
+	return timestamps;
+    }
+    
+    /** Copies the measurements and the metadata of the view into a depth map.
+     * See getTimestamps for the meaning of timestamps_per_row */
+    void toDepthMap(DepthMap& result, bool timestamps_per_row = true) const
+    {
+	decimate(result, 1, 1, DECIMATE_MIN, timestamps_per_row);
+    }
+    
+    /** Reduces each block of row_factor x column_factor measurements of the view to
+     * one measurement of the result: the one with the smallest valid distance or the
+     * one with the median of the valid distances (the lower one for an even count).
+     * The remission and the timestamp of the selected measurement are kept with it. 
+     * A block without valid measurements keeps its first one, so that the state of
+     * the measurement does not change. The blocks of the last row and column are 
+     * smaller if the size of the view is not a multiple of the factor.
+     * The intervals of the result are the ones at the centers of the blocks.
+     * The timestamps per row or column are the ones of the first row or column
+     * of the blocks, see getTimestamps for the two-timestamp convention.
+     * When compiled with OpenMP, the rows are decimated in parallel.
+     * 
+     * @param result must not be the viewed depth map
+     * @param timestamps_per_row true, if two timestamps of the depth map are the 
+     *        ones of its first and last rows, false if of its first and last columns
+     * \throws std::invalid_argument if a factor is zero
+     */
+    void decimate(DepthMap& result, uint32_t row_factor, uint32_t column_factor, 
+		  DECIMATION_MODE mode = DECIMATE_MIN, bool timestamps_per_row = true) const
+    {
+	if(row_factor == 0 || column_factor == 0)
+	    throw std::invalid_argument("The decimation factors must be positive.");
+	if(&result == depth_map)
+	    throw std::invalid_argument("A depth map can not be decimated into itself.");
+	if(!checkSizeConfig())
+	    throw std::out_of_range("The view is not within the depth map.");
+	
+	const DepthMap& source = *depth_map;
+	const uint32_t rows = blockCount(vertical_size, row_factor);
+	const uint32_t columns = blockCount(horizontal_size, column_factor);
+	const size_t count = (size_t)rows * (size_t)columns;
+	const bool with_remissions = source.remissions.size() == source.distances.size();
+	const bool measurement_timestamps = hasMeasurementTimestamps();
+	
+	result.vertical_projection = source.vertical_projection;
+	result.horizontal_projection = source.horizontal_projection;
+	result.vertical_interval = computeInterval(false, row_factor);
+	result.horizontal_interval = computeInterval(true, column_factor);
+	result.vertical_size = rows;
+	result.horizontal_size = columns;
+	result.distances.resize(count);
+	result.remissions.resize(with_remissions ? count : 0);
+	if(measurement_timestamps)
+	    result.timestamps.resize(count);
+	else
+	    selectTimestamps(result.timestamps, row_factor, column_factor, timestamps_per_row);
+	
+	const int output_rows = rows;
+#ifdef _OPENMP
+	#pragma omp parallel
+#endif
+	{
+	    // valid distances of a block and their indices
+	    std::vector< std::pair<scalar, size_t> > block;
+	    block.reserve((size_t)std::min(row_factor, vertical_size) * (size_t)std::min(column_factor, horizontal_size));
+#ifdef _OPENMP
+	    #pragma omp for schedule(static)
+#endif
+	    for(int i = 0; i < output_rows; i++)
+	    {
+		const uint32_t row_begin = i * row_factor;
+		const uint32_t row_end = blockEnd(row_begin, row_factor, vertical_size);
+		uint32_t column_begin = 0;
+		for(uint32_t j = 0; j < columns; j++)
+		{
+		    const uint32_t column_end = blockEnd(column_begin, column_factor, horizontal_size);
+		    block.clear();
+		    for(uint32_t v = row_begin; v < row_end; v++)
+		    {
+			for(uint32_t h = column_begin; h < column_end; h++)
+			{
+			    size_t index = getIndex(v, h);
+			    scalar distance = source.distances[index];
+			    if(source.isMeasurementValid(distance))
+				block.push_back(std::make_pair(distance, index));
+			}
+		    }
+		    
+		    size_t selected = getIndex(row_begin, column_begin);
+		    if(!block.empty())
+		    {
+			if(mode == DECIMATE_MEDIAN)
+			{
+			    std::vector< std::pair<scalar, size_t> >::iterator median = block.begin() + (block.size() - 1) / 2;
+			    std::nth_element(block.begin(), median, block.end());
+			    selected = median->second;
+			}
+			else
+			    selected = std::min_element(block.begin(), block.end())->second;
+		    }
+		    
+		    const size_t position = (size_t)i * columns + j;
+		    result.distances[position] = source.distances[selected];
+		    if(with_remissions)
+			result.remissions[position] = source.remissions[selected];
+		    if(measurement_timestamps)
+			result.timestamps[position] = source.timestamps[selected];
+		    column_begin = column_end;
+		}
+	    }
+	}
+    }
+    
+    /** Converts the measurements of the view to a pointcloud, without copying them.
+     * The indices of the points in PointcloudArrays are the ones of the measurements
+     * in the depth map.
+     * 
+     * @see DepthMap::convertDepthMapToPointCloud
+     */
+    template<typename T>
+    void convertDepthMapToPointCloud(std::vector<T> &point_cloud,
+				     const Eigen::Transform<typename T::Scalar,3,Eigen::Affine>& transformation = 
+					Eigen::Transform<typename T::Scalar,3,Eigen::Affine>::Identity(),
+				     bool use_lut = false, 
+				     bool skip_invalid_measurements = true) const
+    {
+	DepthMapProjector<typename T::Scalar>().convertDepthMapToPointCloud(*this, point_cloud, transformation,
+									     use_lut, skip_invalid_measurements);
+    }
+    
+    /** @see convertDepthMapToPointCloud */
+    void convertDepthMapToPointCloud(PointcloudArrays &point_cloud,
+				     const Eigen::Affine3d& transformation = Eigen::Affine3d::Identity(),
+				     bool use_lut = false, 
+				     bool skip_invalid_measurements = true) const;
+    
+private:
+    template<typename S> friend class DepthMapProjector;
+    
+    DepthMap::Grid getGrid() const
+    {
+	DepthMap::Grid grid = { (vertical_size && horizontal_size) ? getIndex(0, 0) : 0,
+				(size_t)row_step * (size_t)depth_map->horizontal_size, column_step, 
+				vertical_size, horizontal_size };
+	return grid;
+    }
+    
+    DepthMatrixMapConst mapMeasurements(const std::vector<scalar>& values) const
+    {
+	const DepthMap::Grid grid = getGrid();
+	return DepthMatrixMapConst(values.data() + grid.first, vertical_size, horizontal_size, 
+				   Stride((DepthMap::DepthMatrix::Index)grid.row_stride, (DepthMap::DepthMatrix::Index)grid.column_stride));
+    }
+    
+    bool hasMeasurementTimestamps() const
+    {
+	return depth_map->timestamps.size() > 1 && depth_map->timestamps.size() == depth_map->distances.size();
+    }
+    
+    /** Number of blocks of the given size needed to cover the elements */
+    static uint32_t blockCount(uint32_t elements, uint32_t block_size)
+    {
+	if(block_size == 0)
+	    throw std::out_of_range("The steps of a depth map view must be positive.");
+	return elements ? (elements - 1) / block_size + 1 : 0;
+    }
+    
+    /** End of the block starting at begin, which is at most the number of elements */
+    static uint32_t blockEnd(uint32_t begin, uint32_t block_size, uint32_t elements)
+    {
+	return block_size < elements - begin ? begin + block_size : elements;
+    }
+    
+    /** Computes the interval of the view decimated by the factor, with the values at 
+     * the centers of the blocks */
+    std::vector<double> computeInterval(bool horizontal, uint32_t factor) const
+    {
+	const std::vector<double>& interval = horizontal ? depth_map->horizontal_interval : depth_map->vertical_interval;
+	if(interval.size() < 2)
+	    return interval;
+	
+	const DepthMap::PROJECTION_TYPE projection = horizontal ? depth_map->horizontal_projection : depth_map->vertical_projection;
+	const uint32_t source_size = horizontal ? depth_map->horizontal_size : depth_map->vertical_size;
+	const uint32_t size = horizontal ? horizontal_size : vertical_size;
+	const uint32_t first = horizontal ? first_column : first_row;
+	const uint32_t step = horizontal ? column_step : row_step;
+	if(interval.size() > 2 && interval.size() != source_size)
+	    throw std::invalid_argument("Number of interval entries does no match the expected number of entries.");
+	
+	// the horizontal polar angles decrease from left to right
+	double resolution = 0.0;
+	if(interval.size() == 2 && source_size > 1)
+	    resolution = depth_map->computeResolution(interval, source_size, projection);
+	if(horizontal && projection == DepthMap::POLAR)
+	    resolution = -resolution;
+	
+	std::vector<double> result;
+	result.reserve(blockCount(size, factor));
+	for(uint32_t begin = 0; begin < size; )
+	{
+	    const uint32_t end = blockEnd(begin, factor, size);
+	    const double position = (double)first + (double)step * 0.5 * (double)(begin + end - 1);
+	    double value;
+	    if(interval.size() == 2)
+		value = interval.front() + position * resolution;
+	    else
+	    {
+		size_t index = (size_t)position;
+		double fraction = position - (double)index;
+		value = interval[index];
+		if(fraction > 0.0)
+		{
+		    double delta = interval[index + 1] - value;
+		    if(projection == DepthMap::POLAR)
+			delta = base::Angle::normalizeRad(delta);
+		    value += fraction * delta;
+		}
+	    }
+	    result.push_back(projection == DepthMap::POLAR ? base::Angle::normalizeRad(value) : value);
+	    begin = end;
+	}
+	return result;
+    }
+    
+    /** Selects the timestamps of the view decimated by the factors, if they are not 
+     * per measurement: the ones of the first row or column of the blocks. Two
+     * timestamps are interpolated along the rows or columns, see getTimestamps */
+    void selectTimestamps(std::vector<base::Time>& result, uint32_t row_factor, uint32_t column_factor,
+			  bool timestamps_per_row) const
+    {
+	const std::vector<base::Time>& timestamps = depth_map->timestamps;
+	result.clear();
+	bool per_row = timestamps_per_row;
+	if(timestamps.size() != 2 && timestamps.size() != (per_row ? depth_map->vertical_size : depth_map->horizontal_size))
+	    per_row = !per_row;
+	const uint32_t groups = per_row ? depth_map->vertical_size : depth_map->horizontal_size;
+	if(timestamps.size() < 2 || (timestamps.size() != 2 && timestamps.size() != groups))
+	{
+	    result = timestamps;
+	    return;
+	}
+	
+	const uint32_t first = per_row ? first_row : first_column;
+	const uint32_t size = per_row ? vertical_size : horizontal_size;
+	const uint32_t step = per_row ? row_step : column_step;
+	const uint32_t factor = per_row ? row_factor : column_factor;
+	if(timestamps.size() == 2 && first == 0 && step == 1 && factor == 1 && size == groups)
+	{
+	    // all rows or columns, the interpolation stays the same
+	    result = timestamps;
+	    return;
+	}
+	std::vector<base::Time> times;
+	base::interpolateTimes(timestamps, groups, times);
+	for(uint32_t i = 0; i < size; i = blockEnd(i, factor, size))
+	    result.push_back(times[first + i * step]);
+    }
+};
+
+/**
+ * Converts the depth maps of a sensor to point clouds.
+ * 
+ * The rotations of the rows and columns only depend on the projection types,
+ * the intervals and the sizes of the depth map, which usually do not change
+ * from one depth map of a sensor to the next. The projector keeps them and 
+ * recomputes them only when a hash of these fields changes, so that a stream
+ * of depth maps is converted without computing any trigonometric function
+ * after the first one.
+ * 
+ * The conversion methods are the ones of DepthMap. They convert into a std::vector
+ * of points of the scalar type of the projector, or into PointcloudArrays. A
+ * DepthMapView is converted like a depth map.
+ * A projector must not be used by several threads at the same time.
+ */
+template<typename S>
+class DepthMapProjector
+{
+public:
+    typedef Eigen::Transform<S,3,Eigen::Affine> Transform;
+    
+    DepthMapProjector() : geometry_hash(0), geometry_valid(false) {}
+    
+    /** Forgets the cached geometry */
+    void reset()
+    {
+	geometry_valid = false;
+	rows2column.clear();
+	columns2pointcloud.clear();
+    }
+    
+    /** @see DepthMap::convertDepthMapToPointCloud */
+    template<typename Cloud>
+    void convertDepthMapToPointCloud(const DepthMap& depth_map,
+				     Cloud &point_cloud,
+				     const Transform& transformation = Transform::Identity(),
+				     bool use_lut = false, 
+				     bool skip_invalid_measurements = true)
+    {
+	if(!prepare(depth_map, point_cloud, use_lut))
+	    return;
+	
+	depth_map.convertRows(depth_map.makeOutput(point_cloud), depth_map.getGrid(), rows2column, columns2pointcloud, 
+			      std::vector<Transform>(1, transformation), 
+			      skip_invalid_measurements);
+    }
+    
+    /** Converts the measurements of a view of a depth map. The cached geometry is 
+     * the one of the whole depth map, so that all views of a sensor share it.
+     * @see DepthMap::convertDepthMapToPointCloud */
+    template<typename Cloud>
+    void convertDepthMapToPointCloud(const DepthMapView& view,
+				     Cloud &point_cloud,
+				     const Transform& transformation = Transform::Identity(),
+				     bool use_lut = false, 
+				     bool skip_invalid_measurements = true)
+    {
+	const DepthMap& depth_map = *view.depth_map;
+	if(!view.checkSizeConfig())
+	{
+	    point_cloud.clear();
+	    throw std::out_of_range("The view is not within the depth map.");
+	}
+	if(!prepare(depth_map, point_cloud, use_lut))
+	    return;
+	
+	view_rows2column.resize(view.vertical_size);
+	for(unsigned v = 0; v < view.vertical_size; v++)
+	    view_rows2column[v] = rows2column[view.first_row + v * view.row_step];
+	columns2world.resize(view.horizontal_size);
+	for(unsigned h = 0; h < view.horizontal_size; h++)
+	    columns2world[h] = columns2pointcloud[view.first_column + h * view.column_step];
+	
+	depth_map.convertRows(depth_map.makeOutput(point_cloud), view.getGrid(), view_rows2column, columns2world, 
+			      std::vector<Transform>(1, transformation), 
+			      skip_invalid_measurements);
+    }
+    
+    /** @see DepthMap::convertDepthMapToPointCloud */
+    template<typename Cloud>
+    void convertDepthMapToPointCloud(const DepthMap& depth_map,
+				     Cloud &point_cloud,
+				     const Transform& first_transformation,
+				     const Transform& last_transformation,
+				     bool use_lut = false,
+				     bool skip_invalid_measurements = true,
+				     bool apply_transforms_vertically = true)
+    {
+	if(!prepare(depth_map, point_cloud, use_lut))
+	    return;
+	
+	Eigen::Matrix<S,3,1> translation_delta = last_transformation.translation() - first_transformation.translation();
+	Eigen::Quaternion<S> first_rotation = Eigen::Quaternion<S>(first_transformation.linear());
+	Eigen::Quaternion<S> last_rotation = Eigen::Quaternion<S>(last_transformation.linear());
+	
+	// interpolate the transformations row- or column-wise
+	unsigned size = apply_transforms_vertically ? depth_map.vertical_size : depth_map.horizontal_size;
+	interpolated.resize(size);
+	for(unsigned i = 0; i < size; i++)
+	{
+	    interpolated[i] = Transform(first_rotation.slerp((double)i / (double)(size-1), last_rotation));
+	    interpolated[i].pretranslate(first_transformation.translation() + ((double)i / (double)(size-1)) * translation_delta);
+	}
+	
+	convertWithTransformations(depth_map, point_cloud, interpolated, 
+				   skip_invalid_measurements, apply_transforms_vertically);
+    }
+    
+    /** @see DepthMap::convertDepthMapToPointCloud */
+    template<typename Cloud>
+    void convertDepthMapToPointCloud(const DepthMap& depth_map,
+				     Cloud &point_cloud,
+				     const std::vector<Transform>& transformations,
+				     bool use_lut = false,
+				     bool skip_invalid_measurements = true,
+				     bool apply_transforms_vertically = true)
+    {
+	if(!prepare(depth_map, point_cloud, use_lut))
+	    return;
+	
+	if(transformations.size() != (apply_transforms_vertically ? depth_map.vertical_size : depth_map.horizontal_size))
+	    throw std::out_of_range("Invalid amount of transformations given");
+	
+	convertWithTransformations(depth_map, point_cloud, transformations, 
+				   skip_invalid_measurements, apply_transforms_vertically);
+    }
+    
+    /** Converts the depth map to a pointcloud in the world frame, compensating
+     * the motion of the sensor during the measurement.
+     * 
+     * The pose of the sensor is looked up for each group of measurements with the
+     * same timestamp, depending on the number of timestamps of the depth map:
+     * - one for all measurements
+     * - one per row or column, as selected by apply_transforms_vertically
+     * - two, the times of the first and last row or column, between which the
+     *   times of the other ones are interpolated
+     * - one per measurement, consecutive measurements with the same time
+     *   sharing their pose
+     * The poses are looked up before the conversion, which runs in parallel
+     * when compiled with OpenMP.
+     * 
+     * @param sensor2world functor called as bool sensor2world(const base::Time&, Transform& pose),
+     *                     which returns false if there is no pose at that time, e.g. RigidBodyStatePoses
+     * @param apply_transforms_vertically true, if the timestamps are per row
+     * \throws std::invalid_argument if the number of timestamps matches none of the cases
+     * \throws std::out_of_range if there is no pose at the time of a valid measurement
+     */
+    template<typename Cloud, typename PoseAtTime>
+    void convertDepthMapToDeskewedPointCloud(const DepthMap& depth_map,
+					     Cloud &point_cloud,
+					     PoseAtTime sensor2world,
+					     bool use_lut = false,
+					     bool skip_invalid_measurements = true,
+					     bool apply_transforms_vertically = true)
+    {
+	if(!prepare(depth_map, point_cloud, use_lut))
+	    return;
+	
+	const std::vector<base::Time>& timestamps = depth_map.timestamps;
+	const size_t groups = apply_transforms_vertically ? depth_map.vertical_size : depth_map.horizontal_size;
+	if(timestamps.size() == depth_map.distances.size() && timestamps.size() > 1)
+	{
+	    convertWithMeasurementPoses(depth_map, point_cloud, sensor2world, skip_invalid_measurements);
+	}
+	else if(timestamps.size() == 1)
+	{
+	    interpolated.resize(1);
+	    lookupPose(sensor2world, timestamps.front(), interpolated.front(), point_cloud);
+	    depth_map.convertRows(depth_map.makeOutput(point_cloud), depth_map.getGrid(), rows2column, columns2pointcloud, 
+				  interpolated, skip_invalid_measurements);
+	}
+	else if(timestamps.size() == groups || timestamps.size() == 2)
+	{
+	    base::interpolateTimes(timestamps, groups, group_times);
+	    interpolated.resize(groups);
+	    for(size_t i = 0; i < groups; i++)
+		lookupPose(sensor2world, group_times[i], interpolated[i], point_cloud);
+	    convertWithTransformations(depth_map, point_cloud, interpolated, 
+				       skip_invalid_measurements, apply_transforms_vertically);
+	}
+	else
+	{
+	    point_cloud.clear();
+	    throw std::invalid_argument("Number of timestamps does not match the size of the depth map.");
+	}
+    }
+    
+private:
+    template<typename Cloud, typename PoseAtTime>
+    void lookupPose(PoseAtTime& sensor2world, const base::Time& time, Transform& pose, Cloud &point_cloud)
+    {
+	if(!sensor2world(time, pose))
+	{
+	    point_cloud.clear();
+	    throw std::out_of_range("No pose of the sensor at " + time.toString());
+	}
+    }
+    
+    /** Converts the measurements with one pose per group of consecutive
+     * measurements with the same timestamp. */
+    template<typename Cloud, typename PoseAtTime>
+    void convertWithMeasurementPoses(const DepthMap& depth_map,
+				     Cloud &point_cloud,
+				     PoseAtTime& sensor2world,
+				     bool skip_invalid_measurements)
+    {
+	const std::vector<base::Time>& timestamps = depth_map.timestamps;
+	const std::vector<DepthMap::scalar>& distances = depth_map.distances;
+	
+	// poses of the groups, only needed if they contain a valid measurement
+	group_starts.clear();
+	interpolated.clear();
+	for(size_t i = 0; i < timestamps.size(); )
+	{
+	    size_t end = i + 1;
+	    bool needed = depth_map.isMeasurementValid(distances[i]);
+	    while(end < timestamps.size() && timestamps[end] == timestamps[i])
+		needed |= depth_map.isMeasurementValid(distances[end++]);
+	    Transform pose = Transform::Identity();
+	    if(needed)
+		lookupPose(sensor2world, timestamps[i], pose, point_cloud);
+	    group_starts.push_back(i);
+	    interpolated.push_back(pose);
+	    i = end;
+	}
+	
+	convertWithGroupPoses(depth_map, depth_map.makeOutput(point_cloud), skip_invalid_measurements);
+    }
+    
+    /** Converts the measurements with the poses of the groups */
+    template<typename Output>
+    void convertWithGroupPoses(const DepthMap& depth_map, Output output, bool skip_invalid_measurements) const
+    {
+	std::vector<size_t> row_positions;
+	size_t count = depth_map.computeRowPositions(row_positions, depth_map.getGrid(), skip_invalid_measurements);
+	output.resize(count);
+	if(count == 0)
+	    return;
+	
+	const std::vector<DepthMap::scalar>& distances = depth_map.distances;
+	const int rows = depth_map.vertical_size;
+	const size_t columns = depth_map.horizontal_size;
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(static)
+#endif
+	for(int v = 0; v < rows; v++)
+	{
+	    const Eigen::Matrix<S,3,1> r = rows2column[v].linear().col(0);
+	    size_t index = (size_t)v * columns;
+	    size_t group = std::upper_bound(group_starts.begin(), group_starts.end(), index) - group_starts.begin() - 1;
+	    size_t position = row_positions[v];
+	    for(size_t h = 0; h < columns; h++, index++)
+	    {
+		while(group + 1 < group_starts.size() && group_starts[group + 1] <= index)
+		    group++;
+		DepthMap::scalar distance = distances[index];
+		if(depth_map.isMeasurementValid(distance))
+		{
+		    Eigen::Matrix<S,3,1> point = interpolated[group] * (columns2pointcloud[h] * (r * (S)distance));
+		    output.setPoint(position++, point, index);
+		}
+		else if(!skip_invalid_measurements)
+		    output.setInvalid(position++, index);
+	    }
+	}
+    }
+    
+    /** Checks the depth map and updates the geometry if it changed.
+     * Returns false if there is nothing to convert. */
+    template<typename Cloud>
+    bool prepare(const DepthMap& depth_map, Cloud &point_cloud, bool use_lut)
+    {
+	// check row and col size
+	if(!depth_map.checkSizeConfig())
+	{
+	    point_cloud.clear();
+	    throw std::out_of_range("Number of rows and columns does not match the distance array size.");
+	}
+
+	// check if nothing to do
+	if(depth_map.distances.empty())
+	{
+	    point_cloud.clear();
+	    return false;
+	}
+	
+	uint64_t hash = computeGeometryHash(depth_map, use_lut);
+	if(!geometry_valid || hash != geometry_hash)
+	{
+	    geometry_valid = false;
+	    depth_map.computeLocalTransformations(rows2column, columns2pointcloud, use_lut);
+	    geometry_hash = hash;
+	    geometry_valid = true;
+	}
+	return true;
+    }
+    
+    /** Applies one transformation per row or per column. */
+    template<typename Cloud>
+    void convertWithTransformations(const DepthMap& depth_map,
+				    Cloud &point_cloud,
+				    const std::vector<Transform>& transformations,
+				    bool skip_invalid_measurements,
+				    bool apply_transforms_vertically)
+    {
+	if(!apply_transforms_vertically)
+	{
+	    columns2world.resize(depth_map.horizontal_size);
+	    for(unsigned h = 0; h < depth_map.horizontal_size; h++)
+		columns2world[h] = transformations[h] * columns2pointcloud[h];
+	    depth_map.convertRows(depth_map.makeOutput(point_cloud), depth_map.getGrid(), rows2column, columns2world, 
+				  std::vector<Transform>(), skip_invalid_measurements);
+	}
+	else
+	{
+	    depth_map.convertRows(depth_map.makeOutput(point_cloud), depth_map.getGrid(), rows2column, columns2pointcloud, 
+				  transformations, skip_invalid_measurements);
+	}
+    }
+    
+    /** FNV-1a hash of the fields the local transformations depend on */
+    static uint64_t computeGeometryHash(const DepthMap& depth_map, bool use_lut)
+    {
+	uint64_t hash = 14695981039346656037ULL;
+	uint32_t header[6] = { (uint32_t)depth_map.vertical_projection, (uint32_t)depth_map.horizontal_projection,
+			       depth_map.vertical_size, depth_map.horizontal_size, 
+			       (uint32_t)depth_map.vertical_interval.size(), use_lut ? 1u : 0u };
+	hash = hashBytes(hash, header, sizeof(header));
+	if(!depth_map.vertical_interval.empty())
+	    hash = hashBytes(hash, &depth_map.vertical_interval[0], depth_map.vertical_interval.size() * sizeof(double));
+	if(!depth_map.horizontal_interval.empty())
+	    hash = hashBytes(hash, &depth_map.horizontal_interval[0], depth_map.horizontal_interval.size() * sizeof(double));
+	return hash;
+    }
+    
+    static uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+    {
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for(size_t i = 0; i < size; i++)
+	    hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	return hash;
+    }
+    
+    uint64_t geometry_hash;
+    bool geometry_valid;
+    std::vector<Transform> rows2column;
+    std::vector<Transform> columns2pointcloud;
+    /** buffers of the conversions with several transformations and of the views */
+    std::vector<Transform> columns2world;
+    std::vector<Transform> view_rows2column;
+    std::vector<Transform> interpolated;
+    std::vector<size_t> group_starts;
+    std::vector<base::Time> group_times;
+};
+
+inline void DepthMapView::convertDepthMapToPointCloud(PointcloudArrays &point_cloud,
+						      const Eigen::Affine3d& transformation,
+						      bool use_lut, 
+						      bool skip_invalid_measurements) const
+{
+    DepthMapProjector<double>().convertDepthMapToPointCloud(*this, point_cloud, transformation,
+							    use_lut, skip_invalid_measurements);
+}
+
+inline void DepthMap::convertDepthMapToPointCloud(PointcloudArrays &point_cloud,
+						  const Eigen::Affine3d& transformation,
+						  bool use_lut, 
+						  bool skip_invalid_measurements) const
+{
+    DepthMapProjector<double>().convertDepthMapToPointCloud(*this, point_cloud, transformation,
+							    use_lut, skip_invalid_measurements);
+}
+
+/**
+ * Poses of a sensor interpolated from a history of RigidBodyState, for
+ * DepthMapProjector::convertDepthMapToDeskewedPointCloud.
+ * The states must be the pose of the sensor in the world frame. The history
+ * is referenced, not copied.
+ */
+class RigidBodyStatePoses
+{
+public:
+    /** @param max_gap if non-null, no pose is interpolated between states further apart than this */
+    explicit RigidBodyStatePoses(const base::TimeIndexedBuffer<RigidBodyState>& poses, 
+				 const base::Time& max_gap = base::Time())
+	: poses(&poses), max_gap(max_gap) {}
+    
+    template<typename S>
+    bool operator()(const base::Time& time, Eigen::Transform<S,3,Eigen::Affine>& pose) const
+    {
+	RigidBodyState state;
+	if(!poses->interpolate(time, state, max_gap))
+	    return false;
+	pose = state.getTransform().template cast<S>();
+	return true;
+    }
+    
+private:
+    const base::TimeIndexedBuffer<RigidBodyState>* poses;
+    base::Time max_gap;
+};
+
 }} // namespaces
 
 #endif
\ No newline at end of file
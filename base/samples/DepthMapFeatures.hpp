@@ -0,0 +1,318 @@
+#ifndef __BASE_SAMPLES_DEPTH_MAP_FEATURES_HPP__
+#define __BASE_SAMPLES_DEPTH_MAP_FEATURES_HPP__
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <Eigen/Geometry>
+
+#include <base/Float.hpp>
+#include <base/samples/DepthMap.hpp>
+#include <base/samples/PointcloudArrays.hpp>
+
+namespace base { namespace samples {
+
+/**
+ * Neighborhood features of the measurements of a DepthMap, computed on its
+ * organized grid instead of searching the neighbors of the points in a k-d tree.
+ *
+ * The neighbors of the measurement (v, h) are the measurements (v -/+ 1, h) and
+ * (v, h -/+ 1). A neighbor is used if it is valid and if the ratio of its distance
+ * to the distance of the measurement is at most max_ratio, so that the features
+ * do not mix surfaces on both sides of a depth discontinuity. The first and last
+ * columns are not neighbors, even in a full circle scan.
+ *
+ * All results are organized like the distances of the depth map, with one entry
+ * per measurement. The kernels process three rows at a time and, when compiled
+ * with OpenMP, the rows in parallel.
+ * The buffers are kept, so that a stream of depth maps is processed without
+ * allocations. An object must not be used by several threads at the same time.
+ */
+class DepthMapFeatures
+{
+public:
+    typedef DepthMap::scalar scalar;
+    typedef boost::uint32_t uint32_t;
+    typedef boost::uint8_t uint8_t;
+
+    enum EDGE_TYPE
+    {
+	/** No neighbor is on another surface */
+	NO_EDGE     = 0,
+	/** A neighbor is farther: the measurement is in front of a discontinuity */
+	OCCLUDING   = 1,
+	/** A neighbor is nearer: the measurement may be partially hidden */
+	OCCLUDED    = 2,
+	/** A neighbor is an invalid measurement */
+	BORDER      = 4
+    };
+
+    explicit DepthMapFeatures(float max_ratio = 1.3f) : max_ratio(max_ratio) {}
+
+    void setMaxRatio(float ratio) { max_ratio = ratio; }
+    float getMaxRatio() const { return max_ratio; }
+
+    /** Computes the normal of each valid measurement from the points of its
+     * horizontal and vertical neighbors: the cross product of the central
+     * differences, or of the one-sided ones if a neighbor can not be used.
+     * The normals point towards the sensor. Measurements without a neighbor
+     * in both directions get NaN.
+     *
+     * @param normals one normal per measurement, in the frame given by the transformation
+     * @param transformation from the sensor to the frame of the normals
+     */
+    void computeNormals(const DepthMap& depth_map,
+			PointcloudArrays& normals,
+			const Eigen::Affine3d& transformation = Eigen::Affine3d::Identity(),
+			bool use_lut = false)
+    {
+	projector.convertDepthMapToPointCloud(depth_map, points, transformation, use_lut, false);
+	const size_t size = depth_map.distances.size();
+	normals.resize(size);
+	if(size == 0)
+	    return;
+
+	const Eigen::Vector3f origin = transformation.translation().cast<float>();
+	const int rows = depth_map.vertical_size;
+	const uint32_t columns = depth_map.horizontal_size;
+	const float nan = base::unknown<float>();
+	const float* px = &points.x[0];
+	const float* py = &points.y[0];
+	const float* pz = &points.z[0];
+	float* nx = &normals.x[0];
+	float* ny = &normals.y[0];
+	float* nz = &normals.z[0];
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(static)
+#endif
+	for(int v = 0; v < rows; v++)
+	{
+	    for(uint32_t h = 0; h < columns; h++)
+	    {
+		const size_t index = depth_map.getIndex(v, h);
+		size_t left = h > 0 ? index - 1 : index, right = h + 1 < columns ? index + 1 : index;
+		size_t up = v > 0 ? index - columns : index, down = v + 1 < rows ? index + columns : index;
+		nx[index] = ny[index] = nz[index] = nan;
+		if(!depth_map.isMeasurementValid(depth_map.distances[index]) ||
+		   selectNeighbors(depth_map, index, left, right) == 0 ||
+		   selectNeighbors(depth_map, index, up, down) == 0)
+		    continue;
+		
+		// cross product of the horizontal and vertical tangents
+		const float hx = px[right] - px[left], hy = py[right] - py[left], hz = pz[right] - pz[left];
+		const float vx = px[down] - px[up], vy = py[down] - py[up], vz = pz[down] - pz[up];
+		float cx = hy * vz - hz * vy, cy = hz * vx - hx * vz, cz = hx * vy - hy * vx;
+		const float norm = std::sqrt(cx * cx + cy * cy + cz * cz);
+		if(norm == 0.0f)
+		    continue;
+		
+		// towards the sensor
+		float scale = 1.0f / norm;
+		if(cx * (px[index] - origin.x()) + cy * (py[index] - origin.y()) + cz * (pz[index] - origin.z()) > 0.0f)
+		    scale = -scale;
+		nx[index] = cx * scale;
+		ny[index] = cy * scale;
+		nz[index] = cz * scale;
+	    }
+	}
+	
+	for(size_t i = 0; i < normals.indices.size(); i++)
+	    normals.indices[i] = i;
+	std::fill(normals.remissions.begin(), normals.remissions.end(), nan);
+    }
+
+    /** Computes the slope of each normal, the angle between the surface and the
+     * xy-plane of the frame of the normals, in [0, PI/2]. NaN normals get NaN. */
+    static void computeSlopes(const PointcloudArrays& normals, std::vector<float>& slopes)
+    {
+	const int size = normals.size();
+	slopes.resize(size);
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(static)
+#endif
+	for(int i = 0; i < size; i++)
+	    slopes[i] = std::acos(std::min(std::abs(normals.z[i]), 1.0f));
+    }
+
+    /** Computes the change of the distance per row and per column of each
+     * measurement: the central difference, or the one-sided one if a neighbor
+     * can not be used. The gradient is NaN if there is no usable neighbor in
+     * that direction or the measurement is invalid. */
+    void computeGradients(const DepthMap& depth_map,
+			  std::vector<float>& vertical_gradients,
+			  std::vector<float>& horizontal_gradients) const
+    {
+	checkDepthMap(depth_map);
+	const size_t size = depth_map.distances.size();
+	vertical_gradients.resize(size);
+	horizontal_gradients.resize(size);
+
+	const int rows = depth_map.vertical_size;
+	const uint32_t columns = depth_map.horizontal_size;
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(static)
+#endif
+	for(int v = 0; v < rows; v++)
+	{
+	    for(uint32_t h = 0; h < columns; h++)
+	    {
+		const size_t index = depth_map.getIndex(v, h);
+		horizontal_gradients[index] = computeGradient(depth_map, index,
+		    h > 0 ? index - 1 : index, h + 1 < columns ? index + 1 : index);
+		vertical_gradients[index] = computeGradient(depth_map, index,
+		    v > 0 ? index - columns : index, v + 1 < rows ? index + columns : index);
+	    }
+	}
+    }
+
+    /** Classifies each measurement with the EDGE_TYPE flags of its neighbors.
+     * A valid neighbor is on another surface if the ratio of the distances
+     * exceeds max_ratio. Invalid measurements get NO_EDGE. */
+    void detectEdges(const DepthMap& depth_map, std::vector<uint8_t>& edges) const
+    {
+	checkDepthMap(depth_map);
+	edges.resize(depth_map.distances.size());
+
+	const int rows = depth_map.vertical_size;
+	const uint32_t columns = depth_map.horizontal_size;
+	const std::vector<scalar>& distances = depth_map.distances;
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(static)
+#endif
+	for(int v = 0; v < rows; v++)
+	{
+	    for(uint32_t h = 0; h < columns; h++)
+	    {
+		const size_t index = depth_map.getIndex(v, h);
+		const scalar distance = distances[index];
+		uint8_t flags = NO_EDGE;
+		if(depth_map.isMeasurementValid(distance))
+		{
+		    if(h > 0)
+			flags |= classifyNeighbor(depth_map, distance, distances[index - 1]);
+		    if(h + 1 < columns)
+			flags |= classifyNeighbor(depth_map, distance, distances[index + 1]);
+		    if(v > 0)
+			flags |= classifyNeighbor(depth_map, distance, distances[index - columns]);
+		    if(v + 1 < rows)
+			flags |= classifyNeighbor(depth_map, distance, distances[index + columns]);
+		}
+		edges[index] = flags;
+	    }
+	}
+    }
+
+    /** Replaces the distance of each valid measurement by the median (the lower
+     * one for an even count) of the valid distances in the window of
+     * (2 * radius + 1) x (2 * radius + 1) measurements around it. The invalid
+     * measurements are kept, and so are the other fields of the depth map.
+     *
+     * @param result must not be the filtered depth map
+     */
+    static void medianFilter(const DepthMap& depth_map, DepthMap& result, unsigned radius = 1)
+    {
+	checkDepthMap(depth_map);
+	if(&result == &depth_map)
+	    throw std::invalid_argument("A depth map can not be filtered into itself.");
+	result = depth_map;
+
+	const int rows = depth_map.vertical_size;
+	const uint32_t columns = depth_map.horizontal_size;
+	const std::vector<scalar>& distances = depth_map.distances;
+#ifdef _OPENMP
+	#pragma omp parallel
+#endif
+	{
+	    std::vector<scalar> window;
+	    window.reserve((2 * radius + 1) * (2 * radius + 1));
+#ifdef _OPENMP
+	    #pragma omp for schedule(static)
+#endif
+	    for(int v = 0; v < rows; v++)
+	    {
+		const uint32_t row_begin = (uint32_t)v > radius ? v - radius : 0;
+		const uint32_t row_end = std::min<uint32_t>(v + radius + 1, rows);
+		for(uint32_t h = 0; h < columns; h++)
+		{
+		    const size_t index = depth_map.getIndex(v, h);
+		    if(!depth_map.isMeasurementValid(distances[index]))
+			continue;
+
+		    const uint32_t column_begin = h > radius ? h - radius : 0;
+		    const uint32_t column_end = std::min<uint32_t>(h + radius + 1, columns);
+		    window.clear();
+		    for(uint32_t r = row_begin; r < row_end; r++)
+		    {
+			const scalar* row = &distances[depth_map.getIndex(r, 0)];
+			for(uint32_t c = column_begin; c < column_end; c++)
+			    if(depth_map.isMeasurementValid(row[c]))
+				window.push_back(row[c]);
+		    }
+		    std::vector<scalar>::iterator median = window.begin() + (window.size() - 1) / 2;
+		    std::nth_element(window.begin(), median, window.end());
+		    result.distances[index] = *median;
+		}
+	    }
+	}
+    }
+
+    /** Organized points of the last call to computeNormals */
+    const PointcloudArrays& getPoints() const { return points; }
+
+private:
+    static void checkDepthMap(const DepthMap& depth_map)
+    {
+	if((size_t)depth_map.vertical_size * (size_t)depth_map.horizontal_size != depth_map.distances.size())
+	    throw std::out_of_range("Number of rows and columns does not match the distance array size.");
+    }
+
+    /** Returns true if the neighbor can be used for the features of the measurement */
+    inline bool isNeighbor(const DepthMap& depth_map, scalar distance, scalar neighbor) const
+    {
+	return depth_map.isMeasurementValid(neighbor) &&
+	       std::max(distance, neighbor) <= max_ratio * std::min(distance, neighbor);
+    }
+
+    inline uint8_t classifyNeighbor(const DepthMap& depth_map, scalar distance, scalar neighbor) const
+    {
+	if(!depth_map.isMeasurementValid(neighbor))
+	    return BORDER;
+	if(isNeighbor(depth_map, distance, neighbor))
+	    return NO_EDGE;
+	return neighbor > distance ? OCCLUDING : OCCLUDED;
+    }
+
+    /** Selects the usable neighbors before and after the measurement at index.
+     * A neighbor equal to index is outside of the depth map. Returns the
+     * number of steps between them, 0 if there is no usable neighbor. */
+    inline unsigned selectNeighbors(const DepthMap& depth_map, size_t index, size_t& before, size_t& after) const
+    {
+	const scalar distance = depth_map.distances[index];
+	if(before == index || !isNeighbor(depth_map, distance, depth_map.distances[before]))
+	    before = index;
+	if(after == index || !isNeighbor(depth_map, distance, depth_map.distances[after]))
+	    after = index;
+	return (before != index ? 1 : 0) + (after != index ? 1 : 0);
+    }
+
+    float computeGradient(const DepthMap& depth_map, size_t index, size_t before, size_t after) const
+    {
+	if(!depth_map.isMeasurementValid(depth_map.distances[index]))
+	    return base::unknown<float>();
+	unsigned steps = selectNeighbors(depth_map, index, before, after);
+	if(steps == 0)
+	    return base::unknown<float>();
+	return (depth_map.distances[after] - depth_map.distances[before]) / (float)steps;
+    }
+
+    float max_ratio;
+    DepthMapProjector<double> projector;
+    PointcloudArrays points;
+};
+
+}} // namespaces
+
+#endif
@@ -4,10 +4,14 @@
 #include <base/Time.hpp>
 #include <base/Eigen.hpp>
 #include "Pointcloud.hpp"
+#include "PointcloudArrays.hpp"
+#include <algorithm>
+#include <cmath>
 #include <vector>
 #include <Eigen/Core>
 #include <boost/math/special_functions/fpclassify.hpp>
 #include <limits>
+#include <stdexcept>
 
 namespace base
 {
@@ -92,7 +96,7 @@ namespace samples
 
 	    // only process vector if distance value is not NaN or inf
 	    const float d = data[width*y+x];
-	    if( boost::math::isnormal( d ) ) 
+	    if( isValidDistance( d ) ) 
 	    {
 		point *= d;
 		return true;
@@ -122,19 +126,46 @@ namespace samples
 	    return true;
 	}
 
+	/** 
+	 * Converts the distance image into a point cloud of the valid scene
+	 * points, in the order of the pixels.
+	 */
         base::samples::Pointcloud getPointCloud() const
         {
             base::samples::Pointcloud pointCloud;
-            Eigen::Vector3d point;
-            for(size_t y = 0; y < height ; y++)
-            {
-                for(size_t x = 0; x < width ; x++)
-                {
-                    pointCloud.points.push_back(point);
-                }
-            }
+            pointCloud.time = time;
+            convertToPointCloud( pointCloud.points );
             return pointCloud;
         }
+
+	/** 
+	 * Converts the distance image into scene points, like getScenePoint for
+	 * each pixel. The projective plane coordinates of the columns and rows
+	 * are computed once, and each point is then the product of the distance
+	 * with them. When compiled with OpenMP, the rows are converted in parallel.
+	 *
+	 * @param points - [out] the points, derived from a 3D eigen vector
+	 * @param skip_invalid - false to keep one point per pixel (an organized
+	 *                       cloud), with NaN for the pixels without distance
+	 */
+	template <class T>
+	void convertToPointCloud( std::vector<T>& points, bool skip_invalid = true ) const
+	{
+	    convertPixels( PointVectorOutput<T>( points ), skip_invalid );
+	}
+
+	/** 
+	 * Converts the distance image into coordinate arrays.
+	 * If enabled in the point cloud, the index of the pixel (width*y+x) is
+	 * stored with each point.
+	 *
+	 * @see convertToPointCloud
+	 */
+	void convertToPointCloud( PointcloudArrays& points, bool skip_invalid = true ) const
+	{
+	    points.time = time;
+	    convertPixels( PointArraysOutput( points ), skip_invalid );
+	}
         
 	/** 
 	 * The intrinsic matrix has the following form
@@ -199,6 +230,140 @@ namespace samples
 	    this->height = height;
 	    data.resize( width * height );
 	}
+
+	/** 
+	 * Returns true if the distance gives a scene point, i.e. it is neither
+	 * zero, subnormal, infinite nor NaN
+	 */
+	static bool isValidDistance( scalar d )
+	{
+	    const scalar magnitude = std::abs( d );
+	    return magnitude >= std::numeric_limits<scalar>::min() && magnitude <= std::numeric_limits<scalar>::max();
+	}
+
+    private:
+	template <class T>
+	class PointVectorOutput
+	{
+	public:
+	    explicit PointVectorOutput( std::vector<T>& points ) : points( &points ) {}
+
+	    void resize( size_t count )
+	    {
+		typedef typename T::Scalar S;
+		points->resize( count, T( S(0), S(0), S(0) ) );
+	    }
+
+	    inline void setPoint( size_t position, scalar x, scalar y, scalar z, size_t )
+	    {
+		(*points)[position] = T( x, y, z );
+	    }
+
+	private:
+	    std::vector<T>* points;
+	};
+
+	class PointArraysOutput
+	{
+	public:
+	    explicit PointArraysOutput( PointcloudArrays& points ) 
+		: points( &points ), x( 0 ), y( 0 ), z( 0 ), indices( 0 ) {}
+
+	    void resize( size_t count )
+	    {
+		points->resize( count );
+		std::fill( points->remissions.begin(), points->remissions.end(), std::numeric_limits<float>::quiet_NaN() );
+		if( count == 0 )
+		    return;
+		x = &points->x[0];
+		y = &points->y[0];
+		z = &points->z[0];
+		indices = points->indices.empty() ? 0 : &points->indices[0];
+	    }
+
+	    inline void setPoint( size_t position, scalar px, scalar py, scalar pz, size_t index )
+	    {
+		x[position] = px;
+		y[position] = py;
+		z[position] = pz;
+		if( indices )
+		    indices[position] = index;
+	    }
+
+	private:
+	    PointcloudArrays* points;
+	    float* x;
+	    float* y;
+	    float* z;
+	    PointcloudArrays::uint32_t* indices;
+	};
+
+	template <class Output>
+	void convertPixels( Output output, bool skip_invalid ) const
+	{
+	    const size_t size = (size_t)width * (size_t)height;
+	    if( data.size() < size )
+		throw std::out_of_range( "DistanceImage: the data is smaller than width * height" );
+	    if( size == 0 )
+	    {
+		output.resize( 0 );
+		return;
+	    }
+
+	    // projective plane coordinates of the columns and rows
+	    std::vector<scalar> column_coefficients( width ), row_coefficients( height );
+	    for( size_t x = 0; x < width; x++ )
+		column_coefficients[x] = (x*scale_x)+center_x;
+	    for( size_t y = 0; y < height; y++ )
+		row_coefficients[y] = (y*scale_y)+center_y;
+
+	    // position of the first point of each row: count the valid pixels
+	    // of each row, then accumulate
+	    const int rows = height;
+	    std::vector<size_t> row_positions( height + 1, 0 );
+	    if( skip_invalid )
+	    {
+#ifdef _OPENMP
+		#pragma omp parallel for schedule(static)
+#endif
+		for( int y = 0; y < rows; y++ )
+		{
+		    const scalar* row = &data[(size_t)y * width];
+		    size_t count = 0;
+		    for( size_t x = 0; x < width; x++ )
+			count += isValidDistance( row[x] ) ? 1 : 0;
+		    row_positions[y + 1] = count;
+		}
+		for( size_t y = 0; y < height; y++ )
+		    row_positions[y + 1] += row_positions[y];
+	    }
+	    else
+	    {
+		for( size_t y = 0; y <= height; y++ )
+		    row_positions[y] = y * width;
+	    }
+	    output.resize( row_positions[height] );
+
+	    const scalar nan = std::numeric_limits<scalar>::quiet_NaN();
+#ifdef _OPENMP
+	    #pragma omp parallel for schedule(static)
+#endif
+	    for( int y = 0; y < rows; y++ )
+	    {
+		const size_t row_index = (size_t)y * width;
+		const scalar* row = &data[row_index];
+		const scalar py = row_coefficients[y];
+		size_t position = row_positions[y];
+		for( size_t x = 0; x < width; x++ )
+		{
+		    const scalar d = row[x];
+		    if( isValidDistance( d ) )
+			output.setPoint( position++, column_coefficients[x] * d, py * d, d, row_index + x );
+		    else if( !skip_invalid )
+			output.setPoint( position++, nan, nan, nan, row_index + x );
+		}
+	    }
+	}
     };
 }
 }
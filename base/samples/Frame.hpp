@@ -16,6 +16,7 @@
 #include <iterator>
 
 #include <base/Time.hpp>
+#include <base/RateLimit.hpp>
 
 
 namespace base { namespace samples { namespace frame { 
@@ -392,11 +393,19 @@ namespace base { namespace samples { namespace frame {
             void validateImageSize(uint32_t size) const {
                 uint32_t expected_size = getPixelSize()*getPixelCount();
                 if (!isCompressed() && size != expected_size){
-		    std::cerr << "Frame: "
-		              << __FUNCTION__ << " (" << __FILE__ << ", line "
-		              << __LINE__ << "): " << "image size mismatch in setImage() ("
-		              << "getting " << size << " bytes but I was expecting " << expected_size << " bytes)"
-		              << std::endl;
+                    // Drivers tend to hit this for every frame
+                    static RateLimit limit;
+                    unsigned int suppressed;
+                    if (limit.allow(Time::fromSeconds(1), suppressed))
+                    {
+		        std::cerr << "Frame: "
+		                  << __FUNCTION__ << " (" << __FILE__ << ", line "
+		                  << __LINE__ << "): " << "image size mismatch in setImage() ("
+		                  << "getting " << size << " bytes but I was expecting " << expected_size << " bytes)";
+                        if (suppressed)
+                            std::cerr << " (" << suppressed << " similar messages suppressed)";
+                        std::cerr << std::endl;
+                    }
                     throw std::runtime_error("Frame::validateImageSize: wrong image size!");
                 }
             }
@@ -2,6 +2,7 @@
 #define BASE_SAMPLES_LASER_H__
 
 #include <vector>
+#include <cmath>
 #include <boost/cstdint.hpp>
 #include <Eigen/Geometry>
 #include <stdexcept>
@@ -9,6 +10,7 @@
 #include <base/Float.hpp>
 #include <base/Time.hpp>
 #include <base/Deprecated.hpp>
+#include <base/samples/PointcloudArrays.hpp>
 
 namespace base { namespace samples {
     /** Special values for the ranges. If a range has one of these values, then
@@ -131,6 +133,35 @@ namespace base { namespace samples {
 	    }
 	}
             
+        /** converts the laser scan into coordinate arrays according to the given transformation matrix,
+         *  the start_angle and the angular_resolution. See the std::vector version.
+         *  If enabled in the point cloud, the index of the scan point and its remission are stored with
+         *  each point, so that invalid scan points can be skipped without losing the remission association.
+         *  Points of invalid scan points that are not skipped are set to NaN.
+         */
+        void convertScanToPointCloud(PointcloudArrays &points,
+                                     const Eigen::Affine3d& transform = Eigen::Affine3d::Identity(),
+                                     bool skip_invalid_points = true) const
+        {
+            points.time = time;
+            points.resize(ranges.size());
+            const bool has_remission = remission.size() == ranges.size();
+            const float nan = base::unknown<float>();
+            size_t position = 0;
+            for(unsigned int i = 0; i < ranges.size(); i++) {
+                float point_remission = has_remission ? remission[i] : nan;
+                if(isRangeValid(ranges[i])) {
+                    double angle = start_angle + i * angular_resolution;
+                    double range = ranges[i] / 1000.0;
+                    Eigen::Vector3d point = transform * Eigen::Vector3d(range * cos(angle), range * sin(angle), 0.0);
+                    points.setPoint(position++, point.x(), point.y(), point.z(), i, point_remission);
+                } else if(!skip_invalid_points) {
+                    points.setPoint(position++, nan, nan, nan, i, point_remission);
+                }
+            }
+            points.resize(position);
+        }
+
         /**
          * Helper function that converts range 'i' to a point.
 	 * The origin ot the point will be the laserScanner
@@ -0,0 +1,90 @@
+#ifndef BASE_SAMPLES_POINTCLOUD_ARRAYS_HPP
+#define BASE_SAMPLES_POINTCLOUD_ARRAYS_HPP
+
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <Eigen/Core>
+
+#include <base/Time.hpp>
+
+namespace base { namespace samples {
+
+/**
+ * A point cloud stored as one array per coordinate (structure of arrays).
+ *
+ * This is the layout ICP, voxelization and other per-point kernels load into
+ * SIMD registers, without reordering the points of a std::vector of 3D vectors.
+ * DepthMap and LaserScan convert into it directly.
+ *
+ * Optionally, the cloud has the index of the source measurement of each point,
+ * which keeps the association with the source when invalid measurements are
+ * skipped, and the remission of each point. Both channels are enabled by the
+ * user and filled by the conversions.
+ *
+ * The arrays keep their capacity, so that converting each scan of a sensor
+ * into the same object does not allocate once it has grown to the scan size.
+ */
+struct PointcloudArrays
+{
+    typedef boost::uint32_t uint32_t;
+
+    /** Time of the source, i.e. LaserScan::time or the first timestamp of a DepthMap */
+    Time time;
+
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+
+    /** Index of the source measurement of each point, filled if with_indices is set */
+    std::vector<uint32_t> indices;
+
+    /** Remission of each point, filled if with_remissions is set. The points of
+     * sources without remissions get NaN */
+    std::vector<float> remissions;
+
+    bool with_indices;
+    bool with_remissions;
+
+    explicit PointcloudArrays(bool with_indices = false, bool with_remissions = false)
+	: with_indices(with_indices), with_remissions(with_remissions) {}
+
+    size_t size() const { return x.size(); }
+    bool empty() const { return x.empty(); }
+
+    /** Removes all points, keeping the capacity */
+    void clear()
+    {
+	resize(0);
+    }
+
+    /** Resizes the coordinates and the enabled channels. The disabled channels are emptied */
+    void resize(size_t size)
+    {
+	x.resize(size);
+	y.resize(size);
+	z.resize(size);
+	indices.resize(with_indices ? size : 0);
+	remissions.resize(with_remissions ? size : 0);
+    }
+
+    /** Sets the point at the given position, which must be less than size() */
+    inline void setPoint(size_t position, float px, float py, float pz, uint32_t index, float remission)
+    {
+	x[position] = px;
+	y[position] = py;
+	z[position] = pz;
+	if(with_indices)
+	    indices[position] = index;
+	if(with_remissions)
+	    remissions[position] = remission;
+    }
+
+    Eigen::Vector3f getPoint(size_t position) const
+    {
+	return Eigen::Vector3f(x[position], y[position], z[position]);
+    }
+};
+
+}} // namespaces
+
+#endif
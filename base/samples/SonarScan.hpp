@@ -14,6 +14,7 @@
 #include <stdexcept>
 
 #include <base/Time.hpp>
+#include <base/RateLimit.hpp>
 #include <base/Angle.hpp>
 #include <base/samples/SonarBeam.hpp>
 
@@ -313,11 +314,19 @@ namespace base { namespace samples {
             inline void setData(const char *data, uint32_t size) {
                 if (size != this->data.size())
                 {
-                    std::cerr << "SonarScan: "
-                        << __FUNCTION__ << " (" << __FILE__ << ", line "
-                        << __LINE__ << "): " << "size mismatch in setData() ("
-                                                 << size << " != " << this->data.size() << ")"
-                                                 << std::endl;
+                    // Drivers tend to hit this for every scan
+                    static RateLimit limit;
+                    unsigned int suppressed;
+                    if (limit.allow(Time::fromSeconds(1), suppressed))
+                    {
+                        std::cerr << "SonarScan: "
+                            << __FUNCTION__ << " (" << __FILE__ << ", line "
+                            << __LINE__ << "): " << "size mismatch in setData() ("
+                                                     << size << " != " << this->data.size() << ")";
+                        if (suppressed)
+                            std::cerr << " (" << suppressed << " similar messages suppressed)";
+                        std::cerr << std::endl;
+                    }
                     return;
                 }
                 memcpy(&this->data[0], data, size);
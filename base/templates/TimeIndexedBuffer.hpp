@@ -0,0 +1,349 @@
+#ifndef BASE_TIME_INDEXED_BUFFER_HPP
+#define BASE_TIME_INDEXED_BUFFER_HPP
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <base/Time.hpp>
+#include <base/Eigen.hpp>
+#include <base/templates/TimeStamped.hpp>
+#include <base/samples/RigidBodyState.hpp>
+#include <base/samples/Joints.hpp>
+
+namespace base {
+
+    /** Interpolation hook used by TimeIndexedBuffer::interpolate
+     *
+     * apply() computes the sample at \c ratio between \c a (ratio = 0) and
+     * \c b (ratio = 1). The default implementation is linear, which is valid
+     * for scalars and Eigen vectors. Specialize it for other types.
+     */
+    template<typename T>
+    struct Interpolator
+    {
+        static void apply(T const& a, T const& b, double ratio, T& result)
+        {
+            result = a + (b - a) * ratio;
+        }
+    };
+
+    /** Orientations are interpolated with SLERP */
+    template<typename Scalar, int Options>
+    struct Interpolator< Eigen::Quaternion<Scalar, Options> >
+    {
+        static void apply(Eigen::Quaternion<Scalar, Options> const& a, Eigen::Quaternion<Scalar, Options> const& b,
+                double ratio, Eigen::Quaternion<Scalar, Options>& result)
+        {
+            result = a.slerp(ratio, b);
+        }
+    };
+
+    /** Times are interpolated linearly, rounded to the microsecond */
+    template<>
+    struct Interpolator<Time>
+    {
+        static void apply(Time const& a, Time const& b, double ratio, Time& result)
+        {
+            result = a + Time::fromMicroseconds(static_cast<int64_t>(round((b - a).toMicroseconds() * ratio)));
+        }
+    };
+
+    template<typename BASE>
+    struct Interpolator< TimeStamped<BASE> >
+    {
+        static void apply(TimeStamped<BASE> const& a, TimeStamped<BASE> const& b, double ratio, TimeStamped<BASE>& result)
+        {
+            Interpolator<BASE>::apply(a, b, ratio, result.getBase());
+            Interpolator<Time>::apply(a.time, b.time, ratio, result.time);
+        }
+    };
+
+    /** Positions, velocities and covariances are interpolated linearly, the
+     * orientation with SLERP. The frame names are the ones of \c a */
+    template<>
+    struct Interpolator<samples::RigidBodyState>
+    {
+        static void apply(samples::RigidBodyState const& a, samples::RigidBodyState const& b,
+                double ratio, samples::RigidBodyState& result)
+        {
+            Interpolator<Time>::apply(a.time, b.time, ratio, result.time);
+            result.sourceFrame = a.sourceFrame;
+            result.targetFrame = a.targetFrame;
+            result.position = a.position + (b.position - a.position) * ratio;
+            result.cov_position = a.cov_position + (b.cov_position - a.cov_position) * ratio;
+            result.orientation = a.orientation.slerp(ratio, b.orientation);
+            result.cov_orientation = a.cov_orientation + (b.cov_orientation - a.cov_orientation) * ratio;
+            result.velocity = a.velocity + (b.velocity - a.velocity) * ratio;
+            result.cov_velocity = a.cov_velocity + (b.cov_velocity - a.cov_velocity) * ratio;
+            result.angular_velocity = a.angular_velocity + (b.angular_velocity - a.angular_velocity) * ratio;
+            result.cov_angular_velocity = a.cov_angular_velocity + (b.cov_angular_velocity - a.cov_angular_velocity) * ratio;
+        }
+    };
+
+    /** All fields are interpolated linearly */
+    template<>
+    struct Interpolator<JointState>
+    {
+        static void apply(JointState const& a, JointState const& b, double ratio, JointState& result)
+        {
+            result.position = a.position + (b.position - a.position) * ratio;
+            result.speed = a.speed + (b.speed - a.speed) * ratio;
+            result.effort = a.effort + (b.effort - a.effort) * ratio;
+            result.raw = a.raw + (b.raw - a.raw) * ratio;
+            result.acceleration = a.acceleration + (b.acceleration - a.acceleration) * ratio;
+        }
+    };
+
+    /** Joints are interpolated element by element. The names are the ones of
+     * \c a
+     *
+     * \throws std::invalid_argument if both samples have different sizes
+     */
+    template<>
+    struct Interpolator<samples::Joints>
+    {
+        static void apply(samples::Joints const& a, samples::Joints const& b, double ratio, samples::Joints& result)
+        {
+            if (a.elements.size() != b.elements.size())
+                throw std::invalid_argument("cannot interpolate between joint samples of different sizes");
+            Interpolator<Time>::apply(a.time, b.time, ratio, result.time);
+            result.names = a.names;
+            result.elements.resize(a.elements.size());
+            for (size_t i = 0; i < a.elements.size(); ++i)
+                Interpolator<JointState>::apply(a.elements[i], b.elements[i], ratio, result.elements[i]);
+        }
+    };
+
+    /** A bounded history of samples, sorted by time
+     *
+     * Samples and their times are stored in preallocated ring buffers, so
+     * that lookups are binary searches on a contiguous array of times and
+     * pushing never allocates. When the buffer is full, pushing a sample
+     * drops the oldest one.
+     *
+     * Samples can be pushed out of order, in which case they are inserted at
+     * their place. This is cheap if they are only slightly late.
+     *
+     * \code
+     * TimeIndexedBuffer<samples::RigidBodyState> poses(100);
+     * poses.push(rbs);
+     * samples::RigidBodyState pose;
+     * if (poses.interpolate(scan.time, pose))
+     *     ...
+     * \endcode
+     */
+    template<typename T>
+    class TimeIndexedBuffer
+    {
+    public:
+        /** @param capacity the maximum number of samples */
+        explicit TimeIndexedBuffer(size_t capacity)
+            : mSamples(std::max<size_t>(capacity, 1))
+            , mTimes(std::max<size_t>(capacity, 1))
+            , mBegin(0), mSize(0) {}
+
+        size_t size() const { return mSize; }
+        bool empty() const { return mSize == 0; }
+        size_t capacity() const { return mTimes.size(); }
+        bool full() const { return mSize == capacity(); }
+
+        /** Removes all samples */
+        void clear() { mBegin = 0; mSize = 0; }
+
+        /** Changes the capacity. The newest samples are kept */
+        void setCapacity(size_t capacity)
+        {
+            capacity = std::max<size_t>(capacity, 1);
+            std::vector<T> samples(capacity);
+            std::vector<Time> times(capacity);
+            size_t kept = std::min(capacity, mSize);
+            for (size_t i = 0; i < kept; ++i)
+            {
+                size_t from = physical(mSize - kept + i);
+                samples[i] = mSamples[from];
+                times[i] = mTimes[from];
+            }
+            mSamples.swap(samples);
+            mTimes.swap(times);
+            mBegin = 0;
+            mSize = kept;
+        }
+
+        /** Adds a sample, using its time field as key. See push(Time, T) */
+        bool push(T const& sample) { return push(sample.time, sample); }
+
+        /** Adds a sample with the given time
+         *
+         * Samples that have the same time than samples already in the buffer
+         * are inserted after them.
+         *
+         * @returns false if the buffer is full and the sample is older than
+         *   all the samples it contains. The sample is not added then.
+         */
+        bool push(Time const& time, T const& sample)
+        {
+            if (full())
+            {
+                if (time < mTimes[mBegin])
+                    return false;
+                mBegin = physical(1);
+                --mSize;
+            }
+
+            size_t index = mSize;
+            if (mSize && time < getTime(mSize - 1))
+            {
+                index = upperBound(time);
+                // Shift the newer samples by one
+                for (size_t i = mSize; i > index; --i)
+                {
+                    size_t to = physical(i), from = physical(i - 1);
+                    mSamples[to] = mSamples[from];
+                    mTimes[to] = mTimes[from];
+                }
+            }
+            size_t slot = physical(index);
+            mSamples[slot] = sample;
+            mTimes[slot] = time;
+            ++mSize;
+            return true;
+        }
+
+        /** Removes all samples older than \c time */
+        void removeBefore(Time const& time)
+        {
+            size_t count = lowerBound(time);
+            mBegin = physical(count);
+            mSize -= count;
+        }
+
+        /** Returns the i-th sample, the oldest being at index 0 */
+        T const& operator[](size_t index) const { return mSamples[physical(index)]; }
+
+        /** Returns the i-th sample
+         * \throws std::out_of_range if the index is out of bounds
+         */
+        T const& at(size_t index) const
+        {
+            if (index >= mSize)
+                throw std::out_of_range("TimeIndexedBuffer: index out of bounds");
+            return (*this)[index];
+        }
+
+        /** Returns the time of the i-th sample */
+        Time const& getTime(size_t index) const { return mTimes[physical(index)]; }
+
+        T const& front() const { return (*this)[0]; }
+        T const& back() const { return (*this)[mSize - 1]; }
+
+        /** Returns the index of the first sample whose time is not before \c
+         * time, or size() if there is none */
+        size_t lowerBound(Time const& time) const
+        {
+            size_t first = 0, count = mSize;
+            while (count > 0)
+            {
+                size_t step = count / 2;
+                if (getTime(first + step) < time)
+                {
+                    first += step + 1;
+                    count -= step + 1;
+                }
+                else
+                    count = step;
+            }
+            return first;
+        }
+
+        /** Returns the index of the first sample whose time is after \c time,
+         * or size() if there is none */
+        size_t upperBound(Time const& time) const
+        {
+            size_t first = 0, count = mSize;
+            while (count > 0)
+            {
+                size_t step = count / 2;
+                if (!(time < getTime(first + step)))
+                {
+                    first += step + 1;
+                    count -= step + 1;
+                }
+                else
+                    count = step;
+            }
+            return first;
+        }
+
+        /** Finds the samples around \c time
+         *
+         * If a sample has exactly the requested time, both indexes are set
+         * to it.
+         *
+         * @returns false if \c time is outside of the time range of the buffer
+         */
+        bool bracket(Time const& time, size_t& before, size_t& after) const
+        {
+            if (!mSize || time < getTime(0) || getTime(mSize - 1) < time)
+                return false;
+            after = lowerBound(time);
+            before = getTime(after) == time ? after : after - 1;
+            return true;
+        }
+
+        /** Returns the index of the sample closest to \c time, or size() if
+         * the buffer is empty */
+        size_t findClosest(Time const& time) const
+        {
+            size_t index = lowerBound(time);
+            if (index == mSize)
+                return mSize - 1 + (mSize == 0);
+            if (index > 0 && (time - getTime(index - 1)) < (getTime(index) - time))
+                return index - 1;
+            return index;
+        }
+
+        /** Computes the sample at \c time by interpolating between the two
+         * samples around it, using Interpolator<T>
+         *
+         * @param max_gap if non-null, the interpolation fails if the
+         *   surrounding samples are further apart than this
+         * @returns false if \c time is outside the time range of the buffer
+         *   or if the gap is too big. \c result is unchanged then.
+         */
+        bool interpolate(Time const& time, T& result, Time const& max_gap = Time()) const
+        {
+            size_t before, after;
+            if (!bracket(time, before, after))
+                return false;
+            if (before == after)
+            {
+                result = (*this)[before];
+                return true;
+            }
+
+            Time start = getTime(before);
+            Time span = getTime(after) - start;
+            if (!max_gap.isNull() && max_gap < span)
+                return false;
+            double ratio = static_cast<double>((time - start).toMicroseconds()) / span.toMicroseconds();
+            Interpolator<T>::apply((*this)[before], (*this)[after], ratio, result);
+            return true;
+        }
+
+    private:
+        size_t physical(size_t index) const
+        {
+            size_t result = mBegin + index;
+            return result >= mTimes.size() ? result - mTimes.size() : result;
+        }
+
+        std::vector<T> mSamples;
+        std::vector<Time> mTimes;
+        size_t mBegin;
+        size_t mSize;
+    };
+
+} // namespace base
+
+#endif
@@ -0,0 +1,320 @@
+/*
+ * @file Profiler.cpp
+ */
+
+#include "Profiler.hpp"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <iomanip>
+
+namespace base {
+namespace profiling {
+
+/** Ring buffer written by its thread and read by Profiler::collect.
+ * mHead is only written by the producer and mTail only by the consumer */
+class ThreadBuffer
+{
+public:
+    ThreadBuffer(size_t capacity)
+        : mEvents(capacity), mHead(0), mTail(0), mDropped(0)
+        , mThread(syscall(SYS_gettid)), mRetired(false) {}
+
+    void push(const char* label, int64_t start, int64_t end)
+    {
+        uint64_t head = mHead;
+        if (head - __atomic_load_n(&mTail, __ATOMIC_ACQUIRE) >= mEvents.size())
+        {
+            __atomic_add_fetch(&mDropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        Event& event = mEvents[head % mEvents.size()];
+        event.label = label;
+        event.start = start;
+        event.end = end;
+        __atomic_store_n(&mHead, head + 1, __ATOMIC_RELEASE);
+    }
+
+    /** Appends all buffered events to \c events. Must only be called by
+     * one thread at a time */
+    void drain(std::vector<Event>& events)
+    {
+        uint64_t tail = mTail;
+        uint64_t head = __atomic_load_n(&mHead, __ATOMIC_ACQUIRE);
+        for (; tail != head; ++tail)
+            events.push_back(mEvents[tail % mEvents.size()]);
+        __atomic_store_n(&mTail, tail, __ATOMIC_RELEASE);
+    }
+
+    int getThread() const { return mThread; }
+
+    uint64_t takeDropped()
+    {
+        return __atomic_exchange_n(&mDropped, 0, __ATOMIC_RELAXED);
+    }
+
+    /** Called by the producer once it does not push anymore */
+    void retire() { __atomic_store_n(&mRetired, true, __ATOMIC_RELEASE); }
+
+    /** True if the producer is gone. All its events are visible to a
+     * drain() that follows this call */
+    bool isRetired() const { return __atomic_load_n(&mRetired, __ATOMIC_ACQUIRE); }
+
+private:
+    std::vector<Event> mEvents;
+    uint64_t mHead;
+    uint64_t mTail;
+    uint64_t mDropped;
+    int mThread;
+    bool mRetired;
+};
+
+bool Profiler::sEnabled = getenv("BASE_PROFILE") != 0;
+base::Time::ClockSource Profiler::sClockSource = base::Time::MonotonicClock;
+
+static __thread ThreadBuffer* tThreadBuffer = 0;
+
+/** Marks the buffer of an exiting thread as retired, collect() frees it */
+static pthread_key_t gThreadBufferKey;
+static pthread_once_t gThreadBufferOnce = PTHREAD_ONCE_INIT;
+
+static void retireThreadBuffer(void* buffer)
+{
+    // A later destructor that records again registers a new buffer
+    tThreadBuffer = 0;
+    static_cast<ThreadBuffer*>(buffer)->retire();
+}
+
+static void createThreadBufferKey()
+{
+    pthread_key_create(&gThreadBufferKey, retireThreadBuffer);
+}
+
+Profiler::Profiler()
+    : mThreadBufferSize(16384), mMaxTraceEvents(1000000), mDropped(0)
+{
+    pthread_mutex_init(&mMutex, 0);
+}
+
+Profiler::~Profiler()
+{
+    // The buffers of live threads are intentionally leaked: they may still
+    // record events during static destruction. The buffers of exited threads
+    // are freed by collect()
+    pthread_mutex_destroy(&mMutex);
+}
+
+ThreadBuffer* Profiler::registerThread()
+{
+    Profiler* profiler = getInstance();
+    pthread_mutex_lock(&profiler->mMutex);
+    ThreadBuffer* buffer = new ThreadBuffer(profiler->mThreadBufferSize);
+    profiler->mThreads.push_back(buffer);
+    pthread_mutex_unlock(&profiler->mMutex);
+
+    pthread_once(&gThreadBufferOnce, createThreadBufferKey);
+    pthread_setspecific(gThreadBufferKey, buffer);
+    return buffer;
+}
+
+void Profiler::record(const char* label, int64_t start, int64_t end)
+{
+    if (!tThreadBuffer)
+        tThreadBuffer = registerThread();
+    tThreadBuffer->push(label, start, end);
+}
+
+void Profiler::setThreadBufferSize(size_t size)
+{
+    pthread_mutex_lock(&mMutex);
+    mThreadBufferSize = std::max<size_t>(size, 1);
+    pthread_mutex_unlock(&mMutex);
+}
+
+void Profiler::setMaxTraceEvents(size_t size)
+{
+    pthread_mutex_lock(&mMutex);
+    mMaxTraceEvents = size;
+    pthread_mutex_unlock(&mMutex);
+}
+
+void Profiler::collect()
+{
+    pthread_mutex_lock(&mMutex);
+    std::vector<Event> events;
+    // Cache of label pointer to histogram, labels are usually literals
+    std::map<const char*, Histogram*> histograms;
+    size_t live = 0;
+    for (size_t i = 0; i < mThreads.size(); ++i)
+    {
+        // Checked before draining so that the last events of an exited
+        // thread are not lost
+        bool retired = mThreads[i]->isRetired();
+        int thread = mThreads[i]->getThread();
+        events.clear();
+        mThreads[i]->drain(events);
+        mDropped += mThreads[i]->takeDropped();
+        if (retired)
+            delete mThreads[i];
+        else
+            mThreads[live++] = mThreads[i];
+
+        for (size_t e = 0; e < events.size(); ++e)
+        {
+            Event const& event = events[e];
+            Histogram*& histogram = histograms[event.label];
+            if (!histogram)
+                histogram = &mHistograms[event.label];
+            histogram->add(event.end - event.start);
+
+            if (mTrace.size() < mMaxTraceEvents)
+            {
+                TraceEvent trace = { event.label, thread, event.start, event.end };
+                mTrace.push_back(trace);
+            }
+        }
+    }
+    mThreads.resize(live);
+    pthread_mutex_unlock(&mMutex);
+}
+
+std::vector<Profiler::Statistics> Profiler::getStatistics() const
+{
+    std::vector<Statistics> result;
+    pthread_mutex_lock(&mMutex);
+    for (std::map<std::string, Histogram>::const_iterator it = mHistograms.begin();
+            it != mHistograms.end(); ++it)
+    {
+        Histogram const& histogram = it->second;
+        Statistics stats;
+        stats.label = it->first;
+        stats.count = histogram.count;
+        stats.total = histogram.total;
+        stats.min = histogram.min;
+        stats.max = histogram.max;
+        stats.p50 = histogram.percentile(0.5);
+        stats.p99 = histogram.percentile(0.99);
+        result.push_back(stats);
+    }
+    pthread_mutex_unlock(&mMutex);
+    return result;
+}
+
+size_t Profiler::getThreadCount() const
+{
+    pthread_mutex_lock(&mMutex);
+    size_t count = mThreads.size();
+    pthread_mutex_unlock(&mMutex);
+    return count;
+}
+
+uint64_t Profiler::getDroppedCount() const
+{
+    pthread_mutex_lock(&mMutex);
+    uint64_t dropped = mDropped;
+    pthread_mutex_unlock(&mMutex);
+    return dropped;
+}
+
+static void writeJSONString(std::ostream& stream, const char* str)
+{
+    stream << '"';
+    for (; *str; ++str)
+    {
+        if (*str == '"' || *str == '\\')
+            stream << '\\' << *str;
+        else if (static_cast<unsigned char>(*str) < 0x20)
+            stream << ' ';
+        else
+            stream << *str;
+    }
+    stream << '"';
+}
+
+void Profiler::writeChromeTrace(std::ostream& stream) const
+{
+    pthread_mutex_lock(&mMutex);
+    int pid = getpid();
+    stream << "{\"traceEvents\":[";
+    for (size_t i = 0; i < mTrace.size(); ++i)
+    {
+        TraceEvent const& event = mTrace[i];
+        if (i)
+            stream << ",";
+        stream << "\n{\"name\":";
+        writeJSONString(stream, event.label);
+        // Chrome expects microseconds, keep the nanosecond resolution
+        stream << ",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << event.thread
+            << ",\"ts\":" << event.start / 1000 << "." << std::setfill('0') << std::setw(3) << event.start % 1000
+            << ",\"dur\":" << (event.end - event.start) / 1000 << "." << std::setw(3) << (event.end - event.start) % 1000
+            << std::setfill(' ') << "}";
+    }
+    stream << "\n],\"displayTimeUnit\":\"ns\"}\n";
+    pthread_mutex_unlock(&mMutex);
+}
+
+void Profiler::clear()
+{
+    pthread_mutex_lock(&mMutex);
+    mHistograms.clear();
+    mTrace.clear();
+    mDropped = 0;
+    pthread_mutex_unlock(&mMutex);
+}
+
+Profiler::Histogram::Histogram()
+    : count(0), total(0), min(0), max(0), buckets(BUCKETS, 0) {}
+
+void Profiler::Histogram::add(int64_t duration)
+{
+    if (duration < 0)
+        duration = 0;
+    if (!count || duration < min)
+        min = duration;
+    if (!count || duration > max)
+        max = duration;
+    ++count;
+    total += duration;
+    ++buckets[bucketIndex(duration)];
+}
+
+int Profiler::Histogram::bucketIndex(int64_t duration)
+{
+    // Values below 8 get their own bucket, above that each power of two is
+    // split into 8 sub-buckets
+    if (duration < 8)
+        return duration;
+    int exponent = 63 - __builtin_clzll(duration);
+    int sub = (duration >> (exponent - 3)) & 7;
+    return 8 + (exponent - 3) * 8 + sub;
+}
+
+int64_t Profiler::Histogram::bucketValue(int index)
+{
+    if (index < 8)
+        return index;
+    int exponent = (index - 8) / 8 + 3;
+    int64_t sub = (index - 8) % 8;
+    // Middle of the bucket
+    return ((8 + sub) << (exponent - 3)) + ((int64_t(1) << (exponent - 3)) >> 1);
+}
+
+int64_t Profiler::Histogram::percentile(double ratio) const
+{
+    if (!count)
+        return 0;
+    uint64_t rank = static_cast<uint64_t>(ratio * (count - 1)) + 1;
+    uint64_t cumulated = 0;
+    for (int i = 0; i < BUCKETS; ++i)
+    {
+        cumulated += buckets[i];
+        if (cumulated >= rank)
+            return std::max(min, std::min(max, bucketValue(i)));
+    }
+    return max;
+}
+
+} // end namespace profiling
+} // end namespace base
@@ -0,0 +1,195 @@
+#ifndef _BASE_PROFILER_HPP_
+#define _BASE_PROFILER_HPP_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <ostream>
+#include <pthread.h>
+#include <base/Time.hpp>
+#include <base/Singleton.hpp>
+
+/*
+ * @file Profiler.hpp
+ *
+ * @brief Low-overhead instrumentation of code sections
+ * @details Mark a block with
+ *
+ *     BASE_PROFILE_ZONE("DepthMap::convert");
+ *
+ * to measure the time spent in it. Profiling is disabled by default; enable
+ * it with base::profiling::Profiler::setEnabled(true) or by setting the
+ * BASE_PROFILE environment variable. Each zone is then stored in a buffer
+ * owned by the calling thread, without any locking. Call
+ * Profiler::getInstance()->collect() from any thread to gather the events
+ * into per-label statistics and into a trace that can be written in the
+ * Chrome trace format (chrome://tracing).
+ *
+ * Defining BASE_PROFILE_DISABLE at compile time removes all zones.
+ */
+
+#define __BASE_PROFILE_CONCAT_(X, Y) X##Y
+#define __BASE_PROFILE_CONCAT(X, Y) __BASE_PROFILE_CONCAT_(X, Y)
+
+#ifdef BASE_PROFILE_DISABLE
+#define BASE_PROFILE_ZONE(LABEL)
+#else
+#define BASE_PROFILE_ZONE(LABEL) ::base::profiling::Zone __BASE_PROFILE_CONCAT(__base_profile_zone_, __LINE__)(LABEL)
+#endif
+
+namespace base {
+namespace profiling {
+
+/** A single measurement of a zone. Times are in nanoseconds of the
+ * profiler's clock */
+struct Event
+{
+    const char* label;
+    int64_t start;
+    int64_t end;
+};
+
+/** Per-thread single-producer single-consumer event buffer */
+class ThreadBuffer;
+
+/**
+ * @class Profiler
+ * @brief Collects the zones measured by all threads
+ */
+class Profiler : public Singleton<Profiler>
+{
+    friend class Singleton<Profiler>;
+
+protected:
+    Profiler();
+
+public:
+    /** Statistics of all events recorded with the same label. Durations are
+     * in nanoseconds; the percentiles are accurate to about 12% */
+    struct Statistics
+    {
+        std::string label;
+        uint64_t count;
+        int64_t total;
+        int64_t min;
+        int64_t max;
+        int64_t p50;
+        int64_t p99;
+    };
+
+    virtual ~Profiler();
+
+    /** Enables or disables the recording of zones at runtime */
+    static void setEnabled(bool enable) { __atomic_store_n(&sEnabled, enable, __ATOMIC_RELAXED); }
+    /** True if zones are recorded */
+    static bool isEnabled() { return __atomic_load_n(&sEnabled, __ATOMIC_RELAXED); }
+
+    /** Selects the clock used to time zones (MonotonicClock by default).
+     * TscClock is the cheapest one on x86 */
+    static void setClockSource(base::Time::ClockSource source) { __atomic_store_n(&sClockSource, source, __ATOMIC_RELAXED); }
+
+    /** Returns the current time of the profiler's clock, in nanoseconds */
+    static int64_t ticks() { return base::Time::nanoseconds(__atomic_load_n(&sClockSource, __ATOMIC_RELAXED)); }
+
+    /** Records an event in the calling thread's buffer. This does not lock.
+     * Events are dropped if the buffer is full, i.e. if collect() is not
+     * called often enough */
+    static void record(const char* label, int64_t start, int64_t end);
+
+    /** Sets the number of events each thread can buffer between two calls to
+     * collect(). Only affects threads that did not record anything yet */
+    void setThreadBufferSize(size_t size);
+
+    /** Sets the maximum number of events kept for writeChromeTrace. Events
+     * beyond that are only accounted in the statistics */
+    void setMaxTraceEvents(size_t size);
+
+    /** Moves the events buffered by all threads into the statistics and the
+     * trace */
+    void collect();
+
+    /** Returns the statistics of all labels, sorted by label */
+    std::vector<Statistics> getStatistics() const;
+
+    /** Returns the number of thread buffers. The buffers of exited threads
+     * are released by the next collect() */
+    size_t getThreadCount() const;
+
+    /** Returns the number of events that got dropped because a thread buffer
+     * was full */
+    uint64_t getDroppedCount() const;
+
+    /** Writes the collected trace in the Chrome trace event JSON format */
+    void writeChromeTrace(std::ostream& stream) const;
+
+    /** Removes all collected statistics and trace events */
+    void clear();
+
+private:
+    struct Histogram
+    {
+        static const int BUCKETS = 8 + 61 * 8;
+        uint64_t count;
+        int64_t total;
+        int64_t min;
+        int64_t max;
+        std::vector<uint64_t> buckets;
+
+        Histogram();
+        void add(int64_t duration);
+        int64_t percentile(double ratio) const;
+        static int bucketIndex(int64_t duration);
+        static int64_t bucketValue(int index);
+    };
+
+    struct TraceEvent
+    {
+        const char* label;
+        int thread;
+        int64_t start;
+        int64_t end;
+    };
+
+    static ThreadBuffer* registerThread();
+
+    /** Read by all zones and written at runtime, accessed atomically */
+    static bool sEnabled;
+    static base::Time::ClockSource sClockSource;
+
+    mutable pthread_mutex_t mMutex;
+    std::vector<ThreadBuffer*> mThreads;
+    size_t mThreadBufferSize;
+    size_t mMaxTraceEvents;
+    std::map<std::string, Histogram> mHistograms;
+    std::vector<TraceEvent> mTrace;
+    uint64_t mDropped;
+};
+
+/** RAII helper that records the time between its construction and its
+ * destruction. Use it through BASE_PROFILE_ZONE */
+class Zone
+{
+public:
+    /** @param label static string, it is not copied */
+    explicit Zone(const char* label)
+        : mLabel(Profiler::isEnabled() ? label : 0)
+        , mStart(mLabel ? Profiler::ticks() : 0) {}
+
+    ~Zone()
+    {
+        if (mLabel)
+            Profiler::record(mLabel, mStart, Profiler::ticks());
+    }
+
+private:
+    Zone(const Zone&);
+    Zone& operator =(const Zone&);
+
+    const char* mLabel;
+    int64_t mStart;
+};
+
+} // end namespace profiling
+} // end namespace base
+
+#endif // _BASE_PROFILER_HPP_
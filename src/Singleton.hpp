@@ -1,14 +1,32 @@
 #ifndef _BASE_SINGLETON_H_
 #define _BASE_SINGLETON_H_
 
+#include <pthread.h>
+
 namespace base {
 
+/**
+ * Base class of the lazily created, process-wide instances, e.g. the
+ * logging::Logger
+ *
+ * getInstance() is thread-safe. Once the instance exists, it only costs an
+ * acquire load. The first call creates the instance under a mutex, so that
+ * concurrent first calls construct it only once.
+ *
+ * The instances are destroyed at exit in the reverse order of the end of
+ * their construction: a singleton that uses another one in its constructor
+ * is destroyed before it. destroyInstance() destroys an instance earlier.
+ *
+ * Use BASE_SINGLETON_EAGER_INIT to create an instance at load time instead
+ * of on first use.
+ */
 template<class Derived>
 class Singleton
 {
 
 private:
 	static Derived* msInstance;
+	static pthread_mutex_t msMutex;
 
 protected:
 	Singleton() {}
@@ -16,14 +34,23 @@ protected:
 public:
 	static Derived* getInstance()
 	{
-		static CGuard g;
+		Derived* instance = __atomic_load_n(&msInstance, __ATOMIC_ACQUIRE);
+		if(instance)
+			return instance;
+		return createInstance();
+	}
 
-		if(msInstance == 0)
-		{
-			msInstance = new Derived(); 
-		}
-	
-		return msInstance;
+	/**
+	 * Destroys the instance, the next call to getInstance creates a new one.
+	 * Must not be called while other threads use the instance
+	 */
+	static void destroyInstance()
+	{
+		pthread_mutex_lock(&msMutex);
+		Derived* instance = msInstance;
+		__atomic_store_n(&msInstance, static_cast<Derived*>(0), __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&msMutex);
+		delete instance;
 	}
 
 	virtual ~Singleton()
@@ -34,25 +61,65 @@ public:
 	// Nested singleton helper class
 	class CGuard
 	{
-		public: 
+		public:
 			~CGuard()
 			{
-				if(msInstance != 0)
-				{
-					delete msInstance;
-					msInstance = 0;
-				}
+				destroyInstance();
 			}
 
 	};
 
 	friend class CGuard;
 
+private:
+	static Derived* createInstance()
+	{
+		pthread_mutex_lock(&msMutex);
+		Derived* instance = msInstance;
+		if(instance == 0)
+		{
+			try
+			{
+				instance = new Derived();
+			}
+			catch(...)
+			{
+				pthread_mutex_unlock(&msMutex);
+				throw;
+			}
+			__atomic_store_n(&msInstance, instance, __ATOMIC_RELEASE);
+
+			// Registered once the instance is constructed, so that it is
+			// destroyed before the singletons its constructor used
+			static CGuard g;
+		}
+		pthread_mutex_unlock(&msMutex);
+		return instance;
+	}
 };
 
 template<typename Derived> Derived* Singleton<Derived>::msInstance = 0;
+template<typename Derived> pthread_mutex_t Singleton<Derived>::msMutex = PTHREAD_MUTEX_INITIALIZER;
 
 } // end namespace base;
 
+#define BASE_SINGLETON_CONCAT_(A, B) A ## B
+#define BASE_SINGLETON_CONCAT(A, B) BASE_SINGLETON_CONCAT_(A, B)
+
+/**
+ * Creates the instance of the singleton at load time, e.g. in the
+ * translation unit that implements it:
+ *
+ *   BASE_SINGLETON_EAGER_INIT(MyRegistry)
+ *
+ * Types whose name contains a comma need a typedef
+ */
+#ifdef __GNUC__
+#define BASE_SINGLETON_EAGER_INIT(DERIVED) \
+	static DERIVED* const BASE_SINGLETON_CONCAT(base_singleton_eager_, __LINE__) __attribute__((unused)) = ::base::Singleton< DERIVED >::getInstance();
+#else
+#define BASE_SINGLETON_EAGER_INIT(DERIVED) \
+	static DERIVED* const BASE_SINGLETON_CONCAT(base_singleton_eager_, __LINE__) = ::base::Singleton< DERIVED >::getInstance();
+#endif
 
 #endif // _BASE_SINGLETON_H_
@@ -0,0 +1,74 @@
+/*
+ * @file log_decode.cpp
+ *
+ * @brief Renders a binary log stream (BASE_LOG_FORMAT=BINARY), or the ring
+ * file of a MappedRingLogSink, as text
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <string>
+#include "logging_binary.h"
+#include "logging_sinks.h"
+
+using namespace base::logging;
+
+static int usage()
+{
+    fprintf(stderr, "usage: base-log-decode [--format DEFAULT|MULTILINE|SHORT] [FILE]\n"
+            "  decodes a binary log written with BASE_LOG_FORMAT=BINARY, from stdin if FILE is not given\n"
+            "       base-log-decode --ring FILE\n"
+            "  prints the messages of a ring file written by MappedRingLogSink\n");
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    LogFormat format = DEFAULT;
+    const char* path = 0;
+    for(int i = 1; i < argc; ++i)
+    {
+        if(!strcmp(argv[i], "--ring") && argc == 3 && i == 1)
+        {
+            std::string text;
+            if(!MappedRingLogSink::read(argv[2], text))
+            {
+                fprintf(stderr, "base-log-decode: cannot read %s, or not a ring file\n", argv[2]);
+                return 1;
+            }
+            fwrite(text.data(), text.size(), 1, stdout);
+            return 0;
+        }
+        else if(!strcmp(argv[i], "--format") && i + 1 < argc)
+        {
+            ++i;
+            if(!strcasecmp(argv[i], "DEFAULT"))
+                format = DEFAULT;
+            else if(!strcasecmp(argv[i], "MULTILINE"))
+                format = MULTILINE;
+            else if(!strcasecmp(argv[i], "SHORT"))
+                format = SHORT;
+            else
+                return usage();
+        }
+        else if(argv[i][0] == '-' || path)
+            return usage();
+        else
+            path = argv[i];
+    }
+
+    FILE* in = stdin;
+    if(path && !(in = fopen(path, "rb")))
+    {
+        perror(path);
+        return 1;
+    }
+
+    bool success = decodeBinaryLog(in, stdout, format);
+    if(!success)
+        fprintf(stderr, "base-log-decode: not a binary log, or corrupted stream\n");
+    if(in != stdin)
+        fclose(in);
+    return success ? 0 : 1;
+}
@@ -0,0 +1,486 @@
+/*
+ * @file logging_binary.cpp
+ *
+ */
+
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "logging_binary.h"
+
+// va_copy is only declared by C99 and C++11
+#ifndef va_copy
+#define va_copy(dest, src) __va_copy(dest, src)
+#endif
+
+namespace base {
+namespace logging {
+
+namespace {
+
+enum Length { LENGTH_INT, LENGTH_LONG, LENGTH_LONG_LONG, LENGTH_SIZE, LENGTH_INTMAX, LENGTH_PTRDIFF, LENGTH_LONG_DOUBLE };
+
+/** A conversion specification of a printf format string */
+struct Conversion
+{
+    /** The '%' */
+    const char* begin;
+    /** Just after the conversion character */
+    const char* end;
+    /** Number of '*' width and precision, each takes an int argument */
+    int stars;
+    /** Precision given as digits, -1 if there is none or it is a '*' */
+    int precision;
+    /** True if the precision is the last '*' argument */
+    bool precisionStar;
+    Length length;
+    char type;
+};
+
+/** Finds the first conversion of \c format, skipping "%%"
+ * @returns false if there is none */
+bool nextConversion(const char* format, Conversion& conversion)
+{
+    for (const char* p = format; *p; ++p)
+    {
+        if (*p != '%')
+            continue;
+        if (p[1] == '%')
+        {
+            ++p;
+            continue;
+        }
+
+        conversion.begin = p;
+        conversion.stars = 0;
+        conversion.precision = -1;
+        conversion.precisionStar = false;
+        conversion.length = LENGTH_INT;
+        const char* it = p + 1;
+        while (*it && strchr("-+ #0'", *it))
+            ++it;
+        if (*it == '*')
+        {
+            ++conversion.stars;
+            ++it;
+        }
+        else while (isdigit(*it))
+            ++it;
+        if (*it == '.')
+        {
+            ++it;
+            if (*it == '*')
+            {
+                ++conversion.stars;
+                conversion.precisionStar = true;
+                ++it;
+            }
+            else
+            {
+                conversion.precision = 0;
+                for (; isdigit(*it); ++it)
+                    conversion.precision = std::min(conversion.precision * 10 + (*it - '0'), 1 << 24);
+            }
+        }
+
+        switch (*it)
+        {
+            case 'h':
+                // Promoted to int
+                ++it;
+                if (*it == 'h')
+                    ++it;
+                break;
+            case 'l':
+                ++it;
+                if (*it == 'l')
+                {
+                    ++it;
+                    conversion.length = LENGTH_LONG_LONG;
+                }
+                else
+                    conversion.length = LENGTH_LONG;
+                break;
+            case 'q': ++it; conversion.length = LENGTH_LONG_LONG; break;
+            case 'L': ++it; conversion.length = LENGTH_LONG_DOUBLE; break;
+            case 'z':
+            case 'Z': ++it; conversion.length = LENGTH_SIZE; break;
+            case 'j': ++it; conversion.length = LENGTH_INTMAX; break;
+            case 't': ++it; conversion.length = LENGTH_PTRDIFF; break;
+        }
+
+        if (!*it)
+            return false;
+        conversion.type = *it;
+        conversion.end = it + 1;
+        return true;
+    }
+    return false;
+}
+
+bool isInteger(char type) { return strchr("diouxXc", type) != 0; }
+/** %lc and %ls take wide characters, which are not supported */
+bool isWide(Conversion const& conversion)
+{
+    return conversion.length == LENGTH_LONG && (conversion.type == 'c' || conversion.type == 's');
+}
+bool isFloat(char type) { return strchr("fFeEgGaA", type) != 0; }
+
+/** Appends raw bytes to a fixed-size buffer */
+class Writer
+{
+public:
+    Writer(char* buffer, size_t size) : mBuffer(buffer), mIt(buffer), mEnd(buffer + size) {}
+
+    bool put(const void* data, size_t size)
+    {
+        if (static_cast<size_t>(mEnd - mIt) < size)
+            return false;
+        memcpy(mIt, data, size);
+        mIt += size;
+        return true;
+    }
+
+    size_t available() const { return mEnd - mIt; }
+    size_t size() const { return mIt - mBuffer; }
+
+private:
+    char* mBuffer;
+    char* mIt;
+    char* mEnd;
+};
+
+/** Reads raw bytes from a buffer */
+class Reader
+{
+public:
+    Reader(const char* buffer, size_t size) : mIt(buffer), mEnd(buffer + size) {}
+
+    template<typename T>
+    bool get(T& value)
+    {
+        if (static_cast<size_t>(mEnd - mIt) < sizeof(T))
+            return false;
+        memcpy(&value, mIt, sizeof(T));
+        mIt += sizeof(T);
+        return true;
+    }
+
+    bool get(std::string& value)
+    {
+        uint32_t length;
+        if (!get(length) || static_cast<size_t>(mEnd - mIt) < length)
+            return false;
+        value.assign(mIt, length);
+        mIt += length;
+        return true;
+    }
+
+private:
+    const char* mIt;
+    const char* mEnd;
+};
+
+int64_t readInteger(va_list& arguments, Length length)
+{
+    switch (length)
+    {
+        case LENGTH_LONG: return va_arg(arguments, long);
+        case LENGTH_LONG_LONG: return va_arg(arguments, long long);
+        case LENGTH_SIZE: return va_arg(arguments, ssize_t);
+        case LENGTH_INTMAX: return va_arg(arguments, intmax_t);
+        case LENGTH_PTRDIFF: return va_arg(arguments, ptrdiff_t);
+        default: return va_arg(arguments, int);
+    }
+}
+
+/** Appends printf output to a fixed-size buffer, truncating it */
+class Output
+{
+public:
+    Output(char* buffer, size_t size) : mBuffer(buffer), mSize(size), mLength(0)
+    {
+        if (mSize)
+            mBuffer[0] = 0;
+    }
+
+    void printf(const char* format, ...)
+    {
+        if (mLength + 1 >= mSize)
+            return;
+        va_list arguments;
+        va_start(arguments, format);
+        int written = vsnprintf(mBuffer + mLength, mSize - mLength, format, arguments);
+        va_end(arguments);
+        if (written > 0)
+            mLength = std::min(mLength + written, mSize - 1);
+    }
+
+    /** Appends a part of a format string that has no conversions. The
+     * text is copied as-is, except that "%%" becomes "%". It is not given to
+     * vsnprintf, which would break on an incomplete conversion such as a
+     * trailing '%' */
+    void literal(const char* begin, const char* end)
+    {
+        for (const char* it = begin; it != end && mLength + 1 < mSize; ++it)
+        {
+            mBuffer[mLength++] = *it;
+            if (*it == '%' && it + 1 != end && it[1] == '%')
+                ++it;
+        }
+        if (mSize)
+            mBuffer[mLength] = 0;
+    }
+
+    template<typename T>
+    void conversion(const char* spec, int stars, const int* star, T value)
+    {
+        switch (stars)
+        {
+            case 0: printf(spec, value); break;
+            case 1: printf(spec, star[0], value); break;
+            default: printf(spec, star[0], star[1], value); break;
+        }
+    }
+
+    size_t length() const { return mLength; }
+
+private:
+    char* mBuffer;
+    size_t mSize;
+    size_t mLength;
+};
+
+void formatInteger(Output& output, const char* spec, int stars, const int* star, Length length, int64_t value)
+{
+    switch (length)
+    {
+        case LENGTH_LONG: output.conversion(spec, stars, star, static_cast<long>(value)); break;
+        case LENGTH_LONG_LONG: output.conversion(spec, stars, star, static_cast<long long>(value)); break;
+        case LENGTH_SIZE: output.conversion(spec, stars, star, static_cast<ssize_t>(value)); break;
+        case LENGTH_INTMAX: output.conversion(spec, stars, star, static_cast<intmax_t>(value)); break;
+        case LENGTH_PTRDIFF: output.conversion(spec, stars, star, static_cast<ptrdiff_t>(value)); break;
+        default: output.conversion(spec, stars, star, static_cast<int>(value)); break;
+    }
+}
+
+} // end anonymous namespace
+
+size_t encodeBinaryArguments(char* buffer, size_t size, const char* format, va_list arguments)
+{
+    va_list args;
+    va_copy(args, arguments);
+
+    Writer writer(buffer, size);
+    Conversion conversion;
+    bool full = false;
+    for (const char* p = format; !full && nextConversion(p, conversion); p = conversion.end)
+    {
+        if (isWide(conversion))
+        {
+            // Like an unknown conversion, rendered as "<?>"
+            break;
+        }
+
+        int precision = conversion.precision;
+        for (int i = 0; i < conversion.stars && !full; ++i)
+        {
+            int64_t value = va_arg(args, int);
+            full = !writer.put(&value, sizeof(value));
+            if (conversion.precisionStar && i == conversion.stars - 1)
+                precision = value < 0 ? -1 : value;
+        }
+        if (full)
+            break;
+
+        if (isInteger(conversion.type))
+        {
+            int64_t value = readInteger(args, conversion.length);
+            full = !writer.put(&value, sizeof(value));
+        }
+        else if (isFloat(conversion.type))
+        {
+            double value = conversion.length == LENGTH_LONG_DOUBLE ?
+                static_cast<double>(va_arg(args, long double)) : va_arg(args, double);
+            full = !writer.put(&value, sizeof(value));
+        }
+        else if (conversion.type == 's')
+        {
+            const char* value = va_arg(args, const char*);
+            if (!value)
+                value = "(null)";
+            if (writer.available() < sizeof(uint32_t))
+                break;
+            // With a precision, the string does not need to be terminated
+            size_t available = writer.available() - sizeof(uint32_t);
+            uint32_t length = precision < 0 ? std::min(strlen(value), available) :
+                strnlen(value, std::min<size_t>(precision, available));
+            writer.put(&length, sizeof(length));
+            writer.put(value, length);
+        }
+        else if (conversion.type == 'p')
+        {
+            uint64_t value = reinterpret_cast<uintptr_t>(va_arg(args, void*));
+            full = !writer.put(&value, sizeof(value));
+        }
+        else if (conversion.type == 'n')
+            va_arg(args, void*);
+        else
+        {
+            // Unknown conversion, the following arguments cannot be found
+            break;
+        }
+    }
+
+    va_end(args);
+    return writer.size();
+}
+
+size_t formatBinaryArguments(char* buffer, size_t size, const char* format, const char* arguments, size_t argumentsSize)
+{
+    Output output(buffer, size);
+    Reader reader(arguments, argumentsSize);
+    Conversion conversion;
+    const char* p = format;
+    for (; nextConversion(p, conversion); p = conversion.end)
+    {
+        output.literal(p, conversion.begin);
+        std::string spec(conversion.begin, conversion.end);
+
+        int star[2];
+        bool valid = true;
+        for (int i = 0; i < conversion.stars && valid; ++i)
+        {
+            int64_t value = 0;
+            valid = reader.get(value);
+            star[i] = value;
+        }
+
+        if (isWide(conversion))
+            valid = false;
+        else if (valid && isInteger(conversion.type))
+        {
+            int64_t value;
+            if ((valid = reader.get(value)))
+                formatInteger(output, spec.c_str(), conversion.stars, star, conversion.length, value);
+        }
+        else if (valid && isFloat(conversion.type))
+        {
+            double value;
+            if ((valid = reader.get(value)))
+            {
+                if (conversion.length == LENGTH_LONG_DOUBLE)
+                    output.conversion(spec.c_str(), conversion.stars, star, static_cast<long double>(value));
+                else
+                    output.conversion(spec.c_str(), conversion.stars, star, value);
+            }
+        }
+        else if (valid && conversion.type == 's')
+        {
+            std::string value;
+            if ((valid = reader.get(value)))
+                output.conversion(spec.c_str(), conversion.stars, star, value.c_str());
+        }
+        else if (valid && conversion.type == 'p')
+        {
+            uint64_t value;
+            if ((valid = reader.get(value)))
+                output.conversion(spec.c_str(), conversion.stars, star, reinterpret_cast<void*>(static_cast<uintptr_t>(value)));
+        }
+        else if (conversion.type != 'n')
+            valid = false;
+
+        if (!valid)
+        {
+            // The argument got truncated at logging time, or its
+            // conversion is not supported
+            output.printf("%s", "<?>");
+        }
+    }
+    output.literal(p, p + strlen(p));
+    return output.length();
+}
+
+bool decodeBinaryLog(FILE* in, FILE* out, LogFormat format)
+{
+    char magic[sizeof(BINARY_LOG_MAGIC)];
+    if (fread(magic, sizeof(magic), 1, in) != 1 || memcmp(magic, BINARY_LOG_MAGIC, sizeof(magic)))
+        return false;
+
+    static const char* priorityNames[] = { "UNKNOWN", "FATAL", "ERROR", "WARN", "INFO", "DEBUG" };
+    std::map<uint64_t, std::string> strings;
+    std::vector<char> arguments;
+    std::vector<char> message(16384);
+
+    uint8_t type;
+    while (fread(&type, 1, 1, in) == 1)
+    {
+        if (type == STRING_RECORD)
+        {
+            uint64_t id;
+            uint32_t length;
+            if (fread(&id, sizeof(id), 1, in) != 1 || fread(&length, sizeof(length), 1, in) != 1)
+                return false;
+            std::string& value = strings[id];
+            value.resize(length);
+            if (length && fread(&value[0], length, 1, in) != 1)
+                return false;
+        }
+        else if (type == MESSAGE_RECORD)
+        {
+            uint8_t priority;
+            int32_t line;
+            int64_t time;
+            uint64_t ids[4];
+            uint32_t size;
+            if (fread(&priority, sizeof(priority), 1, in) != 1 ||
+                    fread(&line, sizeof(line), 1, in) != 1 ||
+                    fread(&time, sizeof(time), 1, in) != 1 ||
+                    fread(ids, sizeof(ids), 1, in) != 1 ||
+                    fread(&size, sizeof(size), 1, in) != 1)
+                return false;
+            arguments.resize(size);
+            if (size && fread(&arguments[0], size, 1, in) != 1)
+                return false;
+
+            std::string const& formatString = strings[ids[0]];
+            std::string const& function = strings[ids[1]];
+            std::string const& file = strings[ids[2]];
+            std::string const& name_space = strings[ids[3]];
+            formatBinaryArguments(&message[0], message.size(), formatString.c_str(), size ? &arguments[0] : 0, size);
+            const char* priorityName = priority < sizeof(priorityNames) / sizeof(priorityNames[0]) ? priorityNames[priority] : "UNKNOWN";
+
+            time_t seconds = time / 1000000;
+            struct tm current;
+            localtime_r(&seconds, &current);
+            char currentTime[25];
+            strftime(currentTime, 25, "%Y%m%d-%H:%M:%S", &current);
+            int milliSecs = (time % 1000000) / 1000;
+
+            switch (format)
+            {
+                case MULTILINE:
+                    fprintf(out, "[%s:%03d] in %s\n\t%s:%d\n\t[%5s] - %s::%s \n", currentTime, milliSecs, function.c_str(), file.c_str(), line, priorityName, name_space.c_str(), &message[0]);
+                    break;
+                case SHORT:
+                    fprintf(out, "[%5s] - %s::%s\n", priorityName, name_space.c_str(), &message[0]);
+                    break;
+                default:
+                    fprintf(out, "[%s:%03d] [%5s] - %s::%s (%s:%d - %s)\n", currentTime, milliSecs, priorityName, name_space.c_str(), &message[0], file.c_str(), line, function.c_str());
+                    break;
+            }
+        }
+        else
+            return false;
+    }
+    return feof(in);
+}
+
+} // end namespace logging
+} // end namespace base
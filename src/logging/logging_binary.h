@@ -0,0 +1,69 @@
+/*
+ * @file logging_binary.h
+ *
+ * @brief Binary log records
+ * @details With BASE_LOG_FORMAT=BINARY (or the BINARY log format), the
+ * logger does not format the messages. It writes the format string, the
+ * location and the raw arguments of each message as a binary record, and
+ * writes the static strings (format, function, file and namespace) only
+ * once. Use the base-log-decode tool, or decodeBinaryLog, to render such a
+ * stream in one of the text formats.
+ *
+ * The stream starts with the 8 bytes BINARY_LOG_MAGIC, followed by records
+ * in the native byte order:
+ *
+ *   STRING_RECORD:  uint8 type, uint64 id, uint32 length, char[length]
+ *   MESSAGE_RECORD: uint8 type, uint8 priority, int32 line, int64 time in
+ *                   microseconds, uint64 format, function, file and namespace
+ *                   ids, uint32 size, char[size] arguments
+ *
+ * Strings are identified by their address. The function, file and namespace
+ * strings that are not literals, e.g. those given to Logger::log, use the ids
+ * 1, 2 and 3 instead, and are written again whenever they change.
+ *
+ * Integer arguments are stored as int64, floating-point arguments as double,
+ * pointers as uint64 and strings as uint32 length followed by the characters.
+ */
+
+#ifndef _BASE_LOGGING_BINARY_H_
+#define _BASE_LOGGING_BINARY_H_
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <base/logging/logging_printf_style.h>
+
+namespace base {
+
+namespace logging {
+
+static const char BINARY_LOG_MAGIC[8] = { 'B', 'A', 'S', 'E', 'L', 'O', 'G', '1' };
+
+enum BinaryRecordType { STRING_RECORD = 1, MESSAGE_RECORD = 2 };
+
+/**
+ * Encodes the arguments of a printf-style call, as described by the format
+ * string, into \c buffer. Arguments that do not fit are left out, and
+ * strings are truncated.
+ * @returns the number of bytes written
+ */
+size_t encodeBinaryArguments(char* buffer, size_t size, const char* format, va_list arguments);
+
+/**
+ * Renders the arguments encoded by encodeBinaryArguments into \c buffer,
+ * like vsnprintf would have done
+ * @returns the length of the rendered message, truncated to size - 1
+ */
+size_t formatBinaryArguments(char* buffer, size_t size, const char* format, const char* arguments, size_t argumentsSize);
+
+/**
+ * Decodes a binary log stream and writes it in the given text format
+ * @returns false if the stream is not a binary log or is corrupted. The
+ * messages decoded until then are written
+ */
+bool decodeBinaryLog(FILE* in, FILE* out, LogFormat format);
+
+} // end namespace logging
+} // end namespace base
+
+#endif /* _BASE_LOGGING_BINARY_H_ */
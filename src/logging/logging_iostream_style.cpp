@@ -0,0 +1,201 @@
+/*
+ * @file logging_iostream_style.cpp
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <locale.h>
+#include <pthread.h>
+#include "logging_iostream_style.h"
+#include <base/Time.hpp>
+#include <base/Angle.hpp>
+
+namespace base {
+namespace logging {
+
+LogStreamBuffer::LogStreamBuffer()
+{
+    // Keep one character for the terminating null
+    setp(mFixed, mFixed + FIXED_SIZE - 1);
+}
+
+void LogStreamBuffer::reset()
+{
+    if(mOverflow.size() > MAX_KEPT_SIZE)
+        std::vector<char>().swap(mOverflow);
+
+    if(mOverflow.empty())
+        setp(mFixed, mFixed + FIXED_SIZE - 1);
+    else
+        setp(&mOverflow[0], &mOverflow[0] + mOverflow.size() - 1);
+}
+
+void LogStreamBuffer::setBuffer(char* buffer, size_t size, size_t used)
+{
+    setp(buffer, buffer + size - 1);
+    // pbump only takes an int
+    while(used > 0)
+    {
+        int step = used > 0x40000000 ? 0x40000000 : static_cast<int>(used);
+        pbump(step);
+        used -= step;
+    }
+}
+
+void LogStreamBuffer::writeSlow(const char* data, size_t size)
+{
+    size_t used = pptr() - pbase();
+    size_t required = used + size + 1;
+    if(mOverflow.size() < required)
+    {
+        std::vector<char> buffer(std::max(required, std::max(2 * mOverflow.size(), 2 * FIXED_SIZE)));
+        memcpy(&buffer[0], pbase(), used);
+        mOverflow.swap(buffer);
+        setBuffer(&mOverflow[0], mOverflow.size(), used);
+    }
+    memcpy(pptr(), data, size);
+    setBuffer(&mOverflow[0], mOverflow.size(), used + size);
+}
+
+LogStreamBuffer::int_type LogStreamBuffer::overflow(int_type c)
+{
+    if(traits_type::eq_int_type(c, traits_type::eof()))
+        return traits_type::not_eof(c);
+    char value = traits_type::to_char_type(c);
+    writeSlow(&value, 1);
+    return c;
+}
+
+std::streamsize LogStreamBuffer::xsputn(const char* data, std::streamsize size)
+{
+    write(data, size);
+    return size;
+}
+
+LogStream::State::State()
+    : stream(&buffer), busy(false)
+{
+}
+
+static __thread LogStream::State* tLogStreamState = 0;
+static pthread_key_t gLogStreamStateKey;
+static pthread_once_t gLogStreamStateOnce = PTHREAD_ONCE_INIT;
+
+static void deleteLogStreamState(void* state)
+{
+    // A stream log statement in a later destructor of this thread creates
+    // a new state
+    tLogStreamState = 0;
+    delete static_cast<LogStream::State*>(state);
+}
+
+static void createLogStreamStateKey()
+{
+    pthread_key_create(&gLogStreamStateKey, deleteLogStreamState);
+}
+
+LogStream::LogStream()
+{
+    if(!tLogStreamState)
+    {
+        tLogStreamState = new State;
+        // Only used to delete the state when the thread exits
+        pthread_once(&gLogStreamStateOnce, createLogStreamStateKey);
+        pthread_setspecific(gLogStreamStateKey, tLogStreamState);
+    }
+
+    if(tLogStreamState->busy)
+    {
+        // A stream log statement within another one, e.g. in an operator<<
+        mState = new State;
+    }
+    else
+    {
+        mState = tLogStreamState;
+        mState->buffer.reset();
+        std::ostream& os = mState->stream;
+        os.clear();
+        os.flags(std::ios_base::dec | std::ios_base::skipws);
+        os.precision(6);
+        os.width(0);
+        os.fill(' ');
+    }
+    mState->busy = true;
+}
+
+LogStream::~LogStream()
+{
+    // forward it to class Logger
+    Logger::getInstance()->logLiteralBuffer(mPrio,mpFuncName,mpFileName,mLineNumber,mNamespace,mState->buffer.c_str());
+
+    if(mState == tLogStreamState)
+        mState->busy = false;
+    else
+        delete mState;
+}
+
+bool LogStream::isDefaultFloat()
+{
+    // snprintf uses the decimal point of LC_NUMERIC, which programs calling
+    // setlocale may change, while the stream keeps the classic locale
+    const char* point = localeconv()->decimal_point;
+    return isDefault() && mState->stream.precision() == 6
+        && point[0] == '.' && point[1] == 0;
+}
+
+LogStream& LogStream::writeFloat(double value)
+{
+    if(!isDefaultFloat())
+    {
+        stream() << value;
+        return *this;
+    }
+
+    // Same output as std::ostream with the default flags
+    char buffer[32];
+    int size = snprintf(buffer, sizeof(buffer), "%g", value);
+    mState->buffer.write(buffer, size);
+    return *this;
+}
+
+LogStream& LogStream::operator<<(const base::Time& value)
+{
+    if(!isDefault())
+    {
+        base::operator<<(stream(), value);
+        return *this;
+    }
+
+    // Same layout as base::operator<<(std::ostream&, Time const&)
+    int64_t microseconds = value.toMicroseconds();
+    int64_t remainder = llabs(microseconds) % 1000000;
+    writeInteger<unsigned long long>(static_cast<long long>(microseconds / 1000000));
+    char buffer[8] = { '.', 0, 0, 0, '.', 0, 0, 0 };
+    buffer[1] = '0' + remainder / 100000;
+    buffer[2] = '0' + remainder / 10000 % 10;
+    buffer[3] = '0' + remainder / 1000 % 10;
+    buffer[5] = '0' + remainder / 100 % 10;
+    buffer[6] = '0' + remainder / 10 % 10;
+    buffer[7] = '0' + remainder % 10;
+    mState->buffer.write(buffer, sizeof(buffer));
+    return *this;
+}
+
+LogStream& LogStream::operator<<(const base::Angle& value)
+{
+    if(!isDefaultFloat())
+    {
+        base::operator<<(stream(), value);
+        return *this;
+    }
+
+    // Same layout as base::operator<<(std::ostream&, Angle)
+    char buffer[64];
+    int size = snprintf(buffer, sizeof(buffer), "%g[%3.1fdeg]", value.getRad(), value.getDeg());
+    mState->buffer.write(buffer, std::min<size_t>(size, sizeof(buffer) - 1));
+    return *this;
+}
+
+} // end namespace logging
+} // end namespace base
@@ -1,95 +1,279 @@
-/*
- * @file logging_iostream_style.h
- * @author Jan Vogelgesang, jan.vogelgesang@dfki.de
- *
- * @brief Wrapper for logging.h, adds iostream-style logging
- *
- * @details adds an iostream-style interface to logging.h, appends trailing '_S' for the
- *          iostream interafce. Example:
- *
- *          LOG_WARN_S << "some warning message";
- *
- *          no trailing endl is required (similar to logging_printf_style.h).
- *          Configuration is done through LOG_CONFIGURE from logging_printf_style.h.
- *
- *          based on an idea from Petru Marginean, presented at http://drdobbs.com/cpp/201804215
- */
-
-#ifndef _BASE_LOGGING_IOSTREAM_STYLE_H_
-#define _BASE_LOGGING_IOSTREAM_STYLE_H_
-
-#include <base/logging/logging_printf_style.h>
-#include <sstream>
-
-#if !defined(Release) && !defined(NDEBUG)
-// To allow for the streaming syntax, relying on 'dead code elimination'
-// of the compiler, i.e. given the if prio > BASE_LOG_PRIORITY then the else branch
-// is never reachable. Compilers with 'dead code elimination'
-// will remove the else branch completely (tested on gcc 4.4 with -o0).
-// Using __PRETTY_FUNCTION__ when using gcc otherwise __func__ to show current function
-#ifdef __GNUC__
-#define LOG_STREAM(PRIO) if(PRIO > BASE_LOG_PRIORITY) ; else base::logging::LogStream().get(PRIO,__PRETTY_FUNCTION__, __FILE__, __LINE__, __STRINGIFY(BASE_LOG_NAMESPACE))
-#else
-#define LOG_STREAM(PRIO) if(PRIO > BASE_LOG_PRIORITY) ; else base::logging::LogStream().get(PRIO,__func__, __FILE__, __LINE__,  __STRINGIFY(BASE_LOG_NAMESPACE))
-#endif
-
-#else
-//disable all logging if Release is defined
-#define LOG_STREAM(PRIO) if(true) ; else base::logging::LogStream().get(PRIO,"", "" , 0 , "")
-#endif // Release
-
-// MACROS for general usage of streaming logging
-// Example usage:
-// LOG_WARN_S << "this is a message on level warn";
-//
-// NOTE:'std::endl' is inserted automatically at the end of the statement 
-//
-#define LOG_FATAL_S LOG_STREAM(base::logging::FATAL)
-#define LOG_ERROR_S  LOG_STREAM(base::logging::ERROR)
-#define LOG_WARN_S  LOG_STREAM(base::logging::WARN)
-#define LOG_INFO_S  LOG_STREAM(base::logging::INFO)
-#define LOG_DEBUG_S  LOG_STREAM(base::logging::DEBUG)
-
-namespace base {
-
-namespace logging {
-
-class LogStream
-{
-public:
-	LogStream() {};
-	virtual ~LogStream()
-	{
-	    // forward it to class Logger
-	    Logger::getInstance()->logBuffer(mPrio,mpFuncName,mpFileName,mLineNumber,mNamespace,os.str().c_str());
-	}
-
-
-	std::ostringstream& get(Priority prio,const char* pFuncName, const char* pFileName, int lineNumber, const char* name_space)
-	{
-	    mPrio = prio;
-	    mpFuncName = pFuncName;
-	    mpFileName = pFileName;
-	    mLineNumber = lineNumber;
-	    mNamespace = name_space;
-	   return os;
-	}
-
-protected:
-   std::ostringstream os;
-private:
-   LogStream(const LogStream&);
-   LogStream& operator =(const LogStream&);
-private:
-   Priority mPrio;
-   const char* mpFuncName;
-   const char* mpFileName;
-   int mLineNumber;
-   const char* mNamespace;
-};
-
-
-} //namespace logging
-} //namespace base
-
-#endif // _BASE_LOGGING_IOSTREAM_STYLE_H_
+/*
+ * @file logging_iostream_style.h
+ * @author Jan Vogelgesang, jan.vogelgesang@dfki.de
+ *
+ * @brief Wrapper for logging.h, adds iostream-style logging
+ *
+ * @details adds an iostream-style interface to logging.h, appends trailing '_S' for the
+ *          iostream interafce. Example:
+ *
+ *          LOG_WARN_S << "some warning message";
+ *
+ *          no trailing endl is required (similar to logging_printf_style.h).
+ *          Configuration is done through LOG_CONFIGURE from logging_printf_style.h.
+ *
+ *          based on an idea from Petru Marginean, presented at http://drdobbs.com/cpp/201804215
+ */
+
+#ifndef _BASE_LOGGING_IOSTREAM_STYLE_H_
+#define _BASE_LOGGING_IOSTREAM_STYLE_H_
+
+#include <base/logging/logging_printf_style.h>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <string.h>
+
+#if !defined(Release) && !defined(NDEBUG)
+// To allow for the streaming syntax, relying on 'dead code elimination'
+// of the compiler, i.e. given the if prio > BASE_LOG_PRIORITY then the else branch
+// is never reachable. Compilers with 'dead code elimination'
+// will remove the else branch completely (tested on gcc 4.4 with -o0).
+// Using __PRETTY_FUNCTION__ when using gcc otherwise __func__ to show current function
+//
+// With gcc, the runtime level is checked through a per-call-site LogSite
+// (see logging_printf_style.h) defined in a statement expression. Other
+// compilers look the level of the namespace up for each statement.
+#ifdef __GNUC__
+#define LOG_STREAM(PRIO) if(PRIO > BASE_LOG_PRIORITY || !__extension__ ({ __LOG_SITE(base_log_site_); base_log_site_.enabled(PRIO) && base_log_site_.admit(PRIO); })) ; else base::logging::LogStream().get(PRIO,__PRETTY_FUNCTION__, __FILE__, __LINE__, __STRINGIFY(BASE_LOG_NAMESPACE))
+#else
+#define LOG_STREAM(PRIO) if(PRIO > BASE_LOG_PRIORITY || PRIO > base::logging::Logger::getInstance()->getLogLevel(__STRINGIFY(BASE_LOG_NAMESPACE))) ; else base::logging::LogStream().get(PRIO,__func__, __FILE__, __LINE__,  __STRINGIFY(BASE_LOG_NAMESPACE))
+#endif
+
+#else
+//disable all logging if Release is defined
+#define LOG_STREAM(PRIO) if(true) ; else base::logging::LogStream().get(PRIO,"", "" , 0 , "")
+#endif // Release
+
+// MACROS for general usage of streaming logging
+// Example usage:
+// LOG_WARN_S << "this is a message on level warn";
+//
+// NOTE:'std::endl' is inserted automatically at the end of the statement 
+//
+#define LOG_FATAL_S LOG_STREAM(base::logging::FATAL)
+#define LOG_ERROR_S  LOG_STREAM(base::logging::ERROR)
+#define LOG_WARN_S  LOG_STREAM(base::logging::WARN)
+#define LOG_INFO_S  LOG_STREAM(base::logging::INFO)
+#define LOG_DEBUG_S  LOG_STREAM(base::logging::DEBUG)
+
+namespace base {
+
+struct Time;
+class Angle;
+
+namespace logging {
+
+/**
+ * Character buffer behind LogStream
+ *
+ * It writes into a fixed-size array and only switches to a growing heap
+ * buffer for messages that do not fit. The buffer is reused by all the
+ * stream log statements of a thread, so that after the first long message
+ * logging does not allocate anymore.
+ */
+class LogStreamBuffer : public std::streambuf
+{
+public:
+    /** Size of the fixed buffer */
+    static const size_t FIXED_SIZE = 1024;
+    /** Heap buffers larger than this are released after the message */
+    static const size_t MAX_KEPT_SIZE = 65536;
+
+    LogStreamBuffer();
+
+    /** Discards the current content */
+    void reset();
+
+    /** Returns the current content as a null-terminated string */
+    const char* c_str()
+    {
+        *pptr() = 0;
+        return pbase();
+    }
+
+    /** Appends \c size characters */
+    void write(const char* data, size_t size)
+    {
+        if(size <= static_cast<size_t>(epptr() - pptr()))
+        {
+            memcpy(pptr(), data, size);
+            pbump(static_cast<int>(size));
+        }
+        else
+            writeSlow(data, size);
+    }
+
+protected:
+    int_type overflow(int_type c);
+    std::streamsize xsputn(const char* data, std::streamsize size);
+
+private:
+    void writeSlow(const char* data, size_t size);
+    void setBuffer(char* buffer, size_t size, size_t used);
+
+    char mFixed[FIXED_SIZE];
+    std::vector<char> mOverflow;
+};
+
+class LogStream
+{
+public:
+	LogStream();
+	virtual ~LogStream();
+
+	/** Sets the location of the message. The strings must stay valid while
+	 * the program runs, like the literals given by the LOG_*_S macros */
+	LogStream& get(Priority prio,const char* pFuncName, const char* pFileName, int lineNumber, const char* name_space)
+	{
+	    mPrio = prio;
+	    mpFuncName = pFuncName;
+	    mpFileName = pFileName;
+	    mLineNumber = lineNumber;
+	    mNamespace = name_space;
+	    return *this;
+	}
+
+	/** Returns the underlying std::ostream */
+	std::ostream& stream() { return mState->stream; }
+
+	// Strings, characters, integers and floating-point values are written
+	// directly into the buffer, bypassing the locale facets of std::ostream,
+	// as long as the default formatting is used. Anything else goes through
+	// stream().
+	LogStream& operator<<(const char* value)
+	{
+	    if(!value || !isDefault())
+	        stream() << value;
+	    else
+	        mState->buffer.write(value, strlen(value));
+	    return *this;
+	}
+	LogStream& operator<<(const std::string& value)
+	{
+	    if(!isDefault())
+	        stream() << value;
+	    else
+	        mState->buffer.write(value.data(), value.size());
+	    return *this;
+	}
+	LogStream& operator<<(char value) { return writeChar(value); }
+	LogStream& operator<<(signed char value) { return writeChar(value); }
+	LogStream& operator<<(unsigned char value) { return writeChar(value); }
+	LogStream& operator<<(bool value) { return writeInteger<unsigned long>(static_cast<unsigned long>(value)); }
+	LogStream& operator<<(short value) { return writeInteger<unsigned long>(value); }
+	LogStream& operator<<(unsigned short value) { return writeInteger<unsigned long>(value); }
+	LogStream& operator<<(int value) { return writeInteger<unsigned long>(value); }
+	LogStream& operator<<(unsigned int value) { return writeInteger<unsigned long>(value); }
+	LogStream& operator<<(long value) { return writeInteger<unsigned long>(value); }
+	LogStream& operator<<(unsigned long value) { return writeInteger<unsigned long>(value); }
+	LogStream& operator<<(long long value) { return writeInteger<unsigned long long>(value); }
+	LogStream& operator<<(unsigned long long value) { return writeInteger<unsigned long long>(value); }
+	LogStream& operator<<(float value) { return writeFloat(value); }
+	LogStream& operator<<(double value) { return writeFloat(value); }
+	LogStream& operator<<(const base::Time& value);
+	LogStream& operator<<(const base::Angle& value);
+
+	LogStream& operator<<(std::ostream& (*manipulator)(std::ostream&))
+	{
+	    manipulator(stream());
+	    return *this;
+	}
+	LogStream& operator<<(std::ios& (*manipulator)(std::ios&))
+	{
+	    manipulator(stream());
+	    return *this;
+	}
+	LogStream& operator<<(std::ios_base& (*manipulator)(std::ios_base&))
+	{
+	    manipulator(stream());
+	    return *this;
+	}
+
+	/** Everything else is written with its std::ostream operator */
+	template<typename T>
+	LogStream& operator<<(const T& value)
+	{
+	    stream() << value;
+	    return *this;
+	}
+
+	/** Per-thread buffer and stream, see LogStreamBuffer */
+	struct State
+	{
+	    State();
+
+	    LogStreamBuffer buffer;
+	    std::ostream stream;
+	    bool busy;
+	};
+
+private:
+   LogStream(const LogStream&);
+   LogStream& operator =(const LogStream&);
+
+   /** True if the stream uses the default flags and width */
+   bool isDefault()
+   {
+       std::ostream& os = mState->stream;
+       return os.flags() == (std::ios_base::dec | std::ios_base::skipws) && os.width() == 0;
+   }
+
+   /** True if floating-point values can be formatted with snprintf: the
+    * stream uses the default flags, width and precision, and LC_NUMERIC
+    * uses '.' as the decimal point, like the classic locale of the stream */
+   bool isDefaultFloat();
+
+   LogStream& writeChar(char value)
+   {
+       if(!isDefault())
+           stream() << value;
+       else
+           mState->buffer.write(&value, 1);
+       return *this;
+   }
+
+   template<typename Unsigned, typename T>
+   LogStream& writeInteger(T value)
+   {
+       if(!isDefault())
+       {
+           stream() << value;
+           return *this;
+       }
+
+       // Negating in the unsigned type is also correct for the smallest
+       // negative value
+       bool negative = value < 0;
+       Unsigned magnitude = negative ? 0 - static_cast<Unsigned>(value) : static_cast<Unsigned>(value);
+       char digits[24];
+       char* it = digits + sizeof(digits);
+       do
+       {
+           *--it = '0' + magnitude % 10;
+           magnitude /= 10;
+       }
+       while(magnitude);
+       if(negative)
+           *--it = '-';
+       mState->buffer.write(it, digits + sizeof(digits) - it);
+       return *this;
+   }
+
+   LogStream& writeFloat(double value);
+
+private:
+   State* mState;
+   Priority mPrio;
+   const char* mpFuncName;
+   const char* mpFileName;
+   int mLineNumber;
+   const char* mNamespace;
+};
+
+
+} //namespace logging
+} //namespace base
+
+#endif // _BASE_LOGGING_IOSTREAM_STYLE_H_
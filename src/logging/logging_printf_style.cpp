@@ -6,18 +6,266 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sched.h>
 #include <algorithm>
 #include <sys/time.h>
 #include <time.h>
 #include <vector>
+#include <map>
 #include "terminal_colors.h"
 #include "logging_printf_style.h"
+#include "logging_binary.h"
+#include "logging_sinks.h"
 
 namespace base {
 namespace logging { 
 
-Logger::Logger() : mStream(stderr), mPriorityNames(10), mLogFormatNames(3)
+/** A message waiting to be written by the background thread. The function,
+ * file and namespace strings of the macros are literals and are not copied.
+ * Those given to Logger::log and Logger::logBuffer are copied into names */
+struct LogRecord
 {
+    Priority priority;
+    const char* function;
+    const char* file;
+    int line;
+    const char* name_space;
+    struct timeval time;
+    /** Set in the BINARY format, message then contains the encoded
+     * arguments */
+    const char* format;
+    size_t size;
+    char message[1024];
+    /** False if function, file and name_space point to names */
+    bool literalNames;
+    char names[3][128];
+};
+
+/** Copies name into buffer, truncated if needed */
+template<size_t size>
+static const char* copyName(char (&buffer)[size], const char* name)
+{
+    size_t length = std::min(strlen(name), size - 1);
+    memcpy(buffer, name, length);
+    buffer[length] = 0;
+    return buffer;
+}
+
+/** Sets the function, file and namespace strings of a record, which are
+ * copied unless they are literals */
+static void setNames(LogRecord& record, bool literalNames, const char* function, const char* file, const char* name_space)
+{
+    record.literalNames = literalNames;
+    if(literalNames)
+    {
+        record.function = function;
+        record.file = file;
+        record.name_space = name_space;
+        return;
+    }
+    record.function = copyName(record.names[0], function);
+    record.file = copyName(record.names[1], file);
+    record.name_space = copyName(record.names[2], name_space);
+}
+
+/** Bounded lock-free queue of preallocated log records, with multiple
+ * producers and a single consumer (the background thread)
+ *
+ * Each cell has a sequence number that tells whether it is free for the
+ * producer at a given position, or ready for the consumer. The consumer
+ * only sleeps on a condition variable when the queue is empty, and the
+ * producers only signal it when it does.
+ */
+class LogQueue
+{
+public:
+    struct Cell
+    {
+        size_t sequence;
+        LogRecord record;
+    };
+
+    LogQueue(size_t capacity, bool block)
+        : mBlock(block), mEnqueuePos(0), mDequeuePos(0), mDropped(0)
+        , mWritten(0), mSleeping(false), mStop(false)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size *= 2;
+        mCells.resize(size);
+        mMask = size - 1;
+        for (size_t i = 0; i < size; ++i)
+            mCells[i].sequence = i;
+
+        pthread_mutex_init(&mMutex, 0);
+        pthread_cond_init(&mWakeupCond, 0);
+        pthread_cond_init(&mWrittenCond, 0);
+    }
+
+    ~LogQueue()
+    {
+        pthread_cond_destroy(&mWrittenCond);
+        pthread_cond_destroy(&mWakeupCond);
+        pthread_mutex_destroy(&mMutex);
+    }
+
+    /** Returns a free cell, or 0 if the queue is full and the messages
+     * should be dropped. The cell must be published afterwards */
+    Cell* reserve()
+    {
+        size_t pos = __atomic_load_n(&mEnqueuePos, __ATOMIC_RELAXED);
+        for (;;)
+        {
+            Cell* cell = &mCells[pos & mMask];
+            size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (__atomic_compare_exchange_n(&mEnqueuePos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                    return cell;
+            }
+            else if (diff < 0)
+            {
+                if (!mBlock)
+                {
+                    __atomic_add_fetch(&mDropped, 1, __ATOMIC_RELAXED);
+                    return 0;
+                }
+                wakeup();
+                sched_yield();
+                pos = __atomic_load_n(&mEnqueuePos, __ATOMIC_RELAXED);
+            }
+            else
+                pos = __atomic_load_n(&mEnqueuePos, __ATOMIC_RELAXED);
+        }
+    }
+
+    /** Hands a reserved cell over to the consumer */
+    void publish(Cell* cell)
+    {
+        // Sequentially consistent to pair with the consumer's check of the
+        // queue after it sets mSleeping
+        __atomic_store_n(&cell->sequence, cell->sequence + 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&mSleeping, __ATOMIC_SEQ_CST))
+            wakeup();
+    }
+
+    /** Returns the oldest published cell, or 0 if there is none. Consumer
+     * only */
+    Cell* front()
+    {
+        Cell* cell = &mCells[mDequeuePos & mMask];
+        if (__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) != mDequeuePos + 1)
+            return 0;
+        return cell;
+    }
+
+    /** Releases the cell returned by front(). Consumer only */
+    void pop(Cell* cell)
+    {
+        __atomic_store_n(&cell->sequence, mDequeuePos + mMask + 1, __ATOMIC_RELEASE);
+        ++mDequeuePos;
+    }
+
+    /** Waits until a cell is published or the queue is stopped. Consumer
+     * only */
+    void wait()
+    {
+        pthread_mutex_lock(&mMutex);
+        __atomic_store_n(&mSleeping, true, __ATOMIC_SEQ_CST);
+        if (!front() && !mStop)
+        {
+            // The timeout is only a safety net
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += 1;
+            pthread_cond_timedwait(&mWakeupCond, &mMutex, &deadline);
+        }
+        __atomic_store_n(&mSleeping, false, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&mMutex);
+    }
+
+    void wakeup()
+    {
+        pthread_mutex_lock(&mMutex);
+        pthread_cond_signal(&mWakeupCond);
+        pthread_mutex_unlock(&mMutex);
+    }
+
+    /** Tells the consumer to exit once the queue is empty */
+    void stop()
+    {
+        pthread_mutex_lock(&mMutex);
+        mStop = true;
+        pthread_cond_signal(&mWakeupCond);
+        pthread_mutex_unlock(&mMutex);
+    }
+
+    bool isStopped()
+    {
+        pthread_mutex_lock(&mMutex);
+        bool stopped = mStop;
+        pthread_mutex_unlock(&mMutex);
+        return stopped;
+    }
+
+    /** Called by the consumer once messages have been written and flushed */
+    void markWritten(size_t count)
+    {
+        pthread_mutex_lock(&mMutex);
+        mWritten += count;
+        pthread_cond_broadcast(&mWrittenCond);
+        pthread_mutex_unlock(&mMutex);
+    }
+
+    /** Waits until all messages published so far are written */
+    void flush()
+    {
+        size_t target = __atomic_load_n(&mEnqueuePos, __ATOMIC_ACQUIRE);
+        pthread_mutex_lock(&mMutex);
+        while (mWritten < target)
+            pthread_cond_wait(&mWrittenCond, &mMutex);
+        pthread_mutex_unlock(&mMutex);
+    }
+
+    /** Returns the number of messages dropped since the last call */
+    uint64_t takeDropped()
+    {
+        return __atomic_exchange_n(&mDropped, 0, __ATOMIC_RELAXED);
+    }
+
+private:
+    std::vector<Cell> mCells;
+    size_t mMask;
+    bool mBlock;
+    size_t mEnqueuePos;
+    size_t mDequeuePos;
+    uint64_t mDropped;
+
+    pthread_mutex_t mMutex;
+    pthread_cond_t mWakeupCond;
+    pthread_cond_t mWrittenCond;
+    size_t mWritten;
+    bool mSleeping;
+    bool mStop;
+};
+
+/** Encodes the arguments of a format given as variable argument list */
+static size_t encodeBinary(char* buffer, size_t size, const char* format, ...)
+{
+    va_list arguments;
+    va_start(arguments, format);
+    size_t result = encodeBinaryArguments(buffer, size, format, arguments);
+    va_end(arguments);
+    return result;
+}
+
+Logger::Logger() : mStream(stderr), mPriorityNames(10), mSites(0), mLogFormatNames(5), mLogModeNames(3), mLogMode(SYNC), mQueue(0), mBinaryStream(0), mStreamEnabled(true), mUserPattern(0)
+{
+    pthread_mutex_init(&mSitesMutex, 0);
+
     mPriorityNames[INFO_P] = "INFO";
     mPriorityNames[DEBUG_P] = "DEBUG";
     mPriorityNames[WARN_P] = "WARN";
@@ -28,8 +276,25 @@ Logger::Logger() : mStream(stderr), mPriorityNames(10), mLogFormatNames(3)
     mLogFormatNames[DEFAULT] = "DEFAULT";
     mLogFormatNames[MULTILINE] = "MULTILINE";
     mLogFormatNames[SHORT] = "SHORT";
+    mLogFormatNames[BINARY] = "BINARY";
+    mLogFormatNames[PATTERN] = "PATTERN";
     mLogFormat = getLogFormatFromEnv();
 
+    mPatterns[DEFAULT] = compilePattern("[%t] %c[%p] - %n::%m%C (%F:%L - %f)");
+    mPatterns[MULTILINE] = compilePattern("[%t] in %f\n\t%F:%L\n\t%c[%p] - %n::%m%C ");
+    mPatterns[SHORT] = compilePattern("%c[%p] - %n::%m%C");
+    mUserPattern = new std::vector<PatternElement>(mPatterns[DEFAULT]);
+    char* pattern = getenv("BASE_LOG_PATTERN");
+    if(pattern)
+        setLogPattern(pattern);
+
+    for(size_t i = 0; i < mPriorityNames.size(); ++i)
+    {
+        char padded[32];
+        snprintf(padded, sizeof(padded), "%5s", mPriorityNames[i].c_str());
+        mPaddedPriorityNames.push_back(padded);
+    }
+
     mPriority = getLogLevelFromEnv();
 
     if (getLogColorFromEnv())
@@ -53,49 +318,478 @@ Logger::Logger() : mStream(stderr), mPriorityNames(10), mLogFormatNames(3)
     // Per default enable ERROR logging
     if(mPriority == UNKNOWN_P)
         mPriority = ERROR_P;
+
+    getNamespaceLevelsFromEnv();
+
+    // messages[/seconds]
+    char* burstLimit = getenv("BASE_LOG_BURST_LIMIT");
+    if(burstLimit)
+    {
+        char* separator = strchr(burstLimit, '/');
+        setBurstLimit(std::max(atoi(burstLimit), 0), separator ? atof(separator + 1) : 1.0);
+    }
+    pthread_mutex_lock(&mSitesMutex);
+    updateSites();
+    pthread_mutex_unlock(&mSitesMutex);
+
+    mLogModeNames[SYNC] = "SYNC";
+    mLogModeNames[ASYNC] = "ASYNC";
+    mLogModeNames[ASYNC_BLOCK] = "ASYNC_BLOCK";
+    LogMode mode = getLogModeFromEnv(SYNC);
+    if (mode != SYNC)
+    {
+        char* queueSize = getenv("BASE_LOG_QUEUE_SIZE");
+        setLogMode(mode, queueSize ? std::max(atoi(queueSize), 1) : 1024);
+    }
 }
 
 Logger::~Logger()
 {
+    // Writes all pending messages
+    setLogMode(SYNC, 0);
+    flushOutputs();
+    delete mUserPattern;
+    for(size_t i = 0; i < mRetiredPatterns.size(); ++i)
+        delete mRetiredPatterns[i];
+
+    // The sites register again with the next logger, and the owners that are
+    // destroyed later do not unregister from this one
+    pthread_mutex_lock(&mSitesMutex);
+    for(LogSite* site = mSites; site; site = site->next)
+    {
+        __atomic_store_n(&site->level, static_cast<int>(LogSite::UNREGISTERED), __ATOMIC_RELAXED);
+        __atomic_store_n(&site->owner->registered, false, __ATOMIC_RELAXED);
+    }
+    mSites = 0;
+    pthread_mutex_unlock(&mSitesMutex);
+    pthread_mutex_destroy(&mSitesMutex);
 }
 
 void Logger::configure(Priority priority, FILE* outputStream)
 {
     Priority envPriority = getLogLevelFromEnv();
+    pthread_mutex_lock(&mSitesMutex);
     // Only limit to higher (close to FATAL) priorities
     if(envPriority < priority && envPriority != UNKNOWN_P)
         mPriority = envPriority;
     else
         mPriority = priority;
+    updateSites();
+    pthread_mutex_unlock(&mSitesMutex);
 
     if(outputStream)
+    {
+        // Pending messages go to the previous stream
+        flush();
+        // A new stream gets the binary header and strings again, even if it
+        // has the address of a previous one
+        if(outputStream != mStream)
+            mBinaryStream = 0;
         mStream = outputStream;
+    }
 }
 
-Priority Logger::getLogLevelFromEnv()
+void Logger::configure(Priority priority, FILE* outputStream, LogMode mode, size_t queueSize)
 {
-    char* loglevel = getenv("BASE_LOG_LEVEL");
-    if(!loglevel)
-        return UNKNOWN_P;
+    configure(priority, outputStream);
+    setLogMode(getLogModeFromEnv(mode), queueSize);
+}
 
-    std::string priority(loglevel);
-    std::transform(priority.begin(), priority.end(),priority.begin(), (int(*)(int)) std::toupper);
-    
-    int index = 0;
-    std::vector<std::string>::iterator it = mPriorityNames.begin();
-    for(;it != mPriorityNames.end(); it++)
+void Logger::flush()
+{
+    if(mQueue)
+        mQueue->flush();
+}
+
+void Logger::setLogFormat(LogFormat format)
+{
+    flush();
+    fflush(mStream);
+    mLogFormat = format;
+}
+
+void Logger::setLogPattern(const std::string& pattern)
+{
+    std::vector<PatternElement>* compiled = new std::vector<PatternElement>(compilePattern(pattern));
+    flush();
+
+    // Threads formatting a message keep using the previous pattern, which
+    // stays alive
+    pthread_mutex_lock(&mSitesMutex);
+    std::vector<PatternElement>* previous = __atomic_exchange_n(&mUserPattern, compiled, __ATOMIC_ACQ_REL);
+    if(previous)
+        mRetiredPatterns.push_back(previous);
+    pthread_mutex_unlock(&mSitesMutex);
+
+    // Switching from another format is not safe while other threads log,
+    // see setLogFormat
+    if(mLogFormat != PATTERN)
+    {
+        fflush(mStream);
+        mLogFormat = PATTERN;
+    }
+}
+
+std::vector<Logger::PatternElement> Logger::compilePattern(const std::string& pattern)
+{
+    std::vector<PatternElement> elements;
+    PatternElement literal;
+    literal.token = PATTERN_LITERAL;
+    for(size_t i = 0; i < pattern.size(); ++i)
     {
-        if(*it != priority)
+        PatternToken token = PATTERN_LITERAL;
+        if(pattern[i] == '%' && i + 1 < pattern.size())
         {
-            index++;
-        } else {
-            return (Priority) index; 
+            switch(pattern[i + 1])
+            {
+                case 't': token = PATTERN_TIME; break;
+                case 'p': token = PATTERN_PRIORITY; break;
+                case 'f': token = PATTERN_FUNCTION; break;
+                case 'm': token = PATTERN_MESSAGE; break;
+                case 'F': token = PATTERN_FILE; break;
+                case 'L': token = PATTERN_LINE; break;
+                case 'n': token = PATTERN_NAMESPACE; break;
+                case 'c': token = PATTERN_COLOR; break;
+                case 'C': token = PATTERN_COLOR_END; break;
+                case '%':
+                    literal.literal += '%';
+                    ++i;
+                    continue;
+            }
+        }
+
+        if(token == PATTERN_LITERAL)
+        {
+            literal.literal += pattern[i];
+            continue;
         }
+
+        // Consecutive characters are merged into a single literal
+        if(!literal.literal.empty())
+        {
+            elements.push_back(literal);
+            literal.literal.clear();
+        }
+        PatternElement element;
+        element.token = token;
+        elements.push_back(element);
+        ++i;
     }
+    literal.literal += '\n';
+    elements.push_back(literal);
+    return elements;
+}
 
+void Logger::addSink(LogSink* sink)
+{
+    flush();
+    if(std::find(mSinks.begin(), mSinks.end(), sink) == mSinks.end())
+        mSinks.push_back(sink);
+}
+
+void Logger::removeSink(LogSink* sink)
+{
+    // Pending messages still go to the sink
+    flush();
+    mSinks.erase(std::remove(mSinks.begin(), mSinks.end(), sink), mSinks.end());
+}
+
+void Logger::setStreamEnabled(bool enabled)
+{
+    flush();
+    mStreamEnabled = enabled;
+}
+
+void Logger::flushOutputs()
+{
+    if(mStreamEnabled)
+        fflush(mStream);
+    for(size_t i = 0; i < mSinks.size(); ++i)
+        mSinks[i]->flush();
+}
+
+void Logger::setLogMode(LogMode mode, size_t queueSize)
+{
+    if(mQueue)
+    {
+        mQueue->stop();
+        pthread_join(mThread, 0);
+        delete mQueue;
+        mQueue = 0;
+    }
+
+    mLogMode = mode;
+    if(mode != SYNC)
+    {
+        mQueue = new LogQueue(queueSize, mode == ASYNC_BLOCK);
+        if(pthread_create(&mThread, 0, &Logger::asyncThread, this) != 0)
+        {
+            delete mQueue;
+            mQueue = 0;
+            mLogMode = SYNC;
+        }
+    }
+}
+
+void* Logger::asyncThread(void* arg)
+{
+    Logger* logger = static_cast<Logger*>(arg);
+    LogQueue* queue = logger->mQueue;
+    for(;;)
+    {
+        size_t count = 0;
+        while(LogQueue::Cell* cell = queue->front())
+        {
+            LogRecord const& record = cell->record;
+            if(record.format)
+                logger->writeBinary(record.priority, record.literalNames, record.function, record.file, record.line, record.name_space, record.format, record.message, record.size, record.time);
+            else
+                logger->writeMessage(record.priority, record.function, record.file, record.line, record.name_space, record.message, record.time);
+            queue->pop(cell);
+            ++count;
+        }
+
+        uint64_t dropped = queue->takeDropped();
+        if(dropped)
+            logger->logDropped(dropped);
+
+        if(count || dropped)
+        {
+            logger->flushOutputs();
+            queue->markWritten(count);
+        }
+        else if(queue->isStopped())
+            break;
+        else
+            queue->wait();
+    }
+    return 0;
+}
+
+void Logger::logDropped(uint64_t count)
+{
+    static const char* format = "%llu log messages dropped";
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    if(mLogFormat == BINARY)
+    {
+        char arguments[16];
+        size_t size = encodeBinary(arguments, sizeof(arguments), format, static_cast<unsigned long long>(count));
+        writeBinary(WARN_P, true, __PRETTY_FUNCTION__, __FILE__, __LINE__, "base", format, arguments, size, tv);
+    }
+    else
+    {
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), format, static_cast<unsigned long long>(count));
+        writeMessage(WARN_P, __PRETTY_FUNCTION__, __FILE__, __LINE__, "base", buffer, tv);
+    }
+}
+
+void Logger::setLogLevel(Priority priority)
+{
+    pthread_mutex_lock(&mSitesMutex);
+    mPriority = priority;
+    updateSites();
+    pthread_mutex_unlock(&mSitesMutex);
+}
+
+void Logger::setLogLevel(const std::string& name_space, Priority priority)
+{
+    pthread_mutex_lock(&mSitesMutex);
+    mNamespacePriorities[name_space] = priority;
+    updateSites();
+    pthread_mutex_unlock(&mSitesMutex);
+}
+
+void Logger::clearLogLevel(const std::string& name_space)
+{
+    pthread_mutex_lock(&mSitesMutex);
+    mNamespacePriorities.erase(name_space);
+    updateSites();
+    pthread_mutex_unlock(&mSitesMutex);
+}
+
+Priority Logger::getLogLevel(const std::string& name_space)
+{
+    pthread_mutex_lock(&mSitesMutex);
+    Priority priority = getLogLevelLocked(name_space);
+    pthread_mutex_unlock(&mSitesMutex);
+    return priority;
+}
+
+Priority Logger::getLogLevelLocked(const std::string& name_space)
+{
+    std::map<std::string, Priority>::const_iterator it = mNamespacePriorities.find(name_space);
+    if(it == mNamespacePriorities.end())
+        return mPriority;
+    return it->second;
+}
+
+unsigned int LogSite::burst_limit = 0;
+int64_t LogSite::burst_window = 1000000;
+
+static int64_t getMonotonicMicroseconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
+
+LogSiteOwner::~LogSiteOwner()
+{
+    // Cleared when the logger is destroyed, so that this does not create a
+    // new logger at exit
+    if(__atomic_load_n(&registered, __ATOMIC_RELAXED))
+        Logger::getInstance()->unregisterSites(*this);
+}
+
+bool LogSite::everyT(double seconds)
+{
+    // counter holds the earliest time of the next message
+    int64_t now = getMonotonicMicroseconds();
+    uint64_t next = __atomic_load_n(&counter, __ATOMIC_RELAXED);
+    if(now < static_cast<int64_t>(next))
+        return false;
+    uint64_t updated = now + static_cast<int64_t>(seconds * 1e6);
+    return __atomic_compare_exchange_n(&counter, &next, updated, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+bool LogSite::admitBurst(Priority priority)
+{
+    int64_t now = getMonotonicMicroseconds();
+    int64_t start = __atomic_load_n(&window_start, __ATOMIC_RELAXED);
+    if(now - start >= __atomic_load_n(&burst_window, __ATOMIC_RELAXED)
+            && __atomic_compare_exchange_n(&window_start, &start, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+        // This thread starts the new window
+        __atomic_store_n(&window_count, 0, __ATOMIC_RELAXED);
+        unsigned int missed = __atomic_exchange_n(&suppressed, 0, __ATOMIC_RELAXED);
+        if(missed)
+        {
+            char buffer[64];
+            snprintf(buffer, sizeof(buffer), "last message repeated %u times", missed);
+            Logger::getInstance()->logBuffer(priority, "", file, line, name_space, buffer);
+        }
+    }
+
+    if(__atomic_fetch_add(&window_count, 1, __ATOMIC_RELAXED) < __atomic_load_n(&burst_limit, __ATOMIC_RELAXED))
+        return true;
+    __atomic_add_fetch(&suppressed, 1, __ATOMIC_RELAXED);
+    return false;
+}
+
+void Logger::setBurstLimit(unsigned int messages, double seconds)
+{
+    __atomic_store_n(&LogSite::burst_window, static_cast<int64_t>(seconds * 1e6), __ATOMIC_RELAXED);
+    __atomic_store_n(&LogSite::burst_limit, messages, __ATOMIC_RELAXED);
+}
+
+int Logger::registerSite(LogSite& site)
+{
+    pthread_mutex_lock(&mSitesMutex);
+    // Another thread may have registered it in the meantime
+    if(__atomic_load_n(&site.level, __ATOMIC_RELAXED) == LogSite::UNREGISTERED)
+    {
+        site.next = mSites;
+        mSites = &site;
+        __atomic_store_n(&site.owner->registered, true, __ATOMIC_RELAXED);
+        __atomic_store_n(&site.level, static_cast<int>(getLogLevelLocked(site.name_space)), __ATOMIC_RELAXED);
+    }
+    int level = site.level;
+    pthread_mutex_unlock(&mSitesMutex);
+    return level;
+}
+
+void Logger::unregisterSites(LogSiteOwner& owner)
+{
+    pthread_mutex_lock(&mSitesMutex);
+    LogSite** it = &mSites;
+    while(*it)
+    {
+        LogSite* site = *it;
+        if(site->owner == &owner)
+        {
+            *it = site->next;
+            __atomic_store_n(&site->level, static_cast<int>(LogSite::UNREGISTERED), __ATOMIC_RELAXED);
+        }
+        else
+            it = &site->next;
+    }
+    __atomic_store_n(&owner.registered, false, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&mSitesMutex);
+}
+
+void Logger::updateSites()
+{
+    int maxPriority = mPriority;
+    std::map<std::string, Priority>::const_iterator it = mNamespacePriorities.begin();
+    for(; it != mNamespacePriorities.end(); ++it)
+        maxPriority = std::max<int>(maxPriority, it->second);
+    __atomic_store_n(&mMaxPriority, maxPriority, __ATOMIC_RELAXED);
+
+    for(LogSite* site = mSites; site; site = site->next)
+        __atomic_store_n(&site->level, static_cast<int>(getLogLevelLocked(site->name_space)), __ATOMIC_RELAXED);
+}
+
+/** Splits the comma-separated entries of BASE_LOG_LEVEL */
+static std::vector<std::string> getLogLevelEntriesFromEnv()
+{
+    std::vector<std::string> entries;
+    char* loglevel = getenv("BASE_LOG_LEVEL");
+    if(!loglevel)
+        return entries;
+
+    std::string value(loglevel);
+    size_t start = 0;
+    while(start <= value.size())
+    {
+        size_t end = std::min(value.find(',', start), value.size());
+        entries.push_back(value.substr(start, end - start));
+        start = end + 1;
+    }
+    return entries;
+}
+
+Priority Logger::parseLogLevel(std::string name)
+{
+    std::transform(name.begin(), name.end(), name.begin(), (int(*)(int)) std::toupper);
+
+    for(int index = 0; index < ENDPRIORITIES; ++index)
+    {
+        if(mPriorityNames[index] == name)
+            return (Priority) index;
+    }
     return UNKNOWN_P;
 }
 
+Priority Logger::getLogLevelFromEnv()
+{
+    // The last entry that is not a namespace=level pair
+    Priority priority = UNKNOWN_P;
+    std::vector<std::string> entries = getLogLevelEntriesFromEnv();
+    for(size_t i = 0; i < entries.size(); ++i)
+    {
+        if(entries[i].find('=') == std::string::npos)
+            priority = parseLogLevel(entries[i]);
+    }
+    return priority;
+}
+
+void Logger::getNamespaceLevelsFromEnv()
+{
+    std::vector<std::string> entries = getLogLevelEntriesFromEnv();
+    for(size_t i = 0; i < entries.size(); ++i)
+    {
+        size_t separator = entries[i].find('=');
+        if(separator == std::string::npos)
+            continue;
+
+        Priority priority = parseLogLevel(entries[i].substr(separator + 1));
+        if(priority != UNKNOWN_P)
+            mNamespacePriorities[entries[i].substr(0, separator)] = priority;
+    }
+}
+
 bool Logger::getLogColorFromEnv()
 {
     char* color = getenv("BASE_LOG_COLOR");
@@ -131,52 +825,360 @@ LogFormat Logger::getLogFormatFromEnv()
 }
 
 
+LogMode Logger::getLogModeFromEnv(LogMode defaultMode)
+{
+    char* logmode = getenv("BASE_LOG_MODE");
+    if(!logmode)
+        return defaultMode;
+
+    std::string logmode_str(logmode);
+    std::transform(logmode_str.begin(), logmode_str.end(),logmode_str.begin(), (int(*)(int)) std::toupper);
+
+    std::vector<std::string>::iterator it = std::find(mLogModeNames.begin(), mLogModeNames.end(), logmode_str);
+    if(it == mLogModeNames.end())
+        return defaultMode;
+    return (LogMode) (it - mLogModeNames.begin());
+}
+
 void Logger::log(Priority priority, const char* function, const char* file, int line, const char* name_space, const char* format, ...)
 {
-    if(priority <= mPriority)
+    va_list arguments;
+    va_start(arguments, format);
+    logArguments(false, priority, function, file, line, name_space, format, arguments);
+    va_end(arguments);
+}
+
+void Logger::logLiteral(Priority priority, const char* function, const char* file, int line, const char* name_space, const char* format, ...)
+{
+    va_list arguments;
+    va_start(arguments, format);
+    logArguments(true, priority, function, file, line, name_space, format, arguments);
+    va_end(arguments);
+}
+
+void Logger::logArguments(bool literal, Priority priority, const char* function, const char* file, int line, const char* name_space, const char* format, va_list arguments)
+{
+    if(priority <= __atomic_load_n(&mMaxPriority, __ATOMIC_RELAXED))
     {
-        char buffer[1024];
-        va_list arguments;
+        // The binary records reference the format. Other formats are logged
+        // as text, through logBuffer
+        const bool binary = mLogFormat == BINARY && literal;
+        if(mQueue && (binary || mLogFormat != BINARY))
+        {
+            // Only format the message here, the background thread does the rest
+            LogQueue::Cell* cell = mQueue->reserve();
+            if(!cell)
+                return;
+            LogRecord& record = cell->record;
+            record.priority = priority;
+            setNames(record, literal, function, file, name_space);
+            record.line = line;
+            gettimeofday(&record.time, 0);
 
-        va_start(arguments, format);
-        vsnprintf(buffer, sizeof(buffer), format, arguments);
-        va_end(arguments);
+            if(binary)
+            {
+                record.format = format;
+                record.size = encodeBinaryArguments(record.message, sizeof(record.message), format, arguments);
+            }
+            else
+            {
+                record.format = 0;
+                vsnprintf(record.message, sizeof(record.message), format, arguments);
+            }
+            mQueue->publish(cell);
+            return;
+        }
+
+        if(binary)
+        {
+            char buffer[1024];
+            size_t size = encodeBinaryArguments(buffer, sizeof(buffer), format, arguments);
+
+            struct timeval tv;
+            gettimeofday(&tv, 0);
+            writeBinary(priority, true, function, file, line, name_space, format, buffer, size, tv);
+            return;
+        }
 
-        logBuffer(priority,function,file,line,name_space,buffer);
+        char buffer[1024];
+        vsnprintf(buffer, sizeof(buffer), format, arguments);
+        logBufferNames(literal, priority, function, file, line, name_space, buffer);
     }
 }
 
 void Logger::logBuffer(Priority priority, const char* function, const char* file, int line, const char* name_space, const char* buffer)
 {
-    if(priority <= mPriority)
+    logBufferNames(false, priority, function, file, line, name_space, buffer);
+}
+
+void Logger::logLiteralBuffer(Priority priority, const char* function, const char* file, int line, const char* name_space, const char* buffer)
+{
+    logBufferNames(true, priority, function, file, line, name_space, buffer);
+}
+
+void Logger::logBufferNames(bool literal, Priority priority, const char* function, const char* file, int line, const char* name_space, const char* buffer)
+{
+    if(priority <= __atomic_load_n(&mMaxPriority, __ATOMIC_RELAXED))
     {
-        time_t now;
-        time(&now);
-        struct tm* current = localtime(&now);
-        char currentTime[25];
+        if(mQueue)
+        {
+            LogQueue::Cell* cell = mQueue->reserve();
+            if(!cell)
+                return;
+            LogRecord& record = cell->record;
+            record.priority = priority;
+            setNames(record, literal, function, file, name_space);
+            record.line = line;
+            gettimeofday(&record.time, 0);
+
+            if(mLogFormat == BINARY)
+            {
+                record.format = "%s";
+                record.size = encodeBinary(record.message, sizeof(record.message), record.format, buffer);
+            }
+            else
+            {
+                record.format = 0;
+                size_t length = std::min(strlen(buffer), sizeof(record.message) - 1);
+                memcpy(record.message, buffer, length);
+                record.message[length] = 0;
+            }
+            mQueue->publish(cell);
+            return;
+        }
 
         struct timeval tv;
         gettimeofday(&tv,0);
-        int milliSecs = tv.tv_usec/1000;
-
-        strftime(currentTime, 25, "%Y%m%d-%H:%M:%S", current);
-
-        //Todo: optional log pattern, e.g. %t(ime) %p(rio) %f(unc) %m(sg) %F(ile) %L(ine)
-        //could be optimized to a jumplist, so no performance issue
-        switch (mLogFormat)
-        {
-            case DEFAULT:
-                fprintf(mStream, "[%s:%03d] %s[%5s] - %s::%s%s (%s:%d - %s)\n", currentTime, milliSecs, mpLogColor[priority], mPriorityNames[priority].c_str(), name_space, buffer, mpColorEnd, file, line, function);
-                break;
-            case MULTILINE:
-                fprintf(mStream, "[%s:%03d] in %s\n\t%s:%d\n\t%s[%5s] - %s::%s%s \n", currentTime, milliSecs, function, file, line, mpLogColor[priority], mPriorityNames[priority].c_str(), name_space, buffer, mpColorEnd);
-                break;
-            case SHORT:
-                fprintf(mStream, "%s[%5s] - %s::%s%s\n", mpLogColor[priority], mPriorityNames[priority].c_str(), name_space, buffer, mpColorEnd);
-                break;
-       }
-        fflush(mStream);
+        if(mLogFormat == BINARY)
+        {
+            char arguments[1024];
+            size_t size = encodeBinary(arguments, sizeof(arguments), "%s", buffer);
+            writeBinary(priority, literal, function, file, line, name_space, "%s", arguments, size, tv);
+            return;
+        }
+        writeMessage(priority, function, file, line, name_space, buffer, tv);
+        flushOutputs();
+    }
+}
+
+void Logger::writeBinary(Priority priority, bool literalNames, const char* function, const char* file, int line, const char* name_space, const char* format, const char* arguments, size_t size, const struct timeval& tv)
+{
+    if(!mSinks.empty())
+    {
+        // The sinks get the text
+        char text[1024];
+        formatBinaryArguments(text, sizeof(text), format, arguments, size);
+        writeFormatted(DEFAULT, false, priority, function, file, line, name_space, text, tv);
+    }
+    if(!mStreamEnabled)
+        return;
+
+    // The stream lock keeps the string records before the messages that use
+    // them
+    flockfile(mStream);
+    if(mBinaryStream != mStream)
+    {
+        fwrite(BINARY_LOG_MAGIC, sizeof(BINARY_LOG_MAGIC), 1, mStream);
+        mBinaryStrings.clear();
+        for(int i = 0; i < 3; ++i)
+            mBinaryNames[i].clear();
+        mBinaryStream = mStream;
+    }
+    uint64_t ids[4] = { reinterpret_cast<uintptr_t>(format), reinterpret_cast<uintptr_t>(function),
+        reinterpret_cast<uintptr_t>(file), reinterpret_cast<uintptr_t>(name_space) };
+    writeBinaryString(format);
+    if(literalNames)
+    {
+        writeBinaryString(function);
+        writeBinaryString(file);
+        writeBinaryString(name_space);
+    }
+    else
+    {
+        // Their address may be reused by other strings, they are
+        // identified by their position instead
+        const char* names[3] = { function, file, name_space };
+        for(int i = 0; i < 3; ++i)
+        {
+            ids[i + 1] = i + 1;
+            if(mBinaryNames[i] != names[i])
+            {
+                mBinaryNames[i] = names[i];
+                writeBinaryString(ids[i + 1], names[i]);
+            }
+        }
     }
+
+    char header[64];
+    char* it = header;
+    uint8_t type = MESSAGE_RECORD;
+    uint8_t prio = priority;
+    int32_t line32 = line;
+    int64_t time = static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+    uint32_t size32 = size;
+    memcpy(it, &type, sizeof(type)); it += sizeof(type);
+    memcpy(it, &prio, sizeof(prio)); it += sizeof(prio);
+    memcpy(it, &line32, sizeof(line32)); it += sizeof(line32);
+    memcpy(it, &time, sizeof(time)); it += sizeof(time);
+    memcpy(it, ids, sizeof(ids)); it += sizeof(ids);
+    memcpy(it, &size32, sizeof(size32)); it += sizeof(size32);
+    fwrite(header, it - header, 1, mStream);
+    if(size)
+        fwrite(arguments, size, 1, mStream);
+    funlockfile(mStream);
+}
+
+void Logger::writeBinaryString(const char* str)
+{
+    if(mBinaryStrings.insert(str).second)
+        writeBinaryString(reinterpret_cast<uintptr_t>(str), str);
+}
+
+void Logger::writeBinaryString(uint64_t id, const char* str)
+{
+    uint8_t type = STRING_RECORD;
+    uint32_t length = strlen(str);
+    fwrite(&type, sizeof(type), 1, mStream);
+    fwrite(&id, sizeof(id), 1, mStream);
+    fwrite(&length, sizeof(length), 1, mStream);
+    fwrite(str, length, 1, mStream);
+}
+
+void Logger::writeMessage(Priority priority, const char* function, const char* file, int line, const char* name_space, const char* buffer, const struct timeval& tv)
+{
+    // Binary messages are written by writeBinary
+    if(mLogFormat != BINARY)
+        writeFormatted(mLogFormat, mStreamEnabled, priority, function, file, line, name_space, buffer, tv);
+}
+
+/** Character buffer that starts on the stack and moves to the heap for long
+ * messages */
+class MessageBuffer
+{
+public:
+    MessageBuffer(char* buffer, size_t capacity)
+        : mData(buffer), mSize(0), mCapacity(capacity) {}
+
+    void append(const char* data, size_t size)
+    {
+        if(mSize + size > mCapacity)
+            grow(mSize + size);
+        memcpy(mData + mSize, data, size);
+        mSize += size;
+    }
+
+    void append(const char* str) { append(str, strlen(str)); }
+    void append(const std::string& str) { append(str.data(), str.size()); }
+
+    void appendInteger(int value)
+    {
+        char digits[16];
+        char* it = digits + sizeof(digits);
+        unsigned int magnitude = value < 0 ? 0u - static_cast<unsigned int>(value) : value;
+        do
+        {
+            *--it = '0' + magnitude % 10;
+            magnitude /= 10;
+        }
+        while(magnitude);
+        if(value < 0)
+            *--it = '-';
+        append(it, digits + sizeof(digits) - it);
+    }
+
+    const char* data() const { return mData; }
+    size_t size() const { return mSize; }
+
+private:
+    void grow(size_t required)
+    {
+        std::vector<char> heap(std::max(required, 2 * mCapacity));
+        memcpy(&heap[0], mData, mSize);
+        mHeap.swap(heap);
+        mData = &mHeap[0];
+        mCapacity = mHeap.size();
+    }
+
+    char* mData;
+    size_t mSize;
+    size_t mCapacity;
+    std::vector<char> mHeap;
+};
+
+// localtime_r takes a global lock, so the date and time are only rendered
+// again when the second changes
+static __thread time_t tCachedSecond = -1;
+static __thread char tCachedTime[25];
+
+static const char* getTimePrefix(time_t seconds)
+{
+    if(seconds != tCachedSecond)
+    {
+        struct tm current;
+        localtime_r(&seconds, &current);
+        strftime(tCachedTime, sizeof(tCachedTime), "%Y%m%d-%H:%M:%S", &current);
+        tCachedSecond = seconds;
+    }
+    return tCachedTime;
+}
+
+void Logger::writeFormatted(LogFormat format, bool toStream, Priority priority, const char* function, const char* file, int line, const char* name_space, const char* buffer, const struct timeval& tv)
+{
+        if(!toStream && mSinks.empty())
+            return;
+
+        // Formatted once for all outputs
+        char stackBuffer[2048];
+        MessageBuffer message(stackBuffer, sizeof(stackBuffer));
+        const std::vector<PatternElement>& pattern = format == PATTERN ? *__atomic_load_n(&mUserPattern, __ATOMIC_ACQUIRE)
+            : mPatterns[format == BINARY ? DEFAULT : format];
+        for(size_t i = 0; i < pattern.size(); ++i)
+        {
+            switch(pattern[i].token)
+            {
+                case PATTERN_LITERAL:
+                    message.append(pattern[i].literal);
+                    break;
+                case PATTERN_TIME:
+                {
+                    int milliSecs = tv.tv_usec/1000;
+                    char milliSecsText[4] = { ':', static_cast<char>('0' + milliSecs / 100),
+                        static_cast<char>('0' + milliSecs / 10 % 10), static_cast<char>('0' + milliSecs % 10) };
+                    message.append(getTimePrefix(tv.tv_sec));
+                    message.append(milliSecsText, sizeof(milliSecsText));
+                    break;
+                }
+                case PATTERN_PRIORITY:
+                    message.append(mPaddedPriorityNames[priority]);
+                    break;
+                case PATTERN_FUNCTION:
+                    message.append(function);
+                    break;
+                case PATTERN_MESSAGE:
+                    message.append(buffer);
+                    break;
+                case PATTERN_FILE:
+                    message.append(file);
+                    break;
+                case PATTERN_LINE:
+                    message.appendInteger(line);
+                    break;
+                case PATTERN_NAMESPACE:
+                    message.append(name_space);
+                    break;
+                case PATTERN_COLOR:
+                    message.append(mpLogColor[priority]);
+                    break;
+                case PATTERN_COLOR_END:
+                    message.append(mpColorEnd);
+                    break;
+            }
+        }
+
+        if(toStream)
+            fwrite(message.data(), message.size(), 1, mStream);
+        for(size_t i = 0; i < mSinks.size(); ++i)
+            mSinks[i]->write(priority, message.data(), message.size());
 }
 
 } // end namespace logging
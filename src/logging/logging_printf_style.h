@@ -21,9 +21,21 @@
  * given log levels, e.g. export BASE_LOG_LEVEL="info" to show debug of 
  * INFO and higher log statements
  *
+ * The level can also be set per namespace, by appending comma-separated
+ * namespace=level pairs, e.g. BASE_LOG_LEVEL="warn,mylib=debug" shows the
+ * DEBUG messages of mylib and only WARN and higher for everything else. See
+ * also Logger::setLogLevel
+ *
  * Setting of BASE_LOG_COLOR enables a color scheme for the log message, that 
  * is best viewed in a terminal with dark background color
  *
+ * Setting BASE_LOG_MODE to ASYNC or ASYNC_BLOCK moves the timestamp formatting
+ * and the output to a background thread, see base::logging::LogMode. The
+ * size of the message queue can be set with BASE_LOG_QUEUE_SIZE
+ *
+ * Setting BASE_LOG_BURST_LIMIT to e.g. "100/1.5" mutes the statements that
+ * log more than 100 messages within 1.5 seconds, see Logger::setBurstLimit
+ *
  */
 
 #ifndef _BASE_LOGGING_PRINTF_STYLE_H_
@@ -69,17 +81,47 @@
 #ifdef BASE_LONG_NAMES
 // Empty definition of debug statement
 #define BASE_LOG_DEBUG(FORMAT, ARGS...)
+#define BASE_LOG_DEBUG_EVERY_N(N, FORMAT, ARGS...)
+#define BASE_LOG_DEBUG_EVERY_T(SECONDS, FORMAT, ARGS...)
+#define BASE_LOG_DEBUG_ONCE(FORMAT, ARGS...)
 #define BASE_LOG_INFO(FORMAT, ARGS...)
+#define BASE_LOG_INFO_EVERY_N(N, FORMAT, ARGS...)
+#define BASE_LOG_INFO_EVERY_T(SECONDS, FORMAT, ARGS...)
+#define BASE_LOG_INFO_ONCE(FORMAT, ARGS...)
 #define BASE_LOG_WARN(FORMAT, ARGS...)
+#define BASE_LOG_WARN_EVERY_N(N, FORMAT, ARGS...)
+#define BASE_LOG_WARN_EVERY_T(SECONDS, FORMAT, ARGS...)
+#define BASE_LOG_WARN_ONCE(FORMAT, ARGS...)
 #define BASE_LOG_ERROR(FORMAT, ARGS...)
+#define BASE_LOG_ERROR_EVERY_N(N, FORMAT, ARGS...)
+#define BASE_LOG_ERROR_EVERY_T(SECONDS, FORMAT, ARGS...)
+#define BASE_LOG_ERROR_ONCE(FORMAT, ARGS...)
 #define BASE_LOG_FATAL(FORMAT, ARGS...)
+#define BASE_LOG_FATAL_EVERY_N(N, FORMAT, ARGS...)
+#define BASE_LOG_FATAL_EVERY_T(SECONDS, FORMAT, ARGS...)
+#define BASE_LOG_FATAL_ONCE(FORMAT, ARGS...)
 #define BASE_LOG_CONFIGURE(PRIO, STREAM)
 #else
 #define LOG_DEBUG(FORMAT, ARGS...)
+#define LOG_DEBUG_EVERY_N(N, FORMAT, ARGS...)
+#define LOG_DEBUG_EVERY_T(SECONDS, FORMAT, ARGS...)
+#define LOG_DEBUG_ONCE(FORMAT, ARGS...)
 #define LOG_INFO(FORMAT, ARGS...)
+#define LOG_INFO_EVERY_N(N, FORMAT, ARGS...)
+#define LOG_INFO_EVERY_T(SECONDS, FORMAT, ARGS...)
+#define LOG_INFO_ONCE(FORMAT, ARGS...)
 #define LOG_WARN(FORMAT, ARGS...)
+#define LOG_WARN_EVERY_N(N, FORMAT, ARGS...)
+#define LOG_WARN_EVERY_T(SECONDS, FORMAT, ARGS...)
+#define LOG_WARN_ONCE(FORMAT, ARGS...)
 #define LOG_ERROR(FORMAT, ARGS...)
+#define LOG_ERROR_EVERY_N(N, FORMAT, ARGS...)
+#define LOG_ERROR_EVERY_T(SECONDS, FORMAT, ARGS...)
+#define LOG_ERROR_ONCE(FORMAT, ARGS...)
 #define LOG_FATAL(FORMAT, ARGS...)
+#define LOG_FATAL_EVERY_N(N, FORMAT, ARGS...)
+#define LOG_FATAL_EVERY_T(SECONDS, FORMAT, ARGS...)
+#define LOG_FATAL_ONCE(FORMAT, ARGS...)
 #define LOG_CONFIGURE(PRIO, STREAM)
 #endif // BASE_LONG_NAMES
 
@@ -98,37 +140,81 @@
 // your CMakeLists.txt -DBASE_LOG_NAMESPACE=yournamespace
 //
 // Using __PRETTY_FUNCTION__ when using gcc otherwise __func__ to show current function
+//
+// Each statement has its own LogSite, which caches the runtime level of its
+// namespace. The arguments are only evaluated if the statement is enabled.
+//
+// The _EVERY_N, _EVERY_T and _ONCE variants only log every N-th time, at
+// most every SECONDS seconds, or only the first time the statement is
+// reached while enabled. The other statements are subject to the burst
+// suppression, see Logger::setBurstLimit
+//
+// With gcc, literal formats go to Logger::logLiteral, whose BINARY format
+// identifies them by their address. Other formats go to Logger::log
+#define __LOG_SITE(NAME) static ::base::logging::LogSite NAME = { __STRINGIFY(BASE_LOG_NAMESPACE), ::base::logging::LogSite::UNREGISTERED, 0, &::base::logging::LogSiteOwner::Instance<>::owner, __FILE__, __LINE__, 0, 0, 0, 0 }
 #ifdef __GNUC__
-#define __LOG(PRIO, FORMAT, ARGS ...) { ::base::logging::Logger::getInstance()->log(::base::logging::PRIO,__PRETTY_FUNCTION__, __FILE__, __LINE__, __STRINGIFY(BASE_LOG_NAMESPACE), FORMAT, ## ARGS); }
+#define __LOG_CALL(FORMAT) (__builtin_constant_p(FORMAT) ? &::base::logging::Logger::logLiteral : &::base::logging::Logger::log)
+#define __LOG_IF(PRIO, CONDITION, FORMAT, ARGS ...) { __LOG_SITE(base_log_site_); if(base_log_site_.enabled(::base::logging::PRIO) && (CONDITION)) (::base::logging::Logger::getInstance()->*__LOG_CALL(FORMAT))(::base::logging::PRIO,__PRETTY_FUNCTION__, __FILE__, __LINE__, __STRINGIFY(BASE_LOG_NAMESPACE), FORMAT, ## ARGS); }
 #else
-#define __LOG(PRIO, FORMAT, ARGS ...) { ::base::logging::Logger::getInstance()->log(::base::logging::PRIO,__func__, __FILE__, __LINE__, __STRINGIFY(BASE_LOG_NAMESPACE),  FORMAT, ## ARGS); }
+#define __LOG_IF(PRIO, CONDITION, FORMAT, ARGS ...) { __LOG_SITE(base_log_site_); if(base_log_site_.enabled(::base::logging::PRIO) && (CONDITION)) ::base::logging::Logger::getInstance()->log(::base::logging::PRIO,__func__, __FILE__, __LINE__, __STRINGIFY(BASE_LOG_NAMESPACE),  FORMAT, ## ARGS); }
 #endif
+#define __LOG(PRIO, FORMAT, ARGS ...) __LOG_IF(PRIO, base_log_site_.admit(::base::logging::PRIO), FORMAT, ## ARGS)
 
 #ifdef BASE_LONG_NAMES
 
 #if BASE_LOG_PRIORITY >= 1 
 #undef BASE_LOG_FATAL
 #define BASE_LOG_FATAL(FORMAT, ARGS...) __LOG(FATAL_P, FORMAT, ## ARGS)
+#undef BASE_LOG_FATAL_EVERY_N
+#define BASE_LOG_FATAL_EVERY_N(N, FORMAT, ARGS...) __LOG_IF(FATAL_P, base_log_site_.everyN(N), FORMAT, ## ARGS)
+#undef BASE_LOG_FATAL_EVERY_T
+#define BASE_LOG_FATAL_EVERY_T(SECONDS, FORMAT, ARGS...) __LOG_IF(FATAL_P, base_log_site_.everyT(SECONDS), FORMAT, ## ARGS)
+#undef BASE_LOG_FATAL_ONCE
+#define BASE_LOG_FATAL_ONCE(FORMAT, ARGS...) __LOG_IF(FATAL_P, base_log_site_.once(), FORMAT, ## ARGS)
 #endif
 
 #if BASE_LOG_PRIORITY >= 2
 #undef BASE_LOG_ERROR
 #define BASE_LOG_ERROR(FORMAT, ARGS...) __LOG(ERROR_P, FORMAT, ## ARGS)
+#undef BASE_LOG_ERROR_EVERY_N
+#define BASE_LOG_ERROR_EVERY_N(N, FORMAT, ARGS...) __LOG_IF(ERROR_P, base_log_site_.everyN(N), FORMAT, ## ARGS)
+#undef BASE_LOG_ERROR_EVERY_T
+#define BASE_LOG_ERROR_EVERY_T(SECONDS, FORMAT, ARGS...) __LOG_IF(ERROR_P, base_log_site_.everyT(SECONDS), FORMAT, ## ARGS)
+#undef BASE_LOG_ERROR_ONCE
+#define BASE_LOG_ERROR_ONCE(FORMAT, ARGS...) __LOG_IF(ERROR_P, base_log_site_.once(), FORMAT, ## ARGS)
 #endif
  
 #if BASE_LOG_PRIORITY >= 3
 #undef BASE_LOG_WARN
 #define BASE_LOG_WARN(FORMAT, ARGS...) __LOG(WARN_P, FORMAT, ## ARGS)
+#undef BASE_LOG_WARN_EVERY_N
+#define BASE_LOG_WARN_EVERY_N(N, FORMAT, ARGS...) __LOG_IF(WARN_P, base_log_site_.everyN(N), FORMAT, ## ARGS)
+#undef BASE_LOG_WARN_EVERY_T
+#define BASE_LOG_WARN_EVERY_T(SECONDS, FORMAT, ARGS...) __LOG_IF(WARN_P, base_log_site_.everyT(SECONDS), FORMAT, ## ARGS)
+#undef BASE_LOG_WARN_ONCE
+#define BASE_LOG_WARN_ONCE(FORMAT, ARGS...) __LOG_IF(WARN_P, base_log_site_.once(), FORMAT, ## ARGS)
 #endif
 
 #if BASE_LOG_PRIORITY >= 4 
 #undef BASE_LOG_INFO
 #define BASE_LOG_INFO(FORMAT, ARGS...) __LOG(INFO_P, FORMAT, ## ARGS)
+#undef BASE_LOG_INFO_EVERY_N
+#define BASE_LOG_INFO_EVERY_N(N, FORMAT, ARGS...) __LOG_IF(INFO_P, base_log_site_.everyN(N), FORMAT, ## ARGS)
+#undef BASE_LOG_INFO_EVERY_T
+#define BASE_LOG_INFO_EVERY_T(SECONDS, FORMAT, ARGS...) __LOG_IF(INFO_P, base_log_site_.everyT(SECONDS), FORMAT, ## ARGS)
+#undef BASE_LOG_INFO_ONCE
+#define BASE_LOG_INFO_ONCE(FORMAT, ARGS...) __LOG_IF(INFO_P, base_log_site_.once(), FORMAT, ## ARGS)
 #endif
 
 #if BASE_LOG_PRIORITY >= 5
 #undef BASE_LOG_DEBUG
 #define BASE_LOG_DEBUG(FORMAT, ARGS...) __LOG(DEBUG_P, FORMAT, ## ARGS)  
+#undef BASE_LOG_DEBUG_EVERY_N
+#define BASE_LOG_DEBUG_EVERY_N(N, FORMAT, ARGS...) __LOG_IF(DEBUG_P, base_log_site_.everyN(N), FORMAT, ## ARGS)
+#undef BASE_LOG_DEBUG_EVERY_T
+#define BASE_LOG_DEBUG_EVERY_T(SECONDS, FORMAT, ARGS...) __LOG_IF(DEBUG_P, base_log_site_.everyT(SECONDS), FORMAT, ## ARGS)
+#undef BASE_LOG_DEBUG_ONCE
+#define BASE_LOG_DEBUG_ONCE(FORMAT, ARGS...) __LOG_IF(DEBUG_P, base_log_site_.once(), FORMAT, ## ARGS)
 #endif
 
 #undef BASE_LOG_CONFIGURE
@@ -144,26 +230,56 @@
 #if BASE_LOG_PRIORITY >= 1 
 #undef LOG_FATAL
 #define LOG_FATAL(FORMAT, ARGS...) __LOG(FATAL_P, FORMAT, ## ARGS)
+#undef LOG_FATAL_EVERY_N
+#define LOG_FATAL_EVERY_N(N, FORMAT, ARGS...) __LOG_IF(FATAL_P, base_log_site_.everyN(N), FORMAT, ## ARGS)
+#undef LOG_FATAL_EVERY_T
+#define LOG_FATAL_EVERY_T(SECONDS, FORMAT, ARGS...) __LOG_IF(FATAL_P, base_log_site_.everyT(SECONDS), FORMAT, ## ARGS)
+#undef LOG_FATAL_ONCE
+#define LOG_FATAL_ONCE(FORMAT, ARGS...) __LOG_IF(FATAL_P, base_log_site_.once(), FORMAT, ## ARGS)
 #endif
 
 #if BASE_LOG_PRIORITY >= 2
 #undef LOG_ERROR
 #define LOG_ERROR(FORMAT, ARGS...) __LOG(ERROR_P, FORMAT, ## ARGS)
+#undef LOG_ERROR_EVERY_N
+#define LOG_ERROR_EVERY_N(N, FORMAT, ARGS...) __LOG_IF(ERROR_P, base_log_site_.everyN(N), FORMAT, ## ARGS)
+#undef LOG_ERROR_EVERY_T
+#define LOG_ERROR_EVERY_T(SECONDS, FORMAT, ARGS...) __LOG_IF(ERROR_P, base_log_site_.everyT(SECONDS), FORMAT, ## ARGS)
+#undef LOG_ERROR_ONCE
+#define LOG_ERROR_ONCE(FORMAT, ARGS...) __LOG_IF(ERROR_P, base_log_site_.once(), FORMAT, ## ARGS)
 #endif
  
 #if BASE_LOG_PRIORITY >= 3
 #undef LOG_WARN
 #define LOG_WARN(FORMAT, ARGS...) __LOG(WARN_P, FORMAT, ## ARGS)
+#undef LOG_WARN_EVERY_N
+#define LOG_WARN_EVERY_N(N, FORMAT, ARGS...) __LOG_IF(WARN_P, base_log_site_.everyN(N), FORMAT, ## ARGS)
+#undef LOG_WARN_EVERY_T
+#define LOG_WARN_EVERY_T(SECONDS, FORMAT, ARGS...) __LOG_IF(WARN_P, base_log_site_.everyT(SECONDS), FORMAT, ## ARGS)
+#undef LOG_WARN_ONCE
+#define LOG_WARN_ONCE(FORMAT, ARGS...) __LOG_IF(WARN_P, base_log_site_.once(), FORMAT, ## ARGS)
 #endif
 
 #if BASE_LOG_PRIORITY >= 4 
 #undef LOG_INFO
 #define LOG_INFO(FORMAT, ARGS...) __LOG(INFO_P, FORMAT, ## ARGS)
+#undef LOG_INFO_EVERY_N
+#define LOG_INFO_EVERY_N(N, FORMAT, ARGS...) __LOG_IF(INFO_P, base_log_site_.everyN(N), FORMAT, ## ARGS)
+#undef LOG_INFO_EVERY_T
+#define LOG_INFO_EVERY_T(SECONDS, FORMAT, ARGS...) __LOG_IF(INFO_P, base_log_site_.everyT(SECONDS), FORMAT, ## ARGS)
+#undef LOG_INFO_ONCE
+#define LOG_INFO_ONCE(FORMAT, ARGS...) __LOG_IF(INFO_P, base_log_site_.once(), FORMAT, ## ARGS)
 #endif
 
 #if BASE_LOG_PRIORITY >= 5
 #undef LOG_DEBUG
 #define LOG_DEBUG(FORMAT, ARGS...) __LOG(DEBUG_P, FORMAT, ## ARGS)  
+#undef LOG_DEBUG_EVERY_N
+#define LOG_DEBUG_EVERY_N(N, FORMAT, ARGS...) __LOG_IF(DEBUG_P, base_log_site_.everyN(N), FORMAT, ## ARGS)
+#undef LOG_DEBUG_EVERY_T
+#define LOG_DEBUG_EVERY_T(SECONDS, FORMAT, ARGS...) __LOG_IF(DEBUG_P, base_log_site_.everyT(SECONDS), FORMAT, ## ARGS)
+#undef LOG_DEBUG_ONCE
+#define LOG_DEBUG_ONCE(FORMAT, ARGS...) __LOG_IF(DEBUG_P, base_log_site_.once(), FORMAT, ## ARGS)
 #endif
 
 #endif // BASE_LONG_NAMES
@@ -175,6 +291,11 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <vector>
+#include <set>
+#include <map>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/time.h>
 #include <base/Singleton.hpp>
 
 namespace base {
@@ -192,7 +313,120 @@ enum Priority	{ UNKNOWN = 0, UNKNOWN_P = 0, FATAL = 1, FATAL_P =1, ERROR = 2, ER
 #endif
  
 
-enum LogFormat	{ DEFAULT = 0, MULTILINE, SHORT};
+/**
+* BINARY writes the raw arguments instead of formatting the messages, see
+* logging_binary.h. PATTERN uses the layout given to Logger::setLogPattern
+*/
+enum LogFormat	{ DEFAULT = 0, MULTILINE, SHORT, BINARY, PATTERN };
+
+/**
+ * In SYNC mode, messages are formatted and written by the thread that logs
+ * them. In the ASYNC modes, the thread only formats the message into a
+ * preallocated queue entry, and a background thread adds the timestamp
+ * and writes it. If the queue is full, messages are dropped in ASYNC mode
+ * and the logging thread waits in ASYNC_BLOCK mode.
+ */
+enum LogMode	{ SYNC = 0, ASYNC, ASYNC_BLOCK };
+
+class LogQueue;
+class LogSink;
+
+#ifdef __GNUC__
+#define BASE_LOG_HIDDEN __attribute__((visibility("hidden")))
+#else
+#define BASE_LOG_HIDDEN
+#endif
+
+/**
+ * Unregisters the LogSites of a shared object from the Logger when it is
+ * unloaded, e.g. with dlclose, or when the program exits
+ *
+ * Each shared object has its own hidden instance, Instance<>::owner, which
+ * the sites of its statements point to. This keeps the sites trivially
+ * destructible, so that they are constant-initialized without a guard.
+ */
+struct LogSiteOwner
+{
+    /** True if a site of this owner is registered with the Logger. Cleared
+     * by the Logger when it is destroyed */
+    bool registered;
+
+    ~LogSiteOwner();
+
+    template<typename T = void>
+    struct BASE_LOG_HIDDEN Instance
+    {
+        static LogSiteOwner owner;
+    };
+};
+
+template<typename T> LogSiteOwner LogSiteOwner::Instance<T>::owner;
+
+/**
+ * Cached level check of a log statement, defined by the logging macros for
+ * each call site
+ *
+ * Once the site is registered with the Logger, level holds the runtime
+ * level of its namespace and is updated by the Logger whenever the levels
+ * change. Checking whether the statement is enabled is then a single
+ * relaxed load and comparison.
+ *
+ * The site is a trivially destructible aggregate, its owner unregisters it.
+ */
+struct LogSite
+{
+    /** Level of a site that is not registered yet. It is above all
+     * priorities, so that the first check goes to the slow path */
+    enum { UNREGISTERED = ENDPRIORITIES };
+
+    const char* name_space;
+    int level;
+    LogSite* next;
+    LogSiteOwner* owner;
+    const char* file;
+    int line;
+    /** State of the _EVERY_N, _EVERY_T and _ONCE variants */
+    uint64_t counter;
+    /** State of the burst suppression */
+    int64_t window_start;
+    unsigned int window_count;
+    unsigned int suppressed;
+
+    /** True if messages with this priority should be logged */
+    inline bool enabled(Priority priority);
+
+    /** True every n-th call, starting with the first one */
+    bool everyN(unsigned int n)
+    {
+        return n <= 1 || __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED) % n == 0;
+    }
+
+    /** True if the last call that returned true is at least \c seconds
+     * old */
+    bool everyT(double seconds);
+
+    /** True on the first call only */
+    bool once()
+    {
+        return __atomic_load_n(&counter, __ATOMIC_RELAXED) == 0
+            && __atomic_exchange_n(&counter, 1, __ATOMIC_RELAXED) == 0;
+    }
+
+    /** Applies the burst suppression, see Logger::setBurstLimit */
+    bool admit(Priority priority)
+    {
+        return !__atomic_load_n(&burst_limit, __ATOMIC_RELAXED) || admitBurst(priority);
+    }
+
+    /** Maximum number of messages per site and burst window, 0 if the burst
+     * suppression is disabled. Set by Logger::setBurstLimit */
+    static unsigned int burst_limit;
+    /** Duration of the burst window in microseconds */
+    static int64_t burst_window;
+
+private:
+    bool admitBurst(Priority priority);
+};
 
 /**
  * @class Logger
@@ -234,9 +468,120 @@ public:
         * If no previous configuration is given, no output logging will be done
         */
         void configure(Priority priority, FILE* outputStream);
+
+        /**
+        * Configure logger and select the logging mode. The mode given by the
+        * BASE_LOG_MODE environment variable takes precedence.
+        * Must not be called concurrently with logging
+        * @param queueSize the number of messages the queue can hold in the
+        * ASYNC modes
+        */
+        void configure(Priority priority, FILE* outputStream, LogMode mode, size_t queueSize = 1024);
+
+        /**
+        * Blocks until all messages logged so far have been written. Does
+        * nothing in SYNC mode
+        */
+        void flush();
+
+        /**
+        * Selects the output format. Overrides BASE_LOG_FORMAT. In BINARY
+        * format, the stream should not contain anything else and is not
+        * flushed after each message in SYNC mode
+        * Must not be called concurrently with logging
+        */
+        void setLogFormat(LogFormat format);
+
+        /**
+        * Selects the PATTERN format with the given layout. A newline is
+        * appended to each message. The pattern can also be given in the
+        * BASE_LOG_PATTERN environment variable. It is parsed once, and
+        * recognizes
+        *   %t time, %p priority, %f function, %m message, %F file,
+        *   %L line, %n namespace, %c and %C start and end of the color,
+        *   %% a percent sign
+        * e.g. the DEFAULT format is "[%t] %c[%p] - %n::%m%C (%F:%L - %f)".
+        * If the format already is PATTERN, can be called while other
+        * threads log, which use either the previous or the new pattern.
+        * Otherwise, it switches the format and must not be called
+        * concurrently with logging, like setLogFormat
+        */
+        void setLogPattern(const std::string& pattern);
+
+        /**
+        * Enables the burst suppression: a log statement that emits more than
+        * \c messages messages within \c seconds gets muted until the end
+        * of this window. The first message after that is preceded by a
+        * summary with the number of suppressed messages. The limit can also
+        * be given as "messages/seconds" in BASE_LOG_BURST_LIMIT.
+        * Disabled by default, and by a limit of 0. The _EVERY_N, _EVERY_T
+        * and _ONCE variants are not affected
+        */
+        void setBurstLimit(unsigned int messages, double seconds = 1.0);
+
+        /**
+        * Adds a sink that receives every message, in addition to the
+        * stream, see logging_sinks.h. The sink is not owned by the logger.
+        * Must not be called concurrently with logging
+        */
+        void addSink(LogSink* sink);
+
+        /**
+        * Removes a sink added with addSink.
+        * Must not be called concurrently with logging
+        */
+        void removeSink(LogSink* sink);
+
+        /**
+        * Enables or disables the output to the stream given to configure,
+        * e.g. to only log to sinks. Enabled by default.
+        * Must not be called concurrently with logging
+        */
+        void setStreamEnabled(bool enabled);
+
+        /**
+        * Sets the level of the namespaces that have no level of their own.
+        * Unlike configure, this overrides BASE_LOG_LEVEL
+        */
+        void setLogLevel(Priority priority);
+
+        /**
+        * Sets the level of a single namespace, i.e. of the statements
+        * compiled with BASE_LOG_NAMESPACE=name_space. Can be called while
+        * other threads log
+        */
+        void setLogLevel(const std::string& name_space, Priority priority);
+
+        /**
+        * Makes the namespace use the default level again
+        */
+        void clearLogLevel(const std::string& name_space);
+
+        /**
+        * Returns the level used for the given namespace
+        */
+        Priority getLogLevel(const std::string& name_space);
+
+        /**
+        * Registers a call site, so that its level gets updated when the
+        * levels change. Called by LogSite on its first use
+        * @returns the level of the site
+        */
+        int registerSite(LogSite& site);
+
+        /**
+        * Removes the call sites of the given owner registered with
+        * registerSite. Called by the destructor of LogSiteOwner
+        */
+        void unregisterSites(LogSiteOwner& owner);
 	
 	/**
 	* Logs a message with a given priority, can be used with printf style format
+	* The per-namespace levels are checked by the logging macros. This
+	* method only discards the messages that no namespace would log
+	*
+	* The strings may be temporary, the ASYNC modes copy them. In the BINARY
+	* format, the message is formatted as text when logging, see logLiteral
 	* @param priority priority level
         * @param ns namespace to be used
         * @param filename Filename
@@ -246,18 +591,54 @@ public:
 	*/
 	void log(Priority priority, const char* function, const char* filename, int line, const char* name_space, const char* format, ...);
 
+	/**
+	* Same as log, for a format, function, file and namespace that stay
+	* valid and unchanged while the program runs, e.g. literals. The BINARY
+	* format then only writes the format once and identifies it by its
+	* address, and the ASYNC modes do not copy them. Used by the LOG_* macros
+	* for literal formats
+	*/
+	void logLiteral(Priority priority, const char* function, const char* filename, int line, const char* name_space, const char* format, ...);
+
 	/**
 	 * used by log(...)
 	 * logs the text contained in buffer.
 	 */
 	void logBuffer(Priority priority, const char* function, const char* file, int line, const char* name_space, const char* buffer);
 
+	/**
+	 * Same as logBuffer, for function, file and namespace strings that stay
+	 * valid while the program runs, which the ASYNC modes then do not copy.
+	 * Used by the LOG_*_S macros
+	 */
+	void logLiteralBuffer(Priority priority, const char* function, const char* file, int line, const char* name_space, const char* buffer);
+
 private:
         /**
         * Retrieve the log level from the enviroment
         */
         Priority getLogLevelFromEnv();
 
+        /**
+        * Retrieve the namespace=level pairs of BASE_LOG_LEVEL
+        */
+        void getNamespaceLevelsFromEnv();
+
+        /**
+        * Converts a level name, returns UNKNOWN_P if it is not known
+        */
+        Priority parseLogLevel(std::string name);
+
+        /**
+        * Returns the level of the namespace, mSitesMutex must be locked
+        */
+        Priority getLogLevelLocked(const std::string& name_space);
+
+        /**
+        * Propagates a level change to all the registered sites
+        */
+        void updateSites();
+
         /**
         * Retrieve log level from the enviroment variable BASE_LOG_TYPE
         * Get log color from enviroment
@@ -269,17 +650,134 @@ private:
         */
         LogFormat getLogFormatFromEnv();
 
+        /** 
+        * Retrieve log mode from the enviroment variable BASE_LOG_MODE
+        */
+        LogMode getLogModeFromEnv(LogMode defaultMode);
+
+        /**
+        * Starts or stops the background thread
+        */
+        void setLogMode(LogMode mode, size_t queueSize);
+
+        /**
+        * Formats a message once in the given format, and writes it to the
+        * stream if toStream is set and to all sinks
+        */
+        void writeFormatted(LogFormat format, bool toStream, Priority priority, const char* function, const char* file, int line, const char* name_space, const char* buffer, const struct timeval& tv);
+
+        enum PatternToken { PATTERN_LITERAL, PATTERN_TIME, PATTERN_PRIORITY, PATTERN_FUNCTION, PATTERN_MESSAGE,
+            PATTERN_FILE, PATTERN_LINE, PATTERN_NAMESPACE, PATTERN_COLOR, PATTERN_COLOR_END };
+
+        struct PatternElement
+        {
+            PatternToken token;
+            std::string literal;
+        };
+
+        /**
+        * Parses a pattern, see setLogPattern
+        */
+        static std::vector<PatternElement> compilePattern(const std::string& pattern);
+
+        /**
+        * Flushes the stream and the sinks
+        */
+        void flushOutputs();
+
+        /**
+        * Implements log and logLiteral. literal tells whether the format,
+        * function, file and namespace strings stay valid while the program
+        * runs, so that they do not need to be copied
+        */
+        void logArguments(bool literal, Priority priority, const char* function, const char* file, int line, const char* name_space, const char* format, va_list arguments);
+
+        /**
+        * Implements logBuffer and logLiteralBuffer, see logArguments
+        */
+        void logBufferNames(bool literal, Priority priority, const char* function, const char* file, int line, const char* name_space, const char* buffer);
+
+        /**
+        * Formats and writes a message, without flushing the stream
+        */
+        void writeMessage(Priority priority, const char* function, const char* file, int line, const char* name_space, const char* buffer, const struct timeval& tv);
+
+        /**
+        * Writes a binary message record, see logging_binary.h. literalNames
+        * tells whether the function, file and namespace strings stay valid
+        * and unchanged while the program runs
+        */
+        void writeBinary(Priority priority, bool literalNames, const char* function, const char* file, int line, const char* name_space, const char* format, const char* arguments, size_t size, const struct timeval& tv);
+
+        /**
+        * Writes the string record for str, if it has not been written yet
+        */
+        void writeBinaryString(const char* str);
+
+        /**
+        * Writes a string record with the given id
+        */
+        void writeBinaryString(uint64_t id, const char* str);
+
+        /**
+        * Logs that messages got dropped in the ASYNC mode
+        */
+        void logDropped(uint64_t count);
+
+        static void* asyncThread(void* logger);
+
         FILE* mStream;
         std::vector<std::string> mPriorityNames;
         Priority mPriority;
+        /** The most verbose of all levels, accessed atomically */
+        int mMaxPriority;
+        std::map<std::string, Priority> mNamespacePriorities;
+        /** Protects the levels, the list of registered sites and the
+         * replaced patterns */
+        pthread_mutex_t mSitesMutex;
+        LogSite* mSites;
 
         const char* mpLogColor[ENDPRIORITIES];
         const char* mpColorEnd;
 
         std::vector<std::string> mLogFormatNames;
         LogFormat mLogFormat;
+
+        std::vector<std::string> mLogModeNames;
+        LogMode mLogMode;
+        LogQueue* mQueue;
+        pthread_t mThread;
+
+        FILE* mBinaryStream;
+        std::set<const char*> mBinaryStrings;
+        /** The function, file and namespace strings last written with the
+         * ids 1, 2 and 3, for the messages whose strings are not literals */
+        std::string mBinaryNames[3];
+
+        bool mStreamEnabled;
+        std::vector<LogSink*> mSinks;
+
+        /** The compiled layout of DEFAULT, MULTILINE and SHORT */
+        std::vector<PatternElement> mPatterns[PATTERN];
+        /** The compiled layout of PATTERN, replaced atomically by
+         * setLogPattern. The replaced layouts may still be used by a thread
+         * formatting a message, and are deleted with the logger */
+        std::vector<PatternElement>* mUserPattern;
+        std::vector< std::vector<PatternElement>* > mRetiredPatterns;
+        /** The priority names, right-aligned on 5 characters */
+        std::vector<std::string> mPaddedPriorityNames;
 };
 
+bool LogSite::enabled(Priority priority)
+{
+    int current = __atomic_load_n(&level, __ATOMIC_RELAXED);
+    if(priority > current)
+        return false;
+    if(current == UNREGISTERED)
+        return priority <= Logger::getInstance()->registerSite(*this);
+    return true;
+}
+
 } // end namespace
 } // end namespace
 
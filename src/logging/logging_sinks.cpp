@@ -0,0 +1,257 @@
+/*
+ * @file logging_sinks.cpp
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "logging_sinks.h"
+
+namespace base {
+namespace logging {
+
+MemoryLogSink::MemoryLogSink(size_t maxMessages)
+    : mMaxMessages(maxMessages)
+{
+    pthread_mutex_init(&mMutex, 0);
+}
+
+MemoryLogSink::~MemoryLogSink()
+{
+    pthread_mutex_destroy(&mMutex);
+}
+
+void MemoryLogSink::write(Priority /*priority*/, const char* message, size_t size)
+{
+    pthread_mutex_lock(&mMutex);
+    if(mMaxMessages && mMessages.size() == mMaxMessages)
+        mMessages.pop_front();
+    mMessages.push_back(std::string(message, size));
+    pthread_mutex_unlock(&mMutex);
+}
+
+std::vector<std::string> MemoryLogSink::getMessages() const
+{
+    pthread_mutex_lock(&mMutex);
+    std::vector<std::string> result(mMessages.begin(), mMessages.end());
+    pthread_mutex_unlock(&mMutex);
+    return result;
+}
+
+void MemoryLogSink::clear()
+{
+    pthread_mutex_lock(&mMutex);
+    mMessages.clear();
+    pthread_mutex_unlock(&mMutex);
+}
+
+UnixDatagramLogSink::UnixDatagramLogSink(const std::string& path, bool syslogHeader)
+    : mSyslogHeader(syslogHeader), mDropped(0)
+{
+    memset(&mAddress, 0, sizeof(mAddress));
+    mAddress.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(mAddress.sun_path))
+        throw std::runtime_error("UnixDatagramLogSink: socket path too long: " + path);
+    strcpy(mAddress.sun_path, path.c_str());
+
+    mSocket = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if(mSocket < 0)
+        throw std::runtime_error(std::string("UnixDatagramLogSink: cannot create socket: ") + strerror(errno));
+    fcntl(mSocket, F_SETFD, FD_CLOEXEC);
+}
+
+UnixDatagramLogSink::~UnixDatagramLogSink()
+{
+    close(mSocket);
+}
+
+void UnixDatagramLogSink::write(Priority priority, const char* message, size_t size)
+{
+    // Datagrams carry their own boundaries
+    if(size && message[size - 1] == '\n')
+        --size;
+
+    // Facility user (1), and the closest syslog severity
+    static const int severities[ENDPRIORITIES] = { 5, 2, 3, 4, 6, 7 };
+    char header[8];
+    int headerSize = 0;
+    if(mSyslogHeader)
+        headerSize = snprintf(header, sizeof(header), "<%d>", 8 + severities[priority]);
+
+    struct iovec parts[2];
+    parts[0].iov_base = header;
+    parts[0].iov_len = headerSize;
+    parts[1].iov_base = const_cast<char*>(message);
+    parts[1].iov_len = size;
+
+    struct msghdr datagram;
+    memset(&datagram, 0, sizeof(datagram));
+    datagram.msg_name = &mAddress;
+    datagram.msg_namelen = sizeof(mAddress);
+    datagram.msg_iov = parts;
+    datagram.msg_iovlen = 2;
+    if(sendmsg(mSocket, &datagram, MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+        __atomic_add_fetch(&mDropped, 1, __ATOMIC_RELAXED);
+}
+
+uint64_t UnixDatagramLogSink::getDropped() const
+{
+    return __atomic_load_n(&mDropped, __ATOMIC_RELAXED);
+}
+
+static const char MAPPED_RING_MAGIC[8] = { 'B', 'A', 'S', 'E', 'R', 'I', 'N', 'G' };
+
+struct MappedRingLogSink::Header
+{
+    char magic[8];
+    uint64_t capacity;
+    /** Number of bytes written since the creation of the file */
+    uint64_t position;
+    char padding[40];
+};
+
+/** Size of the bitmap of the message starts, in bytes */
+static size_t startsSize(uint64_t capacity)
+{
+    return (capacity + 63) / 64 * sizeof(uint64_t);
+}
+
+MappedRingLogSink::MappedRingLogSink(const std::string& path, size_t capacity)
+    : mCapacity(std::max<size_t>(capacity, 1))
+    , mMappedSize(sizeof(Header) + startsSize(mCapacity) + mCapacity)
+{
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0)
+        throw std::runtime_error("MappedRingLogSink: cannot open " + path + ": " + strerror(errno));
+    if(ftruncate(fd, mMappedSize) != 0)
+    {
+        std::string error = strerror(errno);
+        close(fd);
+        throw std::runtime_error("MappedRingLogSink: cannot resize " + path + ": " + error);
+    }
+
+    void* mapping = mmap(0, mMappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED)
+        throw std::runtime_error("MappedRingLogSink: cannot map " + path + ": " + strerror(errno));
+
+    mHeader = static_cast<Header*>(mapping);
+    mStarts = reinterpret_cast<uint64_t*>(static_cast<char*>(mapping) + sizeof(Header));
+    mData = static_cast<char*>(mapping) + sizeof(Header) + startsSize(mCapacity);
+    memcpy(mHeader->magic, MAPPED_RING_MAGIC, sizeof(MAPPED_RING_MAGIC));
+    mHeader->capacity = mCapacity;
+    mHeader->position = 0;
+}
+
+MappedRingLogSink::~MappedRingLogSink()
+{
+    munmap(mHeader, mMappedSize);
+}
+
+void MappedRingLogSink::clearStarts(size_t offset, size_t size)
+{
+    while(size)
+    {
+        size_t bit = offset % 64;
+        size_t count = std::min<size_t>(size, 64 - bit);
+        uint64_t mask = (count == 64 ? ~uint64_t(0) : ((uint64_t(1) << count) - 1)) << bit;
+        __atomic_fetch_and(&mStarts[offset / 64], ~mask, __ATOMIC_RELAXED);
+        offset += count;
+        size -= count;
+    }
+}
+
+void MappedRingLogSink::write(Priority /*priority*/, const char* message, size_t size)
+{
+    if(size == 0 || size > mCapacity)
+        return;
+
+    // Concurrent writers get disjoint ranges
+    uint64_t start = __atomic_fetch_add(&mHeader->position, size, __ATOMIC_RELAXED);
+    size_t offset = start % mCapacity;
+    size_t first = std::min(size, mCapacity - offset);
+
+    // The range is cleared and marked as a message start before the copy,
+    // so that read() drops the message if the copy does not complete, e.g.
+    // on a crash. The fences keep the compiler from merging the steps
+    memset(mData + offset, 0, first);
+    memset(mData, 0, size - first);
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    clearStarts(offset, first);
+    clearStarts(0, size - first);
+    __atomic_fetch_or(&mStarts[offset / 64], uint64_t(1) << (offset % 64), __ATOMIC_RELAXED);
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+    memcpy(mData + offset, message, first);
+    memcpy(mData, message + first, size - first);
+}
+
+bool MappedRingLogSink::read(const std::string& path, std::string& text)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if(!file)
+        return false;
+
+    Header header;
+    std::vector<uint64_t> starts;
+    std::vector<char> data;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1
+        && !memcmp(header.magic, MAPPED_RING_MAGIC, sizeof(MAPPED_RING_MAGIC))
+        && header.capacity > 0;
+    if(valid)
+    {
+        starts.resize(startsSize(header.capacity) / sizeof(uint64_t));
+        data.resize(header.capacity);
+        valid = fread(&starts[0], startsSize(header.capacity), 1, file) == 1
+            && fread(&data[0], data.size(), 1, file) == 1;
+    }
+    fclose(file);
+    if(!valid)
+        return false;
+
+    // The oldest byte is at the write position once the ring wrapped
+    size_t offset = 0;
+    size_t size = header.position;
+    if(header.position > header.capacity)
+    {
+        offset = header.position % header.capacity;
+        size = header.capacity;
+    }
+
+    // Bytes are kept from a message start on. This skips the message whose
+    // beginning got overwritten. Zeros are a range whose copy did not
+    // complete, the message they are in is dropped
+    text.clear();
+    size_t messageStart = 0;
+    bool skip = true;
+    for(size_t i = 0; i < size; ++i)
+    {
+        size_t index = (offset + i) % header.capacity;
+        if(data[index] == '\0')
+        {
+            text.resize(messageStart);
+            skip = true;
+            continue;
+        }
+        if(starts[index / 64] & (uint64_t(1) << (index % 64)))
+        {
+            messageStart = text.size();
+            skip = false;
+        }
+        if(!skip)
+            text += data[index];
+    }
+    return true;
+}
+
+} // end namespace logging
+} // end namespace base
@@ -0,0 +1,167 @@
+/*
+ * @file logging_sinks.h
+ *
+ * @brief Additional outputs of the Logger
+ * @details Sinks registered with Logger::addSink receive every message once
+ * it is formatted, in addition to the stream given to configure (which can
+ * be disabled with Logger::setStreamEnabled). The message is formatted only
+ * once for all the outputs.
+ *
+ * In the BINARY format, the sinks receive the messages in the DEFAULT text
+ * format.
+ */
+
+#ifndef _BASE_LOGGING_SINKS_H_
+#define _BASE_LOGGING_SINKS_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/un.h>
+#include <base/logging/logging_printf_style.h>
+
+namespace base {
+
+namespace logging {
+
+class LogSink
+{
+public:
+    virtual ~LogSink() {}
+
+    /**
+     * Called once per message with the formatted text, including the
+     * trailing newline. In SYNC mode, it is called concurrently by the
+     * logging threads
+     */
+    virtual void write(Priority priority, const char* message, size_t size) = 0;
+
+    /**
+     * Called whenever the logger flushes its stream
+     */
+    virtual void flush() {}
+};
+
+/**
+ * Keeps the messages in memory, e.g. to check them in tests
+ */
+class MemoryLogSink : public LogSink
+{
+public:
+    /**
+     * @param maxMessages the number of messages kept, the oldest ones being
+     * dropped. 0 keeps all of them
+     */
+    explicit MemoryLogSink(size_t maxMessages = 0);
+    ~MemoryLogSink();
+
+    void write(Priority priority, const char* message, size_t size);
+
+    /** Returns a copy of the messages, oldest first */
+    std::vector<std::string> getMessages() const;
+
+    void clear();
+
+private:
+    MemoryLogSink(const MemoryLogSink&);
+    MemoryLogSink& operator =(const MemoryLogSink&);
+
+    mutable pthread_mutex_t mMutex;
+    std::deque<std::string> mMessages;
+    size_t mMaxMessages;
+};
+
+/**
+ * Sends each message as a datagram to a Unix socket, for a local collector
+ *
+ * Sending never blocks: messages are dropped when the collector does not
+ * keep up or is not running. With the syslog header, each datagram starts
+ * with the <PRI> field of the syslog protocol (facility user), so that
+ * messages can be sent to /dev/log.
+ */
+class UnixDatagramLogSink : public LogSink
+{
+public:
+    /**
+     * \throws std::runtime_error if the path is too long or the socket
+     * cannot be created
+     */
+    explicit UnixDatagramLogSink(const std::string& path, bool syslogHeader = false);
+    ~UnixDatagramLogSink();
+
+    void write(Priority priority, const char* message, size_t size);
+
+    /** Returns the number of messages that could not be sent */
+    uint64_t getDropped() const;
+
+private:
+    UnixDatagramLogSink(const UnixDatagramLogSink&);
+    UnixDatagramLogSink& operator =(const UnixDatagramLogSink&);
+
+    int mSocket;
+    struct sockaddr_un mAddress;
+    bool mSyslogHeader;
+    uint64_t mDropped;
+};
+
+/**
+ * Writes the messages into a ring buffer in a memory-mapped file
+ *
+ * Writing a message is a copy into the mapping, without any system call.
+ * The content is in the page cache, so it survives a crash of the process
+ * and the file can be inspected afterwards with read() or with
+ * base-log-decode --ring. It is meant to keep an always-on DEBUG history at
+ * little cost.
+ *
+ * The file starts with a 64-byte header (the magic "BASERING", the capacity
+ * and the number of bytes written so far, as native uint64), followed by a
+ * bitmap of the message starts in the ring (one bit per byte, in native
+ * uint64 words) and by the ring of \c capacity bytes of text.
+ *
+ * A writer clears its range before copying its message, so that a message
+ * left incomplete by a crash is dropped. Only a crash between the
+ * reservation of the range and its clearing can leave bytes of the previous
+ * lap in the ring.
+ */
+class MappedRingLogSink : public LogSink
+{
+public:
+    /**
+     * Creates (or truncates) the file and maps it
+     * \throws std::runtime_error if the file cannot be created or mapped
+     */
+    MappedRingLogSink(const std::string& path, size_t capacity);
+    ~MappedRingLogSink();
+
+    /** Messages larger than the capacity are dropped */
+    void write(Priority priority, const char* message, size_t size);
+
+    /**
+     * Reads the text of a ring file, oldest message first. A message that
+     * got partially overwritten, or whose copy did not complete, is skipped
+     * @returns false if the file is not a ring file
+     */
+    static bool read(const std::string& path, std::string& text);
+
+private:
+    MappedRingLogSink(const MappedRingLogSink&);
+    MappedRingLogSink& operator =(const MappedRingLogSink&);
+
+    struct Header;
+
+    /** Clears the message start bits of a range of the ring */
+    void clearStarts(size_t offset, size_t size);
+
+    Header* mHeader;
+    uint64_t* mStarts;
+    char* mData;
+    size_t mCapacity;
+    size_t mMappedSize;
+};
+
+} // end namespace logging
+} // end namespace base
+
+#endif /* _BASE_LOGGING_SINKS_H_ */
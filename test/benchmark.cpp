@@ -1,7 +1,32 @@
 #include <base/TimeMark.hpp>
+#include <base/Singleton.hpp>
+#include <base/samples/DepthMap.hpp>
+#include <base/samples/DepthMapFeatures.hpp>
+#include <base/samples/DistanceImage.hpp>
 #include <iostream>
+#include <sstream>
+#include <pthread.h>
 #include "bench_func.h"
 
+class BenchmarkSingleton : public base::Singleton<BenchmarkSingleton>
+{
+    friend class base::Singleton<BenchmarkSingleton>;
+    BenchmarkSingleton() : value(1) {}
+public:
+    int value;
+};
+
+static const int singleton_count = 100000000;
+
+static void* getInstanceLoop(void* result)
+{
+    int sum = 0;
+    for( int i=0; i<singleton_count; i++ )
+	sum += BenchmarkSingleton::getInstance()->value;
+    *static_cast<int*>(result) = sum;
+    return 0;
+}
+
 int main()
 {
     const int count = 100000000;
@@ -78,5 +103,147 @@ int main()
 	    mult_tt4(TransformDoubleNoAlign::Identity(), TransformDoubleNoAlign::Identity());
 	std::cerr << t << std::endl;
     }
-}
 
+    const int time_count = 1000000;
+    base::Time time = base::Time::now();
+    base::Time step = base::Time::fromMicroseconds(1013);
+    {
+	base::TimeMark t("Time::toString");
+	for( int i=0; i<time_count; i++ )
+	    (time + step * i).toString(base::Time::Microseconds, "%Y%m%d-%H:%M:%S ");
+	std::cerr << t << std::endl;
+    }
+    {
+	base::TimeMark t("Time::toChars");
+	char buffer[base::Time::MaxStringLength];
+	for( int i=0; i<time_count; i++ )
+	    (time + step * i).toChars(buffer, sizeof(buffer));
+	std::cerr << t << std::endl;
+    }
+    {
+	base::TimeMark t("Time::toISO8601");
+	char buffer[base::Time::MaxStringLength];
+	for( int i=0; i<time_count; i++ )
+	    (time + step * i).toISO8601(buffer, sizeof(buffer));
+	std::cerr << t << std::endl;
+    }
+    {
+	std::string str = time.toString();
+	base::TimeMark t("Time::fromString");
+	for( int i=0; i<time_count; i++ )
+	    base::Time::fromString(str + " ", base::Time::Seconds, "%Y%m%d-%H:%M:%S ");
+	std::cerr << t << std::endl;
+    }
+    {
+	char buffer[base::Time::MaxStringLength];
+	size_t length = time.toChars(buffer, sizeof(buffer));
+	base::TimeMark t("Time::fromChars");
+	for( int i=0; i<time_count; i++ )
+	    base::Time::fromChars(buffer, length);
+	std::cerr << t << std::endl;
+    }
+
+    for( int thread_count=1; thread_count<=8; thread_count*=2 )
+    {
+	std::ostringstream name;
+	name << "Singleton::getInstance, " << thread_count << " threads";
+	base::TimeMark t(name.str());
+	pthread_t threads[8];
+	int results[8];
+	for( int i=0; i<thread_count; i++ )
+	    pthread_create(&threads[i], 0, getInstanceLoop, &results[i]);
+	for( int i=0; i<thread_count; i++ )
+	    pthread_join(threads[i], 0);
+	std::cerr << t << std::endl;
+    }
+
+    base::samples::DepthMap depth_map;
+    depth_map.vertical_size = 64;
+    depth_map.horizontal_size = 16384;
+    depth_map.vertical_interval.push_back(0.2);
+    depth_map.vertical_interval.push_back(-0.4);
+    depth_map.horizontal_interval.push_back(M_PI);
+    depth_map.horizontal_interval.push_back(M_PI);
+    depth_map.distances.resize(depth_map.vertical_size * depth_map.horizontal_size);
+    for( size_t i=0; i<depth_map.distances.size(); i++ )
+	depth_map.distances[i] = (i % 97 == 0) ? 0.0 : 1.0 + 0.001 * (i % 1000);
+    std::vector<Eigen::Vector3d> depth_map_points;
+    {
+	base::TimeMark t("DepthMap::convertDepthMapToPointCloud, 1M points");
+	for( int i=0; i<10; i++ )
+	    depth_map.convertDepthMapToPointCloud(depth_map_points, Eigen::Affine3d::Identity(), true);
+	std::cerr << t << std::endl;
+    }
+    {
+	base::samples::DepthMapProjector<double> projector;
+	base::TimeMark t("DepthMapProjector::convertDepthMapToPointCloud, 1M points");
+	for( int i=0; i<10; i++ )
+	    projector.convertDepthMapToPointCloud(depth_map, depth_map_points, Eigen::Affine3d::Identity(), true);
+	std::cerr << t << std::endl;
+    }
+    {
+	base::samples::DepthMapProjector<double> projector;
+	base::samples::PointcloudArrays arrays;
+	base::TimeMark t("DepthMapProjector::convertDepthMapToPointCloud, 1M points into arrays");
+	for( int i=0; i<10; i++ )
+	    projector.convertDepthMapToPointCloud(depth_map, arrays, Eigen::Affine3d::Identity(), true);
+	std::cerr << t << std::endl;
+    }
+    {
+	base::samples::DepthMapProjector<double> projector;
+	base::samples::DepthMapView view = base::samples::DepthMapView::stride(depth_map, 1, 4);
+	base::TimeMark t("DepthMapProjector::convertDepthMapToPointCloud, view of every 4th column");
+	for( int i=0; i<10; i++ )
+	    projector.convertDepthMapToPointCloud(view, depth_map_points, Eigen::Affine3d::Identity(), true);
+	std::cerr << t << std::endl;
+    }
+    {
+	base::samples::DepthMapStatistics statistics;
+	base::TimeMark t("DepthMap::computeStatistics, 1M points");
+	for( int i=0; i<10; i++ )
+	    depth_map.computeStatistics(statistics, 64, 0.0, 2.0);
+	std::cerr << t << std::endl;
+    }
+    {
+	size_t valid = 0;
+	base::TimeMark t("DepthMap::isIndexValid, 1M points");
+	for( int i=0; i<10; i++ )
+	    for( size_t j=0; j<depth_map.distances.size(); j++ )
+		valid += depth_map.isIndexValid(j) ? 1 : 0;
+	std::cerr << t << " (" << valid << " valid)" << std::endl;
+    }
+    {
+	base::samples::DepthMapFeatures features;
+	base::samples::PointcloudArrays normals;
+	base::TimeMark t("DepthMapFeatures::computeNormals, 1M points");
+	for( int i=0; i<10; i++ )
+	    features.computeNormals(depth_map, normals, Eigen::Affine3d::Identity(), true);
+	std::cerr << t << std::endl;
+    }
+    {
+	base::samples::DepthMap filtered;
+	base::TimeMark t("DepthMapFeatures::medianFilter, 3x3 window of 1M points");
+	for( int i=0; i<10; i++ )
+	    base::samples::DepthMapFeatures::medianFilter(depth_map, filtered);
+	std::cerr << t << std::endl;
+    }
+    {
+	base::samples::DistanceImage image;
+	image.setSize(640, 480);
+	image.setIntrinsic(570.0, 570.0, 320.0, 240.0);
+	for( size_t i=0; i<image.data.size(); i++ )
+	    image.data[i] = (i % 97 == 0) ? 0.0 : 1.0 + 0.001 * (i % 1000);
+	base::samples::PointcloudArrays arrays;
+	base::TimeMark t("DistanceImage::convertToPointCloud, 640x480 into arrays");
+	for( int i=0; i<100; i++ )
+	    image.convertToPointCloud(arrays);
+	std::cerr << t << std::endl;
+    }
+    {
+	base::samples::DepthMap decimated;
+	base::TimeMark t("DepthMapView::decimate, median of 2x4 blocks of 1M points");
+	for( int i=0; i<10; i++ )
+	    base::samples::DepthMapView(depth_map).decimate(decimated, 2, 4, base::samples::DepthMapView::DECIMATE_MEDIAN);
+	std::cerr << t << std::endl;
+    }
+}
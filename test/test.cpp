@@ -1,5 +1,7 @@
 #define BOOST_TEST_MODULE BaseTypes
 #include <boost/test/unit_test.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/type_traits/has_trivial_destructor.hpp>
 
 #include <base/Angle.hpp>
 #include <base/commands/AUVMotion.hpp>
@@ -18,6 +20,7 @@
 #include <base/Point.hpp>
 #include <base/Pose.hpp>
 #include <base/Pressure.hpp>
+#include <base/RateLimit.hpp>
 //#include <base/samples/CompressedFrame.hpp>
 #include <base/samples/DistanceImage.hpp>
 #include <base/samples/Frame.hpp>
@@ -31,9 +34,15 @@
 #include <base/samples/SonarBeam.hpp>
 #include <base/samples/SonarScan.hpp>
 #include <base/samples/DepthMap.hpp>
+#include <base/samples/DepthMapFeatures.hpp>
 #include <base/Temperature.hpp>
 #include <base/Time.hpp>
+#include <base/TimeConversion.hpp>
+#include <base/CompactTimeSeries.hpp>
 #include <base/TimeMark.hpp>
+#include <base/TimestampEstimator.hpp>
+#include <base/templates/TimeIndexedBuffer.hpp>
+#include <base/Timeout.hpp>
 #include <base/Trajectory.hpp>
 #include <base/Waypoint.hpp>
 
@@ -43,11 +52,20 @@
 
 #define BASE_LOG_DEBUG
 #include <base/Logging.hpp>
+#include <base/logging/logging_binary.h>
+#include <base/logging/logging_sinks.h>
+#include <base/Profiler.hpp>
 
 #include <Eigen/SVD>
 #include <Eigen/LU>
 #include <Eigen/Geometry>
 
+#include <climits>
+#include <sys/socket.h>
+#include <iomanip>
+#include <new>
+#include <sstream>
+
 using namespace std;
 
 BOOST_AUTO_TEST_CASE(joint_state)
@@ -273,6 +291,245 @@ BOOST_AUTO_TEST_CASE( time_multiply )
     BOOST_REQUIRE_EQUAL( 35 * 1e6 * 0.025, (t * 0.025).toMicroseconds() );
 }
 
+BOOST_AUTO_TEST_CASE( time_clock_sources )
+{
+    base::Time wall = base::Time::now();
+    BOOST_CHECK_SMALL((base::Time::now(base::Time::RealtimeClock) - wall).toSeconds(), 0.1);
+
+    base::Time last = base::Time::monotonicNow();
+    for(int i = 0; i < 1000; ++i)
+    {
+        base::Time current = base::Time::monotonicNow();
+        BOOST_REQUIRE(current >= last);
+        last = current;
+    }
+
+    // All monotonic clocks share the same time base
+    base::Time monotonic = base::Time::now(base::Time::MonotonicClock);
+    BOOST_CHECK_SMALL((base::Time::now(base::Time::MonotonicCoarseClock) - monotonic).toSeconds(), 0.05);
+    BOOST_CHECK_SMALL((base::Time::now(base::Time::TscClock) - monotonic).toSeconds(), 0.05);
+
+    base::Time::setMonotonicClockSource(base::Time::TscClock);
+    BOOST_CHECK_EQUAL(base::Time::TscClock, base::Time::getMonotonicClockSource());
+    base::Time::setMonotonicClockSource(base::Time::MonotonicClock);
+    BOOST_CHECK_THROW(base::Time::setMonotonicClockSource(base::Time::RealtimeClock), std::invalid_argument);
+    BOOST_CHECK_EQUAL(base::Time::MonotonicClock, base::Time::getMonotonicClockSource());
+}
+
+BOOST_AUTO_TEST_CASE( timeout_set )
+{
+    base::TimeoutSet timeouts;
+    base::Time start = timeouts.now();
+    std::vector<base::TimeoutSet::Handle> expired;
+    BOOST_CHECK(timeouts.nextExpiry().isNull());
+
+    // Deadlines in milliseconds, some beyond the range of the wheel
+    std::map<base::TimeoutSet::Handle, int64_t> deadlines;
+    srand(42);
+    for(int i = 0; i < 2000; ++i)
+    {
+        int64_t deadline = (i % 10 == 0) ? rand() % 30000000 : rand() % 100000;
+        deadlines[timeouts.armAt(start + base::Time::fromMilliseconds(deadline))] = deadline;
+    }
+    base::TimeoutSet::Handle cancelled = deadlines.begin()->first;
+    BOOST_CHECK(timeouts.cancel(cancelled));
+    BOOST_CHECK(!timeouts.cancel(cancelled));
+    deadlines.erase(cancelled);
+    BOOST_CHECK_EQUAL(deadlines.size(), timeouts.size());
+
+    int64_t now = 0;
+    while(!deadlines.empty())
+    {
+        int64_t next = deadlines.begin()->second;
+        for(std::map<base::TimeoutSet::Handle, int64_t>::const_iterator it = deadlines.begin(); it != deadlines.end(); ++it)
+            next = std::min(next, it->second);
+        base::Time bound = timeouts.nextExpiry();
+        BOOST_REQUIRE(bound <= start + base::Time::fromMilliseconds(next));
+        BOOST_REQUIRE(bound > start + base::Time::fromMilliseconds(now));
+
+        now += 1 + rand() % 5000;
+        expired.clear();
+        timeouts.update(start + base::Time::fromMilliseconds(now), expired);
+        for(size_t i = 0; i < expired.size(); ++i)
+        {
+            BOOST_REQUIRE(deadlines.count(expired[i]));
+            BOOST_REQUIRE(deadlines[expired[i]] <= now);
+            BOOST_REQUIRE(!timeouts.isArmed(expired[i]));
+            deadlines.erase(expired[i]);
+        }
+        for(std::map<base::TimeoutSet::Handle, int64_t>::const_iterator it = deadlines.begin(); it != deadlines.end(); ++it)
+            BOOST_REQUIRE(it->second > now);
+    }
+    BOOST_CHECK_EQUAL(0, timeouts.size());
+
+    // Timeouts never expire early and can be viewed through base::Timeout
+    base::Timeout view(base::Time::fromMilliseconds(10), timeouts);
+    base::TimeoutSet::Handle handle = timeouts.arm(base::Time::fromMicroseconds(10500));
+    expired.clear();
+    timeouts.update(timeouts.now() + base::Time::fromMilliseconds(10), expired);
+    BOOST_CHECK(expired.empty());
+    BOOST_CHECK(!view.elapsed());
+    BOOST_CHECK_EQUAL(base::Time::fromMicroseconds(1000), timeouts.timeUntilNextExpiry());
+    timeouts.update(timeouts.now() + base::Time::fromMilliseconds(1), expired);
+    BOOST_CHECK_EQUAL(1, expired.size());
+    BOOST_CHECK_EQUAL(handle, expired.front());
+    BOOST_CHECK(view.elapsed());
+}
+
+BOOST_AUTO_TEST_CASE( time_indexed_buffer )
+{
+    base::Time start = base::Time::fromSeconds(100);
+    base::TimeIndexedBuffer<double> buffer(5);
+    double value;
+    BOOST_CHECK(!buffer.interpolate(start, value));
+
+    // Out of order insertion
+    int order[] = { 0, 2, 1, 4, 3 };
+    for(int i = 0; i < 5; ++i)
+        BOOST_REQUIRE(buffer.push(start + base::Time::fromSeconds(order[i]), order[i] * 10));
+    for(size_t i = 0; i < buffer.size(); ++i)
+        BOOST_REQUIRE_EQUAL(i * 10, buffer[i]);
+
+    // The buffer is full: the oldest sample is dropped, unless the new one is
+    // even older
+    BOOST_CHECK(!buffer.push(start - base::Time::fromSeconds(1), -10));
+    BOOST_CHECK(buffer.push(start + base::Time::fromSeconds(5), 50));
+    BOOST_CHECK_EQUAL(5, buffer.size());
+    BOOST_CHECK_EQUAL(10, buffer.front());
+    BOOST_CHECK_EQUAL(50, buffer.back());
+
+    size_t before, after;
+    BOOST_REQUIRE(buffer.bracket(start + base::Time::fromMilliseconds(2500), before, after));
+    BOOST_CHECK_EQUAL(1, before);
+    BOOST_CHECK_EQUAL(2, after);
+    BOOST_REQUIRE(buffer.bracket(start + base::Time::fromSeconds(3), before, after));
+    BOOST_CHECK_EQUAL(2, before);
+    BOOST_CHECK_EQUAL(2, after);
+    BOOST_CHECK(!buffer.bracket(start + base::Time::fromSeconds(6), before, after));
+    BOOST_CHECK_EQUAL(3, buffer.findClosest(start + base::Time::fromMilliseconds(3600)));
+    BOOST_CHECK_EQUAL(4, buffer.findClosest(start + base::Time::fromSeconds(10)));
+
+    BOOST_REQUIRE(buffer.interpolate(start + base::Time::fromMilliseconds(2500), value));
+    BOOST_CHECK_CLOSE(25.0, value, 1e-9);
+    BOOST_CHECK(!buffer.interpolate(start + base::Time::fromMilliseconds(2500), value, base::Time::fromMilliseconds(500)));
+
+    buffer.removeBefore(start + base::Time::fromMilliseconds(3500));
+    BOOST_CHECK_EQUAL(2, buffer.size());
+    BOOST_CHECK_EQUAL(40, buffer.front());
+    buffer.setCapacity(1);
+    BOOST_CHECK_EQUAL(50, buffer.front());
+
+    // Rigid body states: positions are linear, orientations are slerped
+    base::TimeIndexedBuffer<base::samples::RigidBodyState> poses(10);
+    base::samples::RigidBodyState pose;
+    pose.time = start;
+    pose.position = base::Vector3d(0, 0, 0);
+    pose.orientation = base::Quaterniond::Identity();
+    poses.push(pose);
+    pose.time = start + base::Time::fromSeconds(1);
+    pose.position = base::Vector3d(2, 0, 0);
+    pose.orientation = Eigen::AngleAxisd(M_PI / 2, base::Vector3d::UnitZ());
+    poses.push(pose);
+
+    base::samples::RigidBodyState result;
+    BOOST_REQUIRE(poses.interpolate(start + base::Time::fromMilliseconds(500), result));
+    BOOST_CHECK_EQUAL(start + base::Time::fromMilliseconds(500), result.time);
+    BOOST_CHECK((result.position - base::Vector3d(1, 0, 0)).norm() < 1e-9);
+    BOOST_CHECK(result.orientation.isApprox(base::Quaterniond(Eigen::AngleAxisd(M_PI / 4, base::Vector3d::UnitZ()))));
+
+    // Joints and timestamped types
+    base::TimeIndexedBuffer<base::samples::Joints> joints(10);
+    base::samples::Joints sample = base::samples::Joints::Positions(std::vector<double>(2, 0));
+    sample.time = start;
+    joints.push(sample);
+    sample = base::samples::Joints::Positions(std::vector<double>(2, 1));
+    sample.time = start + base::Time::fromSeconds(1);
+    joints.push(sample);
+    BOOST_REQUIRE(joints.interpolate(start + base::Time::fromMilliseconds(250), sample));
+    BOOST_CHECK_CLOSE(0.25, sample.elements[1].position, 1e-9);
+
+    base::TimeIndexedBuffer< base::TimeStamped<base::Vector3d> > stamped(10);
+    base::TimeStamped<base::Vector3d> point;
+    point.getBase() = base::Vector3d(0, 0, 0);
+    point.time = start;
+    stamped.push(point);
+    point.getBase() = base::Vector3d(0, 4, 0);
+    point.time = start + base::Time::fromSeconds(1);
+    stamped.push(point);
+    BOOST_REQUIRE(stamped.interpolate(start + base::Time::fromMilliseconds(750), point));
+    BOOST_CHECK_CLOSE(3.0, point.y(), 1e-9);
+    BOOST_CHECK_EQUAL(start + base::Time::fromMilliseconds(750), point.time);
+}
+
+BOOST_AUTO_TEST_CASE( timestamp_estimator )
+{
+    // 100Hz device whose clock is 50ppm too slow, received with up to 5ms of
+    // jitter on top of a 2ms latency
+    base::Time start = base::Time::fromSeconds(1000);
+    base::TimestampEstimator estimator(base::Time::fromSeconds(20), base::Time::fromMilliseconds(10));
+    srand(0);
+    double max_error = 0;
+    for(int i = 0; i < 6000; ++i)
+    {
+        base::Time real = start + base::Time::fromMilliseconds(10 * i);
+        base::Time received = real + base::Time::fromMicroseconds(2000 + rand() % 5000);
+        base::Time device = base::Time::fromSeconds((real - start).toSeconds() * (1 - 50e-6));
+        base::samples::LaserScan scan;
+        estimator.stamp(scan, device, received);
+        BOOST_REQUIRE(scan.time <= received);
+        if(i > 1000)
+            max_error = std::max(max_error, std::abs((scan.time - real).toSeconds() - 0.002));
+    }
+    BOOST_CHECK_SMALL(max_error, 0.0005);
+    BOOST_CHECK_CLOSE(50e-6, estimator.getDrift(), 10);
+
+    // Sample counters, and reset when the device time goes backwards
+    base::samples::frame::Frame frame;
+    frame.received_time = start + base::Time::fromMilliseconds(3);
+    estimator.stamp(frame, base::Time());
+    BOOST_CHECK_EQUAL(frame.received_time, frame.time);
+    BOOST_CHECK_EQUAL(start + base::Time::fromMilliseconds(13), estimator.updateIndex(1, start + base::Time::fromMilliseconds(20)));
+    BOOST_CHECK_THROW(base::TimestampEstimator().updateIndex(1, start), std::logic_error);
+}
+
+BOOST_AUTO_TEST_CASE( compact_time_series )
+{
+    // Nearly regular times, as in a scan with per-point timestamps
+    std::vector<base::Time> times;
+    srand(1);
+    for(int i = 0; i < 10000; ++i)
+        times.push_back(base::Time::fromMicroseconds(1339675506000000LL + i * 100 + rand() % 3));
+    times.push_back(times.back() - base::Time::fromSeconds(10));
+    times.push_back(times.back() + base::Time::fromSeconds(1000));
+
+    base::CompactTimeSeries compact(times);
+    BOOST_REQUIRE_EQUAL(times.size(), compact.size());
+    BOOST_CHECK(compact.byteSize() * 4 < times.size() * sizeof(base::Time));
+    for(size_t i = 0; i < times.size(); i += 7)
+        BOOST_REQUIRE_EQUAL(times[i], compact[i]);
+    BOOST_CHECK_EQUAL(times.back(), compact.back());
+    BOOST_CHECK_THROW(compact.at(times.size()), std::out_of_range);
+
+    std::vector<base::Time> decoded;
+    compact.decode(decoded);
+    BOOST_CHECK(times == decoded);
+    BOOST_CHECK(std::equal(times.begin(), times.end(), compact.begin()));
+    BOOST_CHECK_EQUAL(times.size(), std::distance(compact.begin(), compact.end()));
+    BOOST_CHECK(std::vector<base::Time>(compact.begin(), compact.end()) == times);
+    base::CompactTimeSeries::const_iterator it = compact.begin();
+    ++it;
+    BOOST_CHECK_EQUAL(times[1].microseconds, it->microseconds);
+
+    base::Time range[3];
+    compact.decode(130, 3, range);
+    BOOST_CHECK(std::equal(range, range + 3, times.begin() + 130));
+
+    base::CompactTimeSeries single;
+    single.push_back(times[0]);
+    BOOST_CHECK(std::vector<base::Time>(1, times[0]) == single.toVector());
+    BOOST_CHECK(base::CompactTimeSeries().toVector().empty());
+}
+
 BOOST_AUTO_TEST_CASE(time_fromString)
 {
     base::Time now = base::Time::now();
@@ -323,6 +580,78 @@ BOOST_AUTO_TEST_CASE(time_fromString)
 
 }
 
+BOOST_AUTO_TEST_CASE(time_toChars)
+{
+    char buffer[base::Time::MaxStringLength];
+    base::Time now = base::Time::now();
+    for(int i = 0; i < 3; ++i)
+    {
+        base::Time t = now + base::Time::fromSeconds(i * 3599.5);
+        BOOST_REQUIRE_EQUAL(t.toString(base::Time::Microseconds, "Time: %Y%m%d-%H:%M:%S").substr(6),
+                std::string(buffer, t.toChars(buffer, sizeof(buffer))));
+        BOOST_REQUIRE_EQUAL(t, base::Time::fromChars(buffer, strlen(buffer)));
+        t.toChars(buffer, sizeof(buffer), base::Time::Milliseconds);
+        BOOST_REQUIRE_EQUAL(t.toMilliseconds(), base::Time::fromChars(buffer, strlen(buffer), base::Time::Milliseconds).toMilliseconds());
+    }
+    BOOST_CHECK_EQUAL(0, now.toChars(buffer, 24));
+    BOOST_CHECK_THROW(base::Time::fromChars("2012-06-14 12:05:06", 19), std::runtime_error);
+
+    base::Time t = base::Time::fromMicroseconds(1339675506001001LL);
+    BOOST_CHECK_EQUAL(std::string("2012-06-14T12:05:06.001001Z"), std::string(buffer, t.toISO8601(buffer, sizeof(buffer))));
+    BOOST_CHECK_EQUAL(t, base::Time::fromISO8601(buffer, strlen(buffer)));
+    BOOST_CHECK_EQUAL(std::string("2012-06-14T12:05:06Z"), std::string(buffer, t.toISO8601(buffer, sizeof(buffer), base::Time::Seconds)));
+    BOOST_CHECK_EQUAL(t, base::Time::fromISO8601("2012-06-14T14:05:06.001001+02:00", 32));
+    BOOST_CHECK_EQUAL(base::Time::fromMicroseconds(-1), base::Time::fromISO8601("1969-12-31T23:59:59.999999Z", 27));
+    BOOST_CHECK_THROW(base::Time::fromISO8601("2012-06-14T12:05:06", 19), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(time_batch_conversion)
+{
+    std::vector<base::Time> times;
+    for(int i = 0; i < 100; ++i)
+        times.push_back(base::Time::fromMicroseconds(1339675506001001LL + i * 1003));
+
+    std::vector<double> seconds;
+    base::toSeconds(times, seconds);
+    std::vector<base::Time> converted;
+    base::fromSeconds(seconds, converted);
+    BOOST_REQUIRE_EQUAL(times.size(), converted.size());
+    for(size_t i = 0; i < times.size(); ++i)
+    {
+        BOOST_REQUIRE_EQUAL(times[i].toSeconds(), seconds[i]);
+        BOOST_REQUIRE_EQUAL(base::Time::fromSeconds(seconds[i]), converted[i]);
+    }
+
+    base::toSeconds(times, times.front(), seconds);
+    base::fromSeconds(seconds, times.front(), converted);
+    BOOST_CHECK_EQUAL(0, seconds.front());
+    BOOST_CHECK_CLOSE(99 * 1003e-6, seconds.back(), 1e-9);
+    BOOST_CHECK(times == converted);
+
+    std::vector<int64_t> usecs;
+    base::toMicroseconds(times, usecs);
+    base::fromMicroseconds(usecs, converted);
+    BOOST_CHECK_EQUAL(times[10].toMicroseconds(), usecs[10]);
+    BOOST_CHECK(times == converted);
+
+    std::vector<base::Time> range;
+    range.push_back(times.front());
+    range.push_back(times.back());
+    base::interpolateTimes(range, times.size(), converted);
+    for(size_t i = 0; i < times.size(); ++i)
+    {
+        BOOST_REQUIRE_EQUAL(times[i], converted[i]);
+        BOOST_REQUIRE_EQUAL(times[i], base::interpolateTime(range, i, times.size()));
+    }
+    range.resize(1);
+    BOOST_CHECK_EQUAL(times.front(), base::interpolateTime(range, 50, times.size()));
+    BOOST_CHECK_EQUAL(times[50], base::interpolateTime(times, 50, times.size()));
+    range.resize(3);
+    BOOST_CHECK_THROW(base::interpolateTimes(range, times.size(), converted), std::invalid_argument);
+    BOOST_CHECK_THROW(base::interpolateTime(range, times.size(), times.size()), std::out_of_range);
+    BOOST_CHECK_THROW(base::interpolateTime(std::vector<base::Time>(), 0, 0), std::out_of_range);
+}
+
 BOOST_AUTO_TEST_CASE( laser_scan_test )
 {
     //configure laser scan
@@ -583,6 +912,51 @@ BOOST_AUTO_TEST_CASE(depth_map_test)
     }
 
 
+    // check the lookup table against the exact rotations, with angles
+    // in between the table entries over the full circle
+    scan.reset();
+    scan.horizontal_interval.push_back(M_PI);
+    scan.horizontal_interval.push_back(M_PI);
+    scan.vertical_interval.push_back(-0.7);
+    scan.vertical_interval.push_back(0.6);
+    scan.horizontal_size = 997;
+    scan.vertical_size = 31;
+    for(unsigned i = 0; i < scan.horizontal_size * scan.vertical_size; i++)
+	scan.distances.push_back(1.0 + 0.01 * (i % 100));
+    std::vector<Eigen::Vector3d> lut_points;
+    scan_points.clear();
+    scan.convertDepthMapToPointCloud(scan_points, transform, false);
+    scan.convertDepthMapToPointCloud(lut_points, transform, true);
+    BOOST_CHECK(lut_points.size() == scan_points.size());
+    double max_error = 0.0;
+    for(unsigned i = 0; i < scan_points.size(); i++)
+	max_error = std::max(max_error, (lut_points[i] - scan_points[i]).norm());
+    BOOST_CHECK_SMALL(max_error, 1e-5);
+
+    // check the order of the points across blocks of columns and rows with invalid measurements
+    double h_step = 2.0 * M_PI / (scan.horizontal_size - 1);
+    double v_step = 1.3 / (scan.vertical_size - 1);
+    for(unsigned i = 0; i < scan.distances.size(); i += 7)
+	scan.distances[i] = (i % 3 == 0) ? 0.0 : base::NaN<float>();
+    scan.convertDepthMapToPointCloud(scan_points, transform, false);
+    unsigned point_index = 0;
+    for(unsigned v = 0; v < scan.vertical_size; v++)
+    {
+	for(unsigned h = 0; h < scan.horizontal_size; h++)
+	{
+	    double distance = scan.distances[scan.getIndex(v,h)];
+	    if(!scan.isMeasurementValid(distance))
+		continue;
+	    Eigen::Vector3d ref_point = transform * (Eigen::AngleAxisd(scan.horizontal_interval.front() - h * h_step, Eigen::Vector3d::UnitZ()) *
+				Eigen::AngleAxisd(scan.vertical_interval.front() + v * v_step, Eigen::Vector3d::UnitY()) *
+				Eigen::Vector3d(distance, 0.0, 0.0));
+	    BOOST_REQUIRE(point_index < scan_points.size());
+	    BOOST_CHECK(scan_points[point_index++].isApprox(ref_point, 1e-6));
+	}
+    }
+    BOOST_CHECK(point_index == scan_points.size());
+
+
     // check measurement states
     scan.reset();
     scan.distances.push_back(1.0);
@@ -618,6 +992,496 @@ BOOST_AUTO_TEST_CASE(depth_map_test)
     BOOST_CHECK(scan_points.size() == 1);
 }
 
+BOOST_AUTO_TEST_CASE(depth_map_projector_test)
+{
+    base::samples::DepthMap scan;
+    scan.vertical_size = 4;
+    scan.horizontal_size = 300;
+    scan.vertical_interval.push_back(0.3);
+    scan.vertical_interval.push_back(-0.3);
+    scan.horizontal_interval.push_back(M_PI);
+    scan.horizontal_interval.push_back(M_PI);
+    for(unsigned i = 0; i < scan.vertical_size * scan.horizontal_size; i++)
+	scan.distances.push_back(1.0 + 0.1 * (i % 10));
+    
+    Eigen::Affine3d transform = Eigen::Affine3d::Identity();
+    transform.translation() = Eigen::Vector3d(1.0, -2.0, 0.5);
+    transform.rotate(Eigen::AngleAxisd(0.4, Eigen::Vector3d::UnitZ()));
+    std::vector<Eigen::Affine3d> transformations(scan.horizontal_size, transform);
+    
+    base::samples::DepthMapProjector<double> projector;
+    std::vector<Eigen::Vector3d> points, ref_points;
+    for(unsigned frame = 0; frame < 3; frame++)
+    {
+	// new distances with the same geometry reuse the cached rotations
+	for(unsigned i = 0; i < scan.distances.size(); i++)
+	    scan.distances[i] += 0.5;
+	scan.convertDepthMapToPointCloud(ref_points, transform);
+	projector.convertDepthMapToPointCloud(scan, points, transform);
+	BOOST_REQUIRE(points.size() == ref_points.size());
+	for(unsigned i = 0; i < points.size(); i++)
+	    BOOST_CHECK(points[i].isApprox(ref_points[i], 1e-12));
+	
+	projector.convertDepthMapToPointCloud(scan, points, transformations, false, true, false);
+	for(unsigned i = 0; i < points.size(); i++)
+	    BOOST_CHECK(points[i].isApprox(ref_points[i], 1e-12));
+	
+	projector.convertDepthMapToPointCloud(scan, points, transform, transform, false, true, true);
+	for(unsigned i = 0; i < points.size(); i++)
+	    BOOST_CHECK(points[i].isApprox(ref_points[i], 1e-12));
+    }
+    
+    // a changed geometry is detected
+    scan.vertical_interval.back() = -0.5;
+    scan.convertDepthMapToPointCloud(ref_points, transform);
+    projector.convertDepthMapToPointCloud(scan, points, transform);
+    BOOST_REQUIRE(points.size() == ref_points.size());
+    for(unsigned i = 0; i < points.size(); i++)
+	BOOST_CHECK(points[i].isApprox(ref_points[i], 1e-12));
+    
+    BOOST_CHECK_THROW(projector.convertDepthMapToPointCloud(scan, points, std::vector<Eigen::Affine3d>(2)), std::out_of_range);
+    scan.vertical_size = 5;
+    BOOST_CHECK_THROW(projector.convertDepthMapToPointCloud(scan, points), std::out_of_range);
+    BOOST_CHECK(points.empty());
+}
+
+BOOST_AUTO_TEST_CASE(depth_map_deskew_test)
+{
+    base::samples::DepthMap scan;
+    scan.vertical_size = 3;
+    scan.horizontal_size = 400;
+    scan.vertical_interval.push_back(0.3);
+    scan.vertical_interval.push_back(-0.3);
+    scan.horizontal_interval.push_back(M_PI);
+    scan.horizontal_interval.push_back(M_PI);
+    for(unsigned i = 0; i < scan.vertical_size * scan.horizontal_size; i++)
+	scan.distances.push_back((i % 13 == 0) ? 0.0 : 2.0 + 0.01 * (i % 50));
+    
+    // the sensor moves along x and turns around z
+    base::Time start = base::Time::fromSeconds(100);
+    base::TimeIndexedBuffer<base::samples::RigidBodyState> poses(10);
+    for(unsigned i = 0; i < 3; i++)
+    {
+	base::samples::RigidBodyState pose;
+	pose.time = start + base::Time::fromMilliseconds(50 * i);
+	pose.position = Eigen::Vector3d(0.5 * i, 0.0, 0.0);
+	pose.orientation = Eigen::Quaterniond(Eigen::AngleAxisd(0.1 * i, Eigen::Vector3d::UnitZ()));
+	poses.push(pose);
+    }
+    base::samples::RigidBodyStatePoses sensor2world(poses);
+    
+    // one timestamp per column, compared to one transformation per column
+    std::vector<Eigen::Affine3d> transformations;
+    for(unsigned h = 0; h < scan.horizontal_size; h++)
+    {
+	scan.timestamps.push_back(start + base::Time::fromMicroseconds(100000 * h / (scan.horizontal_size - 1)));
+	transformations.push_back(Eigen::Affine3d::Identity());
+	BOOST_REQUIRE(sensor2world(scan.timestamps.back(), transformations.back()));
+    }
+    std::vector<Eigen::Vector3d> points, ref_points;
+    scan.convertDepthMapToPointCloud(ref_points, transformations, false, true, false);
+    scan.convertDepthMapToDeskewedPointCloud(points, sensor2world, false, true, false);
+    BOOST_REQUIRE(points.size() == ref_points.size());
+    for(unsigned i = 0; i < points.size(); i++)
+	BOOST_CHECK(points[i].isApprox(ref_points[i], 1e-12));
+    
+    // the first and last timestamp, interpolated as by base::interpolateTimes
+    std::vector<base::Time> column_times = scan.timestamps;
+    scan.timestamps.erase(scan.timestamps.begin() + 1, scan.timestamps.end() - 1);
+    std::vector<base::Time> interpolated_times;
+    base::interpolateTimes(scan.timestamps, scan.horizontal_size, interpolated_times);
+    std::vector<Eigen::Affine3d> interpolated_transformations(scan.horizontal_size);
+    for(unsigned h = 0; h < scan.horizontal_size; h++)
+	BOOST_REQUIRE(sensor2world(interpolated_times[h], interpolated_transformations[h]));
+    std::vector<Eigen::Vector3d> interpolated_points;
+    scan.convertDepthMapToPointCloud(interpolated_points, interpolated_transformations, false, true, false);
+    scan.convertDepthMapToDeskewedPointCloud(points, sensor2world, false, true, false);
+    BOOST_REQUIRE(points.size() == interpolated_points.size());
+    for(unsigned i = 0; i < points.size(); i++)
+	BOOST_CHECK(points[i].isApprox(interpolated_points[i], 1e-12));
+    
+    // one timestamp per measurement
+    scan.timestamps.clear();
+    for(unsigned v = 0; v < scan.vertical_size; v++)
+	scan.timestamps.insert(scan.timestamps.end(), column_times.begin(), column_times.end());
+    base::samples::DepthMapProjector<double> projector;
+    projector.convertDepthMapToDeskewedPointCloud(scan, points, sensor2world, false, false);
+    scan.convertDepthMapToPointCloud(ref_points, transformations, false, false, false);
+    BOOST_REQUIRE(points.size() == ref_points.size());
+    for(unsigned i = 0; i < points.size(); i++)
+	BOOST_CHECK(scan.isIndexValid(i) ? points[i].isApprox(ref_points[i], 1e-12) : !base::isnotnan(points[i]));
+    
+    // no pose for a valid measurement
+    scan.timestamps[1] = start - base::Time::fromSeconds(1);
+    BOOST_CHECK_THROW(projector.convertDepthMapToDeskewedPointCloud(scan, points, sensor2world), std::out_of_range);
+    scan.timestamps.resize(5);
+    BOOST_CHECK_THROW(projector.convertDepthMapToDeskewedPointCloud(scan, points, sensor2world), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(pointcloud_arrays_test)
+{
+    base::samples::DepthMap scan;
+    scan.vertical_size = 3;
+    scan.horizontal_size = 300;
+    scan.vertical_interval.push_back(0.3);
+    scan.vertical_interval.push_back(-0.3);
+    scan.horizontal_interval.push_back(M_PI);
+    scan.horizontal_interval.push_back(M_PI);
+    for(unsigned i = 0; i < scan.vertical_size * scan.horizontal_size; i++)
+    {
+	scan.distances.push_back((i % 7 == 0) ? base::infinity<float>() : 1.0 + 0.01 * (i % 50));
+	scan.remissions.push_back(0.001 * i);
+    }
+    Eigen::Affine3d transform(Eigen::AngleAxisd(0.3, Eigen::Vector3d::UnitX()));
+    transform.translation() = Eigen::Vector3d(0.5, 1.0, -2.0);
+    
+    scan.timestamps.push_back(base::Time::fromSeconds(5.0));
+    
+    std::vector<Eigen::Vector3d> ref_points;
+    scan.convertDepthMapToPointCloud(ref_points, transform);
+    base::samples::PointcloudArrays arrays(true, true);
+    scan.convertDepthMapToPointCloud(arrays, transform);
+    BOOST_CHECK_EQUAL(arrays.time, scan.timestamps.front());
+    BOOST_REQUIRE(arrays.size() == ref_points.size());
+    BOOST_REQUIRE(arrays.indices.size() == arrays.size() && arrays.remissions.size() == arrays.size());
+    for(unsigned i = 0; i < arrays.size(); i++)
+    {
+	BOOST_CHECK(arrays.getPoint(i).isApprox(ref_points[i].cast<float>(), 1e-6));
+	BOOST_CHECK(scan.isIndexValid(arrays.indices[i]));
+	BOOST_CHECK_EQUAL(arrays.remissions[i], scan.remissions[arrays.indices[i]]);
+    }
+    
+    // converting again keeps the arrays
+    scan.convertDepthMapToPointCloud(arrays, transform, false, false);
+    BOOST_CHECK(arrays.size() == scan.distances.size());
+    BOOST_CHECK(base::isNaN(arrays.x[7]) && arrays.indices[7] == 7);
+    const float* data = &arrays.x[0];
+    scan.convertDepthMapToPointCloud(arrays, transform);
+    BOOST_CHECK(arrays.size() == ref_points.size());
+    BOOST_CHECK(&arrays.x[0] == data);
+    
+    // laser scan
+    base::samples::LaserScan laser_scan;
+    laser_scan.time = base::Time::fromSeconds(7.0);
+    laser_scan.start_angle = -1.0;
+    laser_scan.angular_resolution = 0.01;
+    laser_scan.minRange = 100;
+    laser_scan.maxRange = 10000;
+    for(unsigned i = 0; i < 200; i++)
+    {
+	laser_scan.ranges.push_back((i % 5 == 0) ? 50 : 500 + 10 * i);
+	laser_scan.remission.push_back(i);
+    }
+    std::vector<Eigen::Vector3d> laser_points;
+    laser_scan.convertScanToPointCloud(laser_points, transform);
+    arrays.with_remissions = false;
+    laser_scan.convertScanToPointCloud(arrays, transform);
+    BOOST_REQUIRE(arrays.size() == laser_points.size());
+    BOOST_CHECK_EQUAL(arrays.time, laser_scan.time);
+    BOOST_CHECK(arrays.remissions.empty());
+    for(unsigned i = 0; i < arrays.size(); i++)
+    {
+	BOOST_CHECK(arrays.getPoint(i).isApprox(laser_points[i].cast<float>(), 1e-6));
+	BOOST_CHECK(arrays.indices[i] % 5 != 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(depth_map_statistics_test)
+{
+    base::samples::DepthMap scan;
+    scan.vertical_size = 3;
+    scan.horizontal_size = 50;
+    for(unsigned i = 0; i < scan.vertical_size * scan.horizontal_size; i++)
+    {
+	if(i % 11 == 0)
+	    scan.distances.push_back(base::unknown<float>());
+	else if(i % 7 == 0)
+	    scan.distances.push_back(base::infinity<float>());
+	else if(i % 5 == 0)
+	    scan.distances.push_back(0.0);
+	else
+	    scan.distances.push_back(1.0 + 0.1 * (i % 40));
+    }
+    scan.distances[1] = -base::infinity<float>();
+    
+    base::samples::DepthMapStatistics statistics;
+    scan.computeStatistics(statistics, 4, 1.0, 3.0);
+    BOOST_REQUIRE(statistics.valid_mask.size() == 3);
+    size_t counts[4] = { 0, 0, 0, 0 };
+    std::vector<size_t> histogram(4, 0);
+    double min = 100.0, max = 0.0, sum = 0.0;
+    for(unsigned i = 0; i < scan.distances.size(); i++)
+    {
+	BOOST_CHECK_EQUAL(statistics.isIndexValid(i), scan.isIndexValid(i));
+	counts[scan.getIndexState(i)]++;
+	if(scan.isIndexValid(i))
+	{
+	    float distance = scan.distances[i];
+	    min = std::min<double>(min, distance);
+	    max = std::max<double>(max, distance);
+	    sum += distance;
+	    if(distance >= 1.0 && distance < 3.0)
+		histogram[std::min(3, (int)((distance - 1.0) * 2.0))]++;
+	}
+    }
+    for(unsigned s = 0; s < 4; s++)
+	BOOST_CHECK_EQUAL(statistics.state_counts[s], counts[s]);
+    BOOST_CHECK(statistics.histogram == histogram);
+    BOOST_CHECK_EQUAL(statistics.valid_min, min);
+    BOOST_CHECK_EQUAL(statistics.valid_max, max);
+    BOOST_CHECK_CLOSE(statistics.valid_mean, sum / statistics.getValidCount(), 1e-9);
+    
+    std::fill(scan.distances.begin(), scan.distances.end(), 0.0f);
+    scan.computeStatistics(statistics);
+    BOOST_CHECK(statistics.histogram.empty());
+    BOOST_CHECK(statistics.getValidCount() == 0 && base::isNaN(statistics.valid_mean));
+    BOOST_CHECK(statistics.state_counts[base::samples::DepthMap::TOO_NEAR] == scan.distances.size());
+}
+
+BOOST_AUTO_TEST_CASE(depth_map_features_test)
+{
+    // a wall at x = 2 with a box at x = 1 in front of it
+    base::samples::DepthMap scan;
+    scan.vertical_size = 10;
+    scan.horizontal_size = 30;
+    scan.vertical_interval.push_back(-0.3);
+    scan.vertical_interval.push_back(0.3);
+    scan.horizontal_interval.push_back(0.5);
+    scan.horizontal_interval.push_back(-0.5);
+    for(unsigned v = 0; v < scan.vertical_size; v++)
+    {
+	double elevation = -0.3 + v * 0.6 / 9.0;
+	for(unsigned h = 0; h < scan.horizontal_size; h++)
+	{
+	    double azimuth = 0.5 - h / 29.0;
+	    double x = (v >= 3 && v <= 5 && h >= 10 && h <= 14) ? 1.0 : 2.0;
+	    scan.distances.push_back(x / (std::cos(elevation) * std::cos(azimuth)));
+	}
+    }
+    scan.distances[scan.getIndex(8, 25)] = base::unknown<float>();
+    
+    base::samples::DepthMapFeatures features;
+    base::samples::PointcloudArrays normals;
+    features.computeNormals(scan, normals);
+    BOOST_REQUIRE(normals.size() == scan.distances.size());
+    std::vector<float> slopes;
+    base::samples::DepthMapFeatures::computeSlopes(normals, slopes);
+    for(unsigned i = 0; i < normals.size(); i++)
+    {
+	// the measurement below the invalid one has no vertical neighbor
+	if(i == scan.getIndex(8, 25) || i == scan.getIndex(9, 25))
+	{
+	    BOOST_CHECK(base::isNaN(normals.x[i]) && base::isNaN(slopes[i]));
+	    continue;
+	}
+	BOOST_CHECK(normals.getPoint(i).isApprox(Eigen::Vector3f(-1, 0, 0), 1e-4));
+	BOOST_CHECK_CLOSE(slopes[i], M_PI / 2.0, 1e-2);
+    }
+    
+    // the box is in front of the wall
+    std::vector<boost::uint8_t> edges;
+    features.detectEdges(scan, edges);
+    BOOST_CHECK_EQUAL(edges[scan.getIndex(4, 10)], base::samples::DepthMapFeatures::OCCLUDING);
+    BOOST_CHECK_EQUAL(edges[scan.getIndex(3, 12)], base::samples::DepthMapFeatures::OCCLUDING);
+    BOOST_CHECK_EQUAL(edges[scan.getIndex(4, 12)], base::samples::DepthMapFeatures::NO_EDGE);
+    BOOST_CHECK_EQUAL(edges[scan.getIndex(4, 9)], base::samples::DepthMapFeatures::OCCLUDED);
+    BOOST_CHECK_EQUAL(edges[scan.getIndex(2, 12)], base::samples::DepthMapFeatures::OCCLUDED);
+    BOOST_CHECK_EQUAL(edges[scan.getIndex(8, 24)], base::samples::DepthMapFeatures::BORDER);
+    BOOST_CHECK_EQUAL(edges[scan.getIndex(8, 25)], base::samples::DepthMapFeatures::NO_EDGE);
+    
+    std::vector<float> vertical, horizontal;
+    features.computeGradients(scan, vertical, horizontal);
+    size_t index = scan.getIndex(1, 5);
+    BOOST_CHECK_CLOSE(horizontal[index], (scan.distances[index + 1] - scan.distances[index - 1]) / 2.0, 1e-4);
+    BOOST_CHECK_CLOSE(vertical[index], (scan.distances[index + 30] - scan.distances[index - 30]) / 2.0, 1e-4);
+    index = scan.getIndex(4, 9);
+    BOOST_CHECK_CLOSE(horizontal[index], scan.distances[index] - scan.distances[index - 1], 1e-4);
+    BOOST_CHECK(base::isNaN(horizontal[scan.getIndex(8, 25)]));
+    
+    // the median filter removes an outlier, and keeps the invalid measurement
+    base::samples::DepthMap filtered;
+    index = scan.getIndex(7, 20);
+    float distance = scan.distances[index];
+    scan.distances[index] *= 3.0;
+    base::samples::DepthMapFeatures::medianFilter(scan, filtered);
+    BOOST_CHECK_CLOSE(filtered.distances[index], distance, 2.0);
+    BOOST_CHECK(base::isNaN(filtered.distances[scan.getIndex(8, 25)]));
+    BOOST_CHECK_THROW(base::samples::DepthMapFeatures::medianFilter(scan, scan), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(distance_image_point_cloud_test)
+{
+    base::samples::DistanceImage image;
+    image.setSize(40, 30);
+    image.setIntrinsic(50.0, 55.0, 20.0, 15.0);
+    image.time = base::Time::fromSeconds(3.0);
+    for(size_t i = 0; i < image.data.size(); i++)
+	image.data[i] = (i % 9 == 0) ? base::unknown<float>() : ((i % 13 == 0) ? 0.0 : 1.0 + 0.01 * (i % 70));
+    
+    base::samples::Pointcloud cloud = image.getPointCloud();
+    BOOST_CHECK(cloud.time == image.time);
+    base::samples::PointcloudArrays organized(true);
+    image.convertToPointCloud(organized, false);
+    BOOST_REQUIRE(organized.size() == image.data.size());
+    size_t valid = 0;
+    for(size_t y = 0; y < image.height; y++)
+    {
+	for(size_t x = 0; x < image.width; x++)
+	{
+	    size_t index = y * image.width + x;
+	    BOOST_CHECK_EQUAL(organized.indices[index], index);
+	    Eigen::Vector3d point;
+	    if(image.getScenePoint(x, y, point))
+	    {
+		BOOST_REQUIRE(valid < cloud.points.size());
+		BOOST_CHECK(cloud.points[valid++].isApprox(point, 1e-6));
+		BOOST_CHECK(organized.getPoint(index).isApprox(point.cast<float>(), 1e-6));
+	    }
+	    else
+		BOOST_CHECK(base::isNaN(organized.x[index]));
+	}
+    }
+    BOOST_CHECK_EQUAL(cloud.points.size(), valid);
+    
+    image.data.resize(10);
+    BOOST_CHECK_THROW(image.getPointCloud(), std::out_of_range);
+}
+
+BOOST_AUTO_TEST_CASE(depth_map_view_test)
+{
+    base::samples::DepthMap scan;
+    scan.vertical_size = 7;
+    scan.horizontal_size = 40;
+    scan.vertical_interval.push_back(0.3);
+    scan.vertical_interval.push_back(-0.3);
+    scan.horizontal_interval.push_back(M_PI);
+    scan.horizontal_interval.push_back(M_PI);
+    for(unsigned i = 0; i < scan.vertical_size * scan.horizontal_size; i++)
+    {
+	scan.distances.push_back((i % 7 == 0) ? base::infinity<float>() : 1.0 + 0.01 * (i % 50));
+	scan.remissions.push_back(0.001 * i);
+    }
+    base::Time start = base::Time::fromSeconds(10.0);
+    for(unsigned v = 0; v < scan.vertical_size; v++)
+	scan.timestamps.push_back(start + base::Time::fromMilliseconds(v));
+    
+    BOOST_CHECK_THROW(base::samples::DepthMapView(scan, 1, 0, 4, 10, 2, 1), std::out_of_range);
+    BOOST_CHECK_THROW(base::samples::DepthMapView(scan, 0, 0, 1, 1, 0, 1), std::out_of_range);
+    
+    base::samples::DepthMapView view(scan, 1, 5, 3, 10, 2, 3);
+    base::samples::DepthMapView::DepthMatrixMapConst distances = view.getDistanceMatrixMapConst();
+    base::samples::DepthMapView::DepthMatrixMapConst remissions = view.getRemissionMatrixMapConst();
+    BOOST_REQUIRE(distances.rows() == 3 && distances.cols() == 10);
+    for(unsigned v = 0; v < 3; v++)
+    {
+	for(unsigned h = 0; h < 10; h++)
+	{
+	    size_t index = scan.getIndex(1 + 2 * v, 5 + 3 * h);
+	    BOOST_CHECK_EQUAL(view.getIndex(v, h), index);
+	    BOOST_CHECK_EQUAL(distances(v, h), scan.distances[index]);
+	    BOOST_CHECK_EQUAL(remissions(v, h), scan.remissions[index]);
+	}
+    }
+    
+    // the points of the view are the ones of its measurements
+    Eigen::Affine3d transform(Eigen::AngleAxisd(0.3, Eigen::Vector3d::UnitX()));
+    transform.translation() = Eigen::Vector3d(0.5, 1.0, -2.0);
+    std::vector<Eigen::Vector3d> ref_points, points;
+    scan.convertDepthMapToPointCloud(ref_points, transform, false, false);
+    base::samples::PointcloudArrays arrays(true, true);
+    view.convertDepthMapToPointCloud(arrays, transform);
+    view.convertDepthMapToPointCloud(points, transform);
+    BOOST_CHECK_EQUAL(arrays.time, start);
+    BOOST_REQUIRE(points.size() == arrays.size());
+    BOOST_CHECK(points.size() == (size_t)(distances.array() < base::infinity<float>()).count());
+    for(unsigned i = 0; i < points.size(); i++)
+    {
+	BOOST_CHECK(points[i].isApprox(ref_points[arrays.indices[i]], 1e-12));
+	BOOST_CHECK_EQUAL(arrays.remissions[i], scan.remissions[arrays.indices[i]]);
+    }
+    
+    // a copy of the view has the metadata of the measurements
+    base::samples::DepthMap copy;
+    view.toDepthMap(copy);
+    BOOST_REQUIRE(copy.vertical_size == 3 && copy.horizontal_size == 10);
+    BOOST_CHECK(copy.getDistanceMatrixMapConst() == distances);
+    BOOST_REQUIRE(copy.timestamps.size() == 3);
+    BOOST_CHECK(copy.timestamps[2] == scan.timestamps[5]);
+    BOOST_CHECK(view.getTimestamps() == copy.timestamps);
+    BOOST_CHECK(view.getHorizontalInterval() == copy.horizontal_interval);
+    copy.convertDepthMapToPointCloud(ref_points, transform);
+    BOOST_REQUIRE(points.size() == ref_points.size());
+    for(unsigned i = 0; i < points.size(); i++)
+	BOOST_CHECK(points[i].isApprox(ref_points[i], 1e-9));
+    
+    // decimation of every other row and of blocks of four columns
+    base::samples::DepthMapView strided = base::samples::DepthMapView::stride(scan, 2, 1);
+    BOOST_CHECK(strided.vertical_size == 4 && strided.horizontal_size == 40);
+    base::samples::DepthMap decimated;
+    strided.decimate(decimated, 1, 4, base::samples::DepthMapView::DECIMATE_MIN);
+    BOOST_REQUIRE(decimated.vertical_size == 4 && decimated.horizontal_size == 10);
+    BOOST_CHECK(decimated.timestamps.size() == 4 && decimated.timestamps[1] == scan.timestamps[2]);
+    BOOST_CHECK(decimated.horizontal_interval.size() == 10 && decimated.vertical_interval.size() == 4);
+    for(unsigned v = 0; v < 4; v++)
+    {
+	for(unsigned h = 0; h < 10; h++)
+	{
+	    std::vector<float> block;
+	    for(unsigned i = 0; i < 4; i++)
+		if(scan.isMeasurementValid(2 * v, 4 * h + i))
+		    block.push_back(scan.distances[scan.getIndex(2 * v, 4 * h + i)]);
+	    std::sort(block.begin(), block.end());
+	    BOOST_CHECK_EQUAL(decimated.distances[decimated.getIndex(v, h)], block.front());
+	}
+    }
+    strided.decimate(decimated, 2, 4, base::samples::DepthMapView::DECIMATE_MEDIAN);
+    BOOST_REQUIRE(decimated.vertical_size == 2 && decimated.horizontal_size == 10);
+    std::vector<float> block;
+    for(unsigned v = 0; v < 2; v++)
+	for(unsigned h = 0; h < 4; h++)
+	    if(scan.isMeasurementValid(2 * v, 4 + h))
+		block.push_back(scan.distances[scan.getIndex(2 * v, 4 + h)]);
+    std::sort(block.begin(), block.end());
+    BOOST_CHECK_EQUAL(decimated.distances[1], block[(block.size() - 1) / 2]);
+    
+    // the decimated rows are at the centers of the blocks
+    std::vector<Eigen::Vector3d> full_points;
+    scan.convertDepthMapToPointCloud(full_points, false, false);
+    decimated.convertDepthMapToPointCloud(points, false, false);
+    Eigen::Vector3d first = full_points[scan.getIndex(1, 0)], last = full_points[scan.getIndex(1, 3)];
+    BOOST_CHECK_CLOSE(std::atan2(points[0].y(), points[0].x()), 
+		      0.5 * (std::atan2(first.y(), first.x()) + std::atan2(last.y(), last.x())), 1e-6);
+    BOOST_CHECK_CLOSE(points[0].z() / points[0].norm(), first.z() / first.norm(), 1e-6);
+    
+    // blocks without valid measurement keep their first one
+    std::fill(scan.distances.begin(), scan.distances.end(), 0.0f);
+    strided.decimate(decimated, 2, 4);
+    BOOST_CHECK(decimated.getIndexState(0) == base::samples::DepthMap::TOO_NEAR);
+    
+    // the first and last timestamps are interpolated for the rows of the view
+    scan.timestamps.resize(2);
+    scan.timestamps[1] = start + base::Time::fromMilliseconds(70);
+    std::vector<base::Time> row_times;
+    base::interpolateTimes(scan.timestamps, scan.vertical_size, row_times);
+    std::vector<base::Time> view_times = view.getTimestamps();
+    BOOST_REQUIRE(view_times.size() == 3);
+    for(unsigned v = 0; v < 3; v++)
+	BOOST_CHECK_EQUAL(view_times[v], row_times[1 + 2 * v]);
+    view.toDepthMap(copy);
+    BOOST_CHECK(copy.timestamps == view_times);
+    strided.decimate(decimated, 2, 4);
+    BOOST_REQUIRE(decimated.timestamps.size() == 2);
+    BOOST_CHECK_EQUAL(decimated.timestamps[1], row_times[4]);
+    // or for its columns
+    std::vector<base::Time> column_times;
+    base::interpolateTimes(scan.timestamps, scan.horizontal_size, column_times);
+    view_times = view.getTimestamps(false);
+    BOOST_REQUIRE(view_times.size() == 10);
+    BOOST_CHECK_EQUAL(view_times[9], column_times[5 + 3 * 9]);
+    // a view of all rows keeps them
+    BOOST_CHECK(base::samples::DepthMapView(scan, 0, 5, 7, 10, 1, 3).getTimestamps() == scan.timestamps);
+}
+
 BOOST_AUTO_TEST_CASE( pose_test )
 {
     Eigen::Vector3d pos( 10, -1, 20.5 );
@@ -996,8 +1860,672 @@ BOOST_AUTO_TEST_CASE( logging_test )
         printf("Estimated time per log msg %f seconds", seconds);
 }
 
+static void* logging_async_thread(void*)
+{
+    for(int i = 0; i < 1000; i++)
+        LOG_INFO("async message %d", i)
+    return 0;
+}
+
+BOOST_AUTO_TEST_CASE( logging_async_test )
+{
+    using base::logging::Logger;
+    FILE* s = tmpfile();
+    Logger::getInstance()->configure(base::logging::INFO, s, base::logging::ASYNC_BLOCK, 16);
+
+    pthread_t threads[4];
+    for(int i = 0; i < 4; ++i)
+        pthread_create(&threads[i], 0, logging_async_thread, 0);
+    for(int i = 0; i < 4; ++i)
+        pthread_join(threads[i], 0);
+    LOG_INFO_S << "stream message";
+
+    // The strings given to log need not outlive the call
+    char name[16];
+    strcpy(name, "temporary_name");
+    Logger::getInstance()->log(base::logging::INFO, name, name, 1, name, "copied message");
+    memset(name, 'x', sizeof(name) - 1);
+    Logger::getInstance()->flush();
+
+    // Nothing got dropped in blocking mode
+    rewind(s);
+    char line[2048];
+    int count = 0, streamed = 0, copied = 0;
+    while(fgets(line, sizeof(line), s))
+    {
+        if(strstr(line, "async message"))
+            ++count;
+        else if(strstr(line, "stream message"))
+            ++streamed;
+        else if(strstr(line, "copied message"))
+        {
+            ++copied;
+            BOOST_CHECK(strstr(line, "temporary_name::copied message"));
+        }
+    }
+    BOOST_CHECK_EQUAL(4000, count);
+    BOOST_CHECK_EQUAL(1, streamed);
+    BOOST_CHECK_EQUAL(1, copied);
+
+    Logger::getInstance()->configure(base::logging::INFO, stderr, base::logging::SYNC);
+    fclose(s);
+}
+
+static size_t encodeArguments(char* buffer, size_t size, const char* format, ...)
+{
+    va_list arguments;
+    va_start(arguments, format);
+    size_t result = base::logging::encodeBinaryArguments(buffer, size, format, arguments);
+    va_end(arguments);
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE( logging_binary_test )
+{
+    using base::logging::Logger;
+    FILE* s = tmpfile();
+    Logger::getInstance()->configure(base::logging::INFO, s);
+    Logger::getInstance()->setLogFormat(base::logging::BINARY);
+    LOG_INFO("int %d, long %ld, unsigned %u, hex %#x, width %*d, %%", -42, 123456789012L, 42u, 255, 5, 7)
+    LOG_WARN("double %.3f, string '%s', char %c, size %zu", 3.14159, "text", 'x', static_cast<size_t>(17))
+    LOG_INFO_S << "stream message";
+    std::string longString(2000, 'a');
+    LOG_ERROR("long %s end", longString.c_str())
+    Logger::getInstance()->setLogFormat(base::logging::DEFAULT);
+    Logger::getInstance()->configure(base::logging::INFO, stderr);
+
+    rewind(s);
+    FILE* decoded = tmpfile();
+    BOOST_REQUIRE(base::logging::decodeBinaryLog(s, decoded, base::logging::SHORT));
+    rewind(decoded);
+    char line[4096];
+    std::vector<std::string> lines;
+    while(fgets(line, sizeof(line), decoded))
+        lines.push_back(line);
+    fclose(decoded);
+    fclose(s);
+
+    // Lines are "[PRIO] - namespace::message"
+    BOOST_REQUIRE_EQUAL(4, lines.size());
+    BOOST_CHECK_EQUAL(0, lines[0].find("[ INFO]"));
+    BOOST_CHECK_EQUAL("::int -42, long 123456789012, unsigned 42, hex 0xff, width     7, %\n", lines[0].substr(lines[0].find("::")));
+    BOOST_CHECK_EQUAL(0, lines[1].find("[ WARN]"));
+    BOOST_CHECK_EQUAL("::double 3.142, string 'text', char x, size 17\n", lines[1].substr(lines[1].find("::")));
+    BOOST_CHECK_EQUAL("::stream message\n", lines[2].substr(lines[2].find("::")));
+    // Strings are truncated to fit in the record
+    BOOST_CHECK_EQUAL(0, lines[3].find("[ERROR]"));
+    BOOST_CHECK_EQUAL(0, lines[3].substr(lines[3].find("::")).find("::long aaa"));
+    BOOST_CHECK(lines[3].size() < 1100);
+
+    // Formats that are not literals are copied, in the SYNC and ASYNC modes
+    for(int mode = base::logging::SYNC; mode <= base::logging::ASYNC_BLOCK; mode += 2)
+    {
+        s = tmpfile();
+        Logger::getInstance()->configure(base::logging::INFO, s, static_cast<base::logging::LogMode>(mode), 16);
+        Logger::getInstance()->setLogFormat(base::logging::BINARY);
+        char format[32];
+        strcpy(format, "first %d");
+        Logger::getInstance()->log(base::logging::INFO, "function", "file", 1, "ns", format, 1);
+        // Names that are not literals are written again when they change
+        char name_space[16];
+        strcpy(name_space, "first_ns");
+        Logger::getInstance()->log(base::logging::INFO, "function", "file", 1, name_space, "in %s", name_space);
+        strcpy(name_space, "second_ns");
+        Logger::getInstance()->log(base::logging::INFO, "function", "file", 1, name_space, "in %s", name_space);
+        strcpy(format, "second %s");
+        int value = 2;
+        LOG_INFO(format, "2")
+        memset(format, 'x', sizeof(format) - 1);
+        LOG_INFO("literal %d", value)
+        Logger::getInstance()->configure(base::logging::INFO, stderr, base::logging::SYNC);
+        Logger::getInstance()->setLogFormat(base::logging::DEFAULT);
+
+        rewind(s);
+        decoded = tmpfile();
+        BOOST_REQUIRE(base::logging::decodeBinaryLog(s, decoded, base::logging::SHORT));
+        rewind(decoded);
+        lines.clear();
+        while(fgets(line, sizeof(line), decoded))
+            lines.push_back(line);
+        fclose(decoded);
+        fclose(s);
+        BOOST_REQUIRE_EQUAL(5, lines.size());
+        BOOST_CHECK_EQUAL("ns::first 1\n", lines[0].substr(lines[0].find("ns::")));
+        BOOST_CHECK_EQUAL("first_ns::in first_ns\n", lines[1].substr(lines[1].find("first_ns::")));
+        BOOST_CHECK_EQUAL("second_ns::in second_ns\n", lines[2].substr(lines[2].find("second_ns::")));
+        BOOST_CHECK_EQUAL("::second 2\n", lines[3].substr(lines[3].find("::")));
+        BOOST_CHECK_EQUAL("::literal 2\n", lines[4].substr(lines[4].find("::")));
+    }
+
+    // Literal text is copied, incomplete conversions included
+    char message[32];
+    int64_t argument = 42;
+    BOOST_CHECK_EQUAL(16, base::logging::formatBinaryArguments(message, sizeof(message), "%d%% done, tail %",
+                reinterpret_cast<const char*>(&argument), sizeof(argument)));
+    BOOST_CHECK_EQUAL("42% done, tail %", std::string(message));
+    BOOST_CHECK_EQUAL(11, base::logging::formatBinaryArguments(message, sizeof(message), "50%% of 100%", 0, 0));
+    BOOST_CHECK_EQUAL("50% of 100%", std::string(message));
+    BOOST_CHECK_EQUAL(3, base::logging::formatBinaryArguments(message, 4, "ab%%cdef", 0, 0));
+    BOOST_CHECK_EQUAL("ab%", std::string(message));
+
+    // A precision limits the string that is read, it need not be terminated
+    struct { char text[4]; char next[4]; } unterminated = { { 'a', 'b', 'c', 'd' }, { 'e', 'f', 'g', 0 } };
+    char arguments[64];
+    size_t size = encodeArguments(arguments, sizeof(arguments), "%.*s|%.2s", 3, unterminated.text, unterminated.text);
+    BOOST_CHECK_EQUAL(8 + 4 + 3 + 4 + 2, size);
+    base::logging::formatBinaryArguments(message, sizeof(message), "%.*s|%.2s", arguments, size);
+    BOOST_CHECK_EQUAL("abc|ab", std::string(message));
+
+    // Wide strings and characters are not supported
+    size = encodeArguments(arguments, sizeof(arguments), "%ls %lc, %d", L"wide", L'w', 5);
+    BOOST_CHECK_EQUAL(0, size);
+    base::logging::formatBinaryArguments(message, sizeof(message), "%ls %lc, %d", arguments, size);
+    BOOST_CHECK_EQUAL("<?> <?>, <?>", std::string(message));
+}
+
+#undef BASE_LOG_NAMESPACE
+#define BASE_LOG_NAMESPACE other_lib
+static void logFromOtherLib(int& evaluated)
+{
+    LOG_DEBUG("other %d", ++evaluated)
+    LOG_DEBUG_S << "other stream " << ++evaluated;
+}
+#undef BASE_LOG_NAMESPACE
+#define BASE_LOG_NAMESPACE ""
+
+BOOST_AUTO_TEST_CASE( logging_namespace_level_test )
+{
+    using base::logging::Logger;
+    FILE* s = tmpfile();
+    Logger::getInstance()->configure(base::logging::INFO, s);
+    Logger::getInstance()->setLogFormat(base::logging::SHORT);
+
+    // The arguments of disabled statements are not evaluated
+    int evaluated = 0;
+    logFromOtherLib(evaluated);
+    LOG_DEBUG("default %d", ++evaluated)
+    BOOST_CHECK_EQUAL(0, evaluated);
+
+    Logger::getInstance()->setLogLevel("other_lib", base::logging::DEBUG);
+    BOOST_CHECK_EQUAL(base::logging::DEBUG, Logger::getInstance()->getLogLevel("other_lib"));
+    logFromOtherLib(evaluated);
+    LOG_DEBUG("default %d", ++evaluated)
+    BOOST_CHECK_EQUAL(2, evaluated);
+
+    Logger::getInstance()->clearLogLevel("other_lib");
+    BOOST_CHECK_EQUAL(base::logging::INFO, Logger::getInstance()->getLogLevel("other_lib"));
+    logFromOtherLib(evaluated);
+    BOOST_CHECK_EQUAL(2, evaluated);
+
+    Logger::getInstance()->setLogFormat(base::logging::DEFAULT);
+    Logger::getInstance()->configure(base::logging::INFO, stderr);
+
+    rewind(s);
+    char line[1024];
+    std::vector<std::string> lines;
+    while(fgets(line, sizeof(line), s))
+        lines.push_back(line);
+    fclose(s);
+
+    BOOST_REQUIRE_EQUAL(2, lines.size());
+    BOOST_CHECK_EQUAL("[DEBUG] - other_lib::other 1\n", lines[0]);
+    BOOST_CHECK_EQUAL("[DEBUG] - other_lib::other stream 2\n", lines[1]);
+}
+
+BOOST_AUTO_TEST_CASE( logging_site_unregister_test )
+{
+    using base::logging::Logger;
+    using base::logging::LogSite;
+
+    using base::logging::LogSiteOwner;
+
+    // The sites need no guard, their owner unregisters them
+    BOOST_STATIC_ASSERT(boost::has_trivial_destructor<LogSite>::value);
+
+    // Sites whose storage goes away, as the statics of an unloaded library
+    union { char bytes[2 * sizeof(LogSite)]; uint64_t align; } storage;
+    LogSiteOwner* owner = new LogSiteOwner();
+    for(int i = 0; i < 2; ++i)
+    {
+        LogSite init = { "unloaded_lib", LogSite::UNREGISTERED, 0, owner, __FILE__, __LINE__, 0, 0, 0, 0 };
+        LogSite* site = new (storage.bytes + i * sizeof(LogSite)) LogSite(init);
+        BOOST_CHECK(site->enabled(base::logging::ERROR));
+    }
+    BOOST_CHECK(owner->registered);
+    delete owner;
+    memset(storage.bytes, 0xff, sizeof(storage.bytes));
+
+    // The logger does not update the site anymore
+    Logger::getInstance()->setLogLevel("unloaded_lib", base::logging::DEBUG);
+    Logger::getInstance()->clearLogLevel("unloaded_lib");
+    BOOST_CHECK(std::count(storage.bytes, storage.bytes + sizeof(storage.bytes), '\xff') == (int)sizeof(storage.bytes));
+}
+
+BOOST_AUTO_TEST_CASE( logging_rate_limit_test )
+{
+    using base::logging::Logger;
+    FILE* s = tmpfile();
+    Logger::getInstance()->configure(base::logging::INFO, s);
+    Logger::getInstance()->setLogFormat(base::logging::SHORT);
+
+    for(int i = 0; i < 10; ++i)
+    {
+        LOG_INFO_EVERY_N(4, "every n %d", i)
+        LOG_INFO_EVERY_T(3600, "every t %d", i)
+        LOG_INFO_ONCE("once %d", i)
+    }
+
+    Logger::getInstance()->setBurstLimit(3, 0.2);
+    for(int j = 0; j < 2; ++j)
+    {
+        for(int i = 0; i < 10; ++i)
+            LOG_INFO("burst %d", i)
+        usleep(250000);
+    }
+    Logger::getInstance()->setBurstLimit(0);
+
+    Logger::getInstance()->setLogFormat(base::logging::DEFAULT);
+    Logger::getInstance()->configure(base::logging::INFO, stderr);
+
+    rewind(s);
+    char line[1024];
+    std::vector<std::string> lines;
+    while(fgets(line, sizeof(line), s))
+        lines.push_back(std::string(line).substr(std::string(line).find("::") + 2));
+    fclose(s);
+
+    const char* expected[] = { "every n 0\n", "every t 0\n", "once 0\n", "every n 4\n", "every n 8\n",
+        "burst 0\n", "burst 1\n", "burst 2\n",
+        "last message repeated 7 times\n", "burst 0\n", "burst 1\n", "burst 2\n" };
+    BOOST_REQUIRE_EQUAL(12, lines.size());
+    for(size_t i = 0; i < lines.size(); ++i)
+        BOOST_CHECK_EQUAL(expected[i], lines[i]);
+
+    base::RateLimit limit = base::RateLimit();
+    unsigned int suppressed;
+    BOOST_CHECK(limit.allow(base::Time::fromSeconds(3600), suppressed));
+    BOOST_CHECK_EQUAL(0, suppressed);
+    BOOST_CHECK(!limit.allow(base::Time::fromSeconds(3600), suppressed));
+    BOOST_CHECK(!limit.allow(base::Time::fromSeconds(3600), suppressed));
+    limit.next = 0;
+    BOOST_CHECK(limit.allow(base::Time::fromSeconds(3600), suppressed));
+    BOOST_CHECK_EQUAL(2, suppressed);
+}
+
+BOOST_AUTO_TEST_CASE( logging_sinks_test )
+{
+    using namespace base::logging;
+    Logger* logger = Logger::getInstance();
+    logger->configure(INFO, stderr);
+    logger->setLogFormat(SHORT);
+    logger->setStreamEnabled(false);
+
+    std::string socketPath = "/tmp/base_logging_sinks_test.sock";
+    unlink(socketPath.c_str());
+    int collector = socket(AF_UNIX, SOCK_DGRAM, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketPath.c_str());
+    BOOST_REQUIRE_EQUAL(0, bind(collector, reinterpret_cast<sockaddr*>(&address), sizeof(address)));
+
+    std::string ringPath = "/tmp/base_logging_sinks_test.ring";
+    MemoryLogSink memory(3);
+    UnixDatagramLogSink datagram(socketPath, true);
+    {
+        MappedRingLogSink ring(ringPath, 64);
+        logger->addSink(&memory);
+        logger->addSink(&datagram);
+        logger->addSink(&ring);
+        for(int i = 0; i < 10; ++i)
+            LOG_WARN("message %d", i)
+        logger->removeSink(&ring);
+        logger->removeSink(&datagram);
+    }
+    LOG_WARN("only in memory")
+    logger->removeSink(&memory);
+    logger->setStreamEnabled(true);
+    logger->setLogFormat(DEFAULT);
+
+    std::vector<std::string> messages = memory.getMessages();
+    BOOST_REQUIRE_EQUAL(3, messages.size());
+    BOOST_CHECK(messages[0].find("::message 8\n") != std::string::npos);
+    BOOST_CHECK(messages[1].find("::message 9\n") != std::string::npos);
+    BOOST_CHECK(messages[2].find("::only in memory\n") != std::string::npos);
+
+    // The ring keeps the last whole messages that fit
+    std::string text;
+    BOOST_REQUIRE(MappedRingLogSink::read(ringPath, text));
+    BOOST_CHECK_EQUAL(0, text.find("[ WARN]"));
+    BOOST_CHECK(text.find("message 9\n") == text.size() - 10);
+    BOOST_CHECK(text.find("message 0") == std::string::npos);
+    unlink(ringPath.c_str());
+
+    char datagramText[256];
+    ssize_t size = recv(collector, datagramText, sizeof(datagramText), MSG_DONTWAIT);
+    BOOST_REQUIRE(size > 0);
+    std::string first(datagramText, size);
+    BOOST_CHECK_EQUAL(0, first.find("<12>[ WARN] - "));
+    BOOST_CHECK(first.find("::message 0") == first.size() - 11);
+    BOOST_CHECK_EQUAL(0, datagram.getDropped());
+    close(collector);
+    unlink(socketPath.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( logging_ring_wrap_test )
+{
+    using namespace base::logging;
+    std::string ringPath = "/tmp/base_logging_ring_wrap_test.ring";
+    std::string text;
+    {
+        // Messages of 16 bytes, the oldest byte starts message 1
+        MappedRingLogSink ring(ringPath, 64);
+        for(int i = 0; i < 5; ++i)
+        {
+            std::ostringstream message;
+            message << "message " << i << "......\n";
+            ring.write(WARN, message.str().c_str(), message.str().size());
+        }
+        BOOST_REQUIRE(MappedRingLogSink::read(ringPath, text));
+        BOOST_CHECK_EQUAL("message 1......\nmessage 2......\nmessage 3......\nmessage 4......\n", text);
+    }
+
+    // A writer that reserved 16 bytes over message 1 and crashed after
+    // copying 4 of them
+    FILE* file = fopen(ringPath.c_str(), "r+b");
+    BOOST_REQUIRE(file);
+    uint64_t position = 96;
+    char reserved[16] = { 'm', 'e', 's', 's' };
+    BOOST_REQUIRE(fseek(file, 16, SEEK_SET) == 0 && fwrite(&position, sizeof(position), 1, file) == 1);
+    // After the header and the one-word bitmap of the message starts
+    BOOST_REQUIRE(fseek(file, 64 + 8 + 16, SEEK_SET) == 0 && fwrite(reserved, sizeof(reserved), 1, file) == 1);
+    fclose(file);
+    BOOST_REQUIRE(MappedRingLogSink::read(ringPath, text));
+    BOOST_CHECK_EQUAL("message 2......\nmessage 3......\nmessage 4......\n", text);
+    unlink(ringPath.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( logging_pattern_test )
+{
+    using namespace base::logging;
+    Logger* logger = Logger::getInstance();
+    MemoryLogSink memory;
+    logger->configure(INFO, stderr);
+    logger->setStreamEnabled(false);
+    logger->addSink(&memory);
+
+    LOG_WARN("default %d", 1) int defaultLine = __LINE__;
+    logger->setLogPattern("%p|%n|%m|%L|100%%|%x");
+    LOG_ERROR("pattern %d", 2) int patternLine = __LINE__;
+    logger->setLogFormat(DEFAULT);
+    logger->removeSink(&memory);
+    logger->setStreamEnabled(true);
+
+    std::vector<std::string> messages = memory.getMessages();
+    BOOST_REQUIRE_EQUAL(2, messages.size());
+    // [YYYYmmdd-HH:MM:SS:mmm] [ WARN] - ns::message (file:line - function)
+    std::string const& message = messages[0];
+    BOOST_CHECK_EQUAL('[', message[0]);
+    BOOST_CHECK_EQUAL('-', message[9]);
+    BOOST_CHECK_EQUAL(':', message[18]);
+    BOOST_CHECK_EQUAL("] [ WARN] - ", message.substr(22, 12));
+    std::ostringstream location;
+    location << "::default 1 (" << __FILE__ << ":" << defaultLine << " - ";
+    BOOST_CHECK(message.find(location.str()) != std::string::npos);
+    BOOST_CHECK_EQUAL(")\n", message.substr(message.size() - 2));
+
+    std::ostringstream expected;
+    expected << "ERROR|" << __STRINGIFY(BASE_LOG_NAMESPACE) << "|pattern 2|" << patternLine << "|100%|%x\n";
+    BOOST_CHECK_EQUAL(expected.str(), messages[1]);
+}
+
+static void* logging_pattern_thread(void*)
+{
+    for(int i = 0; i < 500; i++)
+        LOG_ERROR("message %d", i)
+    return 0;
+}
+
+BOOST_AUTO_TEST_CASE( logging_pattern_concurrent_test )
+{
+    using namespace base::logging;
+    Logger* logger = Logger::getInstance();
+    MemoryLogSink memory;
+    logger->configure(INFO, stderr);
+    logger->setStreamEnabled(false);
+    logger->addSink(&memory);
+    logger->setLogPattern("A|%m");
+
+    // the threads log while the pattern is replaced
+    pthread_t threads[4];
+    for(int i = 0; i < 4; ++i)
+        pthread_create(&threads[i], 0, logging_pattern_thread, 0);
+    for(int i = 0; i < 200; ++i)
+        logger->setLogPattern(i % 2 ? "A|%m" : "B|%m");
+    for(int i = 0; i < 4; ++i)
+        pthread_join(threads[i], 0);
+
+    logger->setLogFormat(DEFAULT);
+    logger->removeSink(&memory);
+    logger->setStreamEnabled(true);
+
+    std::vector<std::string> messages = memory.getMessages();
+    BOOST_CHECK_EQUAL(2000, messages.size());
+    for(size_t i = 0; i < messages.size(); ++i)
+    {
+        const std::string& message = messages[i];
+        BOOST_CHECK((message[0] == 'A' || message[0] == 'B') && message.substr(1, 9) == "|message ");
+    }
+}
+
+struct LoggedInStream {};
+
+static std::ostream& operator<<(std::ostream& os, LoggedInStream const&)
+{
+    LOG_INFO_S << "nested message";
+    return os << "custom";
+}
+
+BOOST_AUTO_TEST_CASE( logging_stream_test )
+{
+    using base::logging::Logger;
+    FILE* s = tmpfile();
+    Logger::getInstance()->configure(base::logging::INFO, s);
+    Logger::getInstance()->setLogFormat(base::logging::SHORT);
+
+    base::Time time = base::Time::fromMicroseconds(-1234567);
+    base::Angle angle = base::Angle::fromDeg(90);
+    std::ostringstream expected;
+    expected << -42 << " " << 42u << " " << INT_MIN << " " << LLONG_MIN << " " << ULLONG_MAX << " "
+        << true << " " << 'x' << " " << 0.1 << " " << 1e300 << " " << -2.5f << " " << time << " " << angle;
+    LOG_INFO_S << -42 << " " << 42u << " " << INT_MIN << " " << LLONG_MIN << " " << ULLONG_MAX << " "
+        << true << " " << 'x' << " " << 0.1 << " " << 1e300 << " " << -2.5f << " " << time << " " << angle;
+    // The formatting state is reset between statements
+    LOG_INFO_S << std::hex << 255 << " " << std::setw(4) << std::setfill('0') << 7 << " " << std::fixed << 1.5;
+    LOG_INFO_S << 255 << " " << 1.5;
+    std::string longString(3000, 'a');
+    LOG_INFO_S << "long " << longString << " end";
+    LOG_INFO_S << "outer " << LoggedInStream() << " message";
+
+    Logger::getInstance()->setLogFormat(base::logging::DEFAULT);
+    Logger::getInstance()->configure(base::logging::INFO, stderr);
+
+    rewind(s);
+    char line[4096];
+    std::vector<std::string> lines;
+    while(fgets(line, sizeof(line), s))
+        lines.push_back(std::string(line).substr(std::string(line).find("::") + 2));
+    fclose(s);
+
+    BOOST_REQUIRE_EQUAL(6, lines.size());
+    BOOST_CHECK_EQUAL(expected.str() + "\n", lines[0]);
+    BOOST_CHECK_EQUAL("ff 0007 1.500000\n", lines[1]);
+    BOOST_CHECK_EQUAL("255 1.5\n", lines[2]);
+    BOOST_CHECK_EQUAL("long " + longString + " end\n", lines[3]);
+    BOOST_CHECK_EQUAL("nested message\n", lines[4]);
+    BOOST_CHECK_EQUAL("outer custom message\n", lines[5]);
+}
+
+static void logAtThreadExit(void*)
+{
+    LOG_INFO_S << "late message";
+}
+
+static void* logging_stream_exit_thread(void* key)
+{
+    LOG_INFO_S << "thread message";
+    pthread_setspecific(*static_cast<pthread_key_t*>(key), key);
+    return 0;
+}
+
+BOOST_AUTO_TEST_CASE( logging_stream_thread_exit_test )
+{
+    using base::logging::Logger;
+    FILE* s = tmpfile();
+    Logger::getInstance()->configure(base::logging::INFO, s);
+    Logger::getInstance()->setLogFormat(base::logging::SHORT);
+
+    // The destructor of this key runs after the one of the stream state
+    pthread_key_t key;
+    pthread_key_create(&key, logAtThreadExit);
+    pthread_t thread;
+    pthread_create(&thread, 0, logging_stream_exit_thread, &key);
+    pthread_join(thread, 0);
+    pthread_key_delete(key);
+
+    Logger::getInstance()->setLogFormat(base::logging::DEFAULT);
+    Logger::getInstance()->configure(base::logging::INFO, stderr);
+
+    rewind(s);
+    char line[4096];
+    std::vector<std::string> lines;
+    while(fgets(line, sizeof(line), s))
+        lines.push_back(std::string(line).substr(std::string(line).find("::") + 2));
+    fclose(s);
+
+    BOOST_REQUIRE_EQUAL(2, lines.size());
+    BOOST_CHECK_EQUAL("thread message\n", lines[0]);
+    BOOST_CHECK_EQUAL("late message\n", lines[1]);
+}
+
+class CountedSingleton : public base::Singleton<CountedSingleton>
+{
+    friend class base::Singleton<CountedSingleton>;
+    CountedSingleton()
+    {
+        __atomic_add_fetch(&constructed, 1, __ATOMIC_RELAXED);
+        // Widen the window in which other threads ask for the instance
+        usleep(10000);
+    }
+public:
+    ~CountedSingleton() { ++destroyed; }
+    static int constructed;
+    static int destroyed;
+};
+int CountedSingleton::constructed = 0;
+int CountedSingleton::destroyed = 0;
+
+static void* singleton_thread(void* instance)
+{
+    *static_cast<CountedSingleton**>(instance) = CountedSingleton::getInstance();
+    return 0;
+}
+
+BOOST_AUTO_TEST_CASE( singleton_test )
+{
+    pthread_t threads[8];
+    CountedSingleton* instances[8];
+    for(int i = 0; i < 8; ++i)
+        pthread_create(&threads[i], 0, singleton_thread, &instances[i]);
+    for(int i = 0; i < 8; ++i)
+        pthread_join(threads[i], 0);
+
+    BOOST_CHECK_EQUAL(1, CountedSingleton::constructed);
+    for(int i = 0; i < 8; ++i)
+        BOOST_CHECK_EQUAL(instances[0], instances[i]);
+
+    CountedSingleton::destroyInstance();
+    BOOST_CHECK_EQUAL(1, CountedSingleton::destroyed);
+    CountedSingleton::getInstance();
+    BOOST_CHECK_EQUAL(2, CountedSingleton::constructed);
+}
+
 #include <base/Float.hpp>
 
+BOOST_AUTO_TEST_CASE( profiler_test )
+{
+    using base::profiling::Profiler;
+    Profiler* profiler = Profiler::getInstance();
+    profiler->clear();
+
+    { BASE_PROFILE_ZONE("disabled"); }
+    Profiler::setEnabled(true);
+    for(int i = 0; i < 100; ++i)
+    {
+        BASE_PROFILE_ZONE("outer \"zone\"");
+        BASE_PROFILE_ZONE("inner");
+    }
+    Profiler::record("fixed", 1000, 1000 + 5000);
+    Profiler::setEnabled(false);
+    profiler->collect();
+
+    std::vector<Profiler::Statistics> stats = profiler->getStatistics();
+    BOOST_REQUIRE_EQUAL(3, stats.size());
+    BOOST_CHECK_EQUAL("fixed", stats[0].label);
+    BOOST_CHECK_EQUAL(1, stats[0].count);
+    BOOST_CHECK_EQUAL(5000, stats[0].min);
+    BOOST_CHECK_EQUAL(5000, stats[0].p50);
+    BOOST_CHECK_EQUAL("inner", stats[1].label);
+    BOOST_CHECK_EQUAL(100, stats[1].count);
+    BOOST_CHECK(stats[1].min <= stats[1].p50 && stats[1].p50 <= stats[1].p99 && stats[1].p99 <= stats[1].max);
+    BOOST_CHECK_EQUAL(100, stats[2].count);
+    BOOST_CHECK_EQUAL(0, profiler->getDroppedCount());
+
+    std::ostringstream trace;
+    profiler->writeChromeTrace(trace);
+    BOOST_CHECK(trace.str().find("\"name\":\"outer \\\"zone\\\"\"") != std::string::npos);
+    BOOST_CHECK(trace.str().find("\"ts\":1.000,\"dur\":5.000") != std::string::npos);
+    profiler->clear();
+}
+
+static void* profiler_thread(void*)
+{
+    for(int i = 0; i < 10; ++i)
+    {
+        BASE_PROFILE_ZONE("thread");
+    }
+    return 0;
+}
+
+BOOST_AUTO_TEST_CASE( profiler_exited_threads_test )
+{
+    using base::profiling::Profiler;
+    Profiler* profiler = Profiler::getInstance();
+    profiler->collect();
+    profiler->clear();
+    size_t threads = profiler->getThreadCount();
+
+    Profiler::setEnabled(true);
+    for(int round = 0; round < 3; ++round)
+    {
+        pthread_t thread[4];
+        for(int i = 0; i < 4; ++i)
+            pthread_create(&thread[i], 0, profiler_thread, 0);
+        for(int i = 0; i < 4; ++i)
+            pthread_join(thread[i], 0);
+        BOOST_CHECK_EQUAL(threads + 4, profiler->getThreadCount());
+
+        // The events recorded before exiting are kept, the buffers are freed
+        profiler->collect();
+        BOOST_CHECK_EQUAL(threads, profiler->getThreadCount());
+        std::vector<Profiler::Statistics> stats = profiler->getStatistics();
+        BOOST_REQUIRE_EQUAL(1, stats.size());
+        BOOST_CHECK_EQUAL(40 * (round + 1), stats[0].count);
+    }
+    Profiler::setEnabled(false);
+    profiler->clear();
+}
+
 BOOST_AUTO_TEST_CASE( test_inf_nan )
 {
     {
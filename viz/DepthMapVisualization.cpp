@@ -70,13 +70,17 @@ void DepthMapVisualization::updateMainNode ( osg::Node* node )
     std::vector<Eigen::Vector3d> points;
     scan_sample.convertDepthMapToPointCloud(points, true, false);
     
+    // validity of all measurements
+    base::samples::DepthMapStatistics statistics;
+    scan_sample.computeStatistics(statistics);
+    
     //set color binding
     osg::ref_ptr<osg::Vec4Array> colors = new osg::Vec4Array();
     if(colorize_magnitude || colorize_altitude)
     {
         for(unsigned i = 0; i < points.size(); i++)
         {
-	    if(scan_sample.isIndexValid(i))
+	    if(statistics.isIndexValid(i))
 	    {
 		double hue = 0.0;
 		if(colorize_altitude)
@@ -98,9 +102,9 @@ void DepthMapVisualization::updateMainNode ( osg::Node* node )
     }
     else if(show_remission && !scan_sample.remissions.empty())
     {
-        for(unsigned i = 0; i < scan_sample.remissions.size(); i++)
+        for(unsigned i = 0; i < std::min(scan_sample.remissions.size(), points.size()); i++)
         {
-	    if(scan_sample.isIndexValid(i))
+	    if(statistics.isIndexValid(i))
 		colors->push_back(osg::Vec4(0,0,scan_sample.remissions[i],0.5));
         }
 
@@ -125,10 +129,10 @@ void DepthMapVisualization::updateMainNode ( osg::Node* node )
 
     // convert points to osg
     osg::Vec3Array *scan_vertices = new osg::Vec3Array();
-    scan_vertices->reserve(points.size());
+    scan_vertices->reserve(statistics.getValidCount());
     for(unsigned i = 0; i < points.size(); i++)
     {
-	if(scan_sample.isIndexValid(i))
+	if(statistics.isIndexValid(i))
 	    scan_vertices->push_back(eigenVectorToOsgVec3(points[i]));
     }
     slope_geom->setVertexArray(scan_vertices);
@@ -145,11 +149,11 @@ void DepthMapVisualization::updateMainNode ( osg::Node* node )
         osg::ref_ptr<osg::Vec4Array> slope_colors = new osg::Vec4Array();
 
         base::samples::DepthMap::DepthMatrixMapConst depth_map = scan_sample.getDistanceMatrixMapConst();
-	for(unsigned row = 0; row < depth_map.rows()-1; row++)
+	for(unsigned row = 0; row + 1 < depth_map.rows(); row++)
 	{
 	    for(unsigned col = 0; col < depth_map.cols(); col++)
 	    {
-		if(scan_sample.isMeasurementValid(row, col) && scan_sample.isMeasurementValid(row+1, col) &&
+		if(statistics.isIndexValid(scan_sample.getIndex(row, col)) && statistics.isIndexValid(scan_sample.getIndex(row+1, col)) &&
 		    (std::min(depth_map(row, col), depth_map(row+1, col)) * 1.3) >= std::max(depth_map(row, col), depth_map(row+1, col)))
 		{
 		    Eigen::Vector3d point1 = points[scan_sample.getIndex(row,col)];